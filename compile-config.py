@@ -0,0 +1,190 @@
+#! /usr/bin/env python2.7
+#
+# Tool intended to help facilitate the process of booting Linux on Intel
+# Macintosh computers made by Apple from a USB stick or similar.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# Copyright (C) 2014 SevenBits
+#
+#
+from __future__ import print_function
+import re
+import struct
+import sys
+import zlib
+""" Note: like verify-install.py, this program assumes that it is being
+ executed from the root directory of a USB drive containing an
+ installation of Enterprise.
+
+ 	It compiles efi/boot/.MLUL-Live-USB into efi/boot/.MLUL-Live-USB.plan,
+ which Enterprise loads instead of parsing the configuration file. The file
+ is read exactly the way the loader reads it, and every distribution family
+ is resolved here, so mistakes are reported now rather than at boot time.
+ Run it again whenever the configuration file changes; Enterprise ignores a
+ plan that is older than the file, or that was built from a file of a
+ different size. The layout is described in src/plan.h."""
+
+PLAN_SIGNATURE = 0x50424E45 # "ENBP"
+PLAN_VERSION = 2
+PLAN_HEADER = struct.Struct("<IHHIIQIIIIIII")
+PLAN_ENTRY = struct.Struct("<IIIII")
+
+PLAN_TIMEOUT = 0x01
+PLAN_HEADLESS_SET = 0x02
+PLAN_HEADLESS = 0x04
+
+## The same table as distribution.c: (kernel, initrd, boot folder).
+DISTRIBUTIONS = {
+	b"Debian": (b"/live/vmlinuz", b"/live/initrd.img", b"live"),
+	b"Ubuntu": (b"/casper/vmlinuz", b"/casper/initrd.lz", b"casper"),
+	b"Mint": (b"/casper/vmlinuz", b"/casper/initrd.lz", b"casper"),
+}
+
+ENTRY_KEYS = [b"family", b"kernel", b"initrd", b"root"]
+
+def main():
+	"""The program's main method."""
+	source = "efi/boot/.MLUL-Live-USB"
+	output = source + ".plan"
+	if len(sys.argv) > 1:
+		source = sys.argv[1]
+		output = source + ".plan"
+	if len(sys.argv) > 2:
+		output = sys.argv[2]
+	if len(sys.argv) > 3:
+		print("Usage: {0} [configuration file] [plan file]".format(sys.argv[0]))
+		sys.exit(2)
+
+	try:
+		with open(source, "rb") as file:
+			contents = file.read()
+	except IOError as error:
+		print("Cannot read {0}: {1}".format(source, error.strerror))
+		sys.exit(1)
+
+	entries, settings, warnings, errors = compileConfiguration(contents)
+	for message in warnings:
+		print(message)
+	if errors:
+		for message in errors:
+			print(message)
+		print("The plan was not written.")
+		sys.exit(1)
+
+	with open(output, "wb") as file:
+		file.write(buildPlan(entries, settings, len(contents)))
+	print("Wrote {0} entries to {1}.".format(len(entries), output))
+
+def configurationLines(contents):
+	"""Yield (line number, key, value) for each line that the loader's
+		tokenizer would return: it stops at a NUL, splits lines at CR or LF,
+		and skips comments and keys without a value."""
+	contents = contents.split(b"\0", 1)[0]
+	for lineNumber, line in enumerate(contents.split(b"\n")):
+		for part in line.split(b"\r"):
+			key, value = re.match(b"[ \t]*([^ \t]*)[ \t]*(.*)", part).groups()
+			value = value.rstrip(b" \t")
+			if not key or key.startswith(b"#") or not value:
+				continue
+			yield (lineNumber + 1, key, value)
+
+def compileConfiguration(contents):
+	"""Resolve the configuration file into a list of entries, each a
+		dictionary of byte strings, and a dictionary of global settings,
+		along with lists of warnings and errors. Mirrors
+		ParseConfiguration() in config.c: the loader skips over whatever
+		causes a warning, and refuses to boot on an error."""
+	entries = []
+	settings = {}
+	warnings = []
+	errors = []
+	entry = None
+	for lineNumber, key, value in configurationLines(contents):
+		where = "Line {0}: ".format(lineNumber)
+		if key == b"entry":
+			entry = {"name": value}
+			entries.append(entry)
+		elif key == b"timeout":
+			if value.isdigit():
+				settings["timeout"] = int(value)
+			else:
+				warnings.append(where + "warning: invalid timeout {0}".format(value.decode("utf-8", "replace")))
+		elif key == b"headless":
+			if value in (b"true", b"yes", b"1"):
+				settings["headless"] = True
+			elif value in (b"false", b"no", b"0"):
+				settings["headless"] = False
+			else:
+				warnings.append(where + "warning: invalid value for headless")
+		elif key == b"discover":
+			settings["discover"] = value
+		elif key not in ENTRY_KEYS:
+			warnings.append(where + "warning: unrecognized option {0}".format(key.decode("utf-8", "replace")))
+		elif entry is None:
+			warnings.append(where + "warning: {0} appears before any entry".format(key.decode("utf-8", "replace")))
+		elif key == b"family":
+			if value not in DISTRIBUTIONS:
+				errors.append(where + "distribution family {0} is not supported"
+					.format(value.decode("utf-8", "replace")))
+				continue
+			entry["family"] = value
+			entry["kernel"], entry["initrd"], entry["root"] = DISTRIBUTIONS[value]
+		else:
+			entry[key.decode("ascii")] = value
+
+	if not entries and "discover" not in settings:
+		errors.append("The configuration file has no entries, and does not ask for any to be discovered.")
+	if settings.get("timeout", 0) > 0xFFFFFFFF:
+		errors.append("The timeout is too long.")
+	return (entries, settings, warnings, errors)
+
+def buildPlan(entries, settings, sourceSize):
+	"""Lay the entries out as a boot plan, as described in plan.h."""
+	strings = bytearray(b"\0")
+	offsets = {b"": 0}
+	def stringOffset(value):
+		if value not in offsets:
+			offsets[value] = len(strings)
+			strings.extend(value + b"\0")
+		return offsets[value]
+
+	records = bytearray()
+	for entry in entries:
+		records.extend(PLAN_ENTRY.pack(
+			stringOffset(entry["name"]),
+			stringOffset(entry.get("family", b"")),
+			stringOffset(entry.get("kernel", b"")),
+			stringOffset(entry.get("initrd", b"")),
+			stringOffset(entry.get("root", b""))))
+
+	discover = stringOffset(settings.get("discover", b""))
+	flags = 0
+	if "timeout" in settings:
+		flags |= PLAN_TIMEOUT
+	if "headless" in settings:
+		flags |= PLAN_HEADLESS_SET
+		if settings["headless"]:
+			flags |= PLAN_HEADLESS
+
+	stringsOffset = PLAN_HEADER.size + len(records)
+	size = stringsOffset + len(strings)
+	def header(checksum):
+		return PLAN_HEADER.pack(PLAN_SIGNATURE, PLAN_VERSION, PLAN_HEADER.size, size, checksum,
+			sourceSize, len(entries), PLAN_ENTRY.size, stringsOffset, len(strings),
+			settings.get("timeout", 0), flags, discover)
+
+	body = bytes(records + strings)
+	checksum = zlib.adler32(header(0) + body) & 0xFFFFFFFF
+	return header(checksum) + body
+
+if  __name__ == '__main__':
+	main()
@@ -0,0 +1,107 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~((UINTN)ARENA_ALIGNMENT - 1))
+
+/* Each run of pages starts with this header, linking it to the previous run. */
+typedef struct ArenaBlock {
+	struct ArenaBlock *next;
+	UINTN pages;
+} ArenaBlock;
+
+VOID ArenaInitialize(MemoryArena *arena, UINTN block_size) {
+	arena->blocks = NULL;
+	arena->next = NULL;
+	arena->remaining = 0;
+	arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+static BOOLEAN ArenaGrow(MemoryArena *arena, UINTN size) {
+	EFI_PHYSICAL_ADDRESS address;
+	ArenaBlock *block;
+	UINTN bytes, pages;
+	EFI_STATUS err;
+
+	bytes = ARENA_ALIGN(sizeof(ArenaBlock)) + size;
+	if (bytes < arena->block_size) {
+		bytes = arena->block_size;
+	}
+	pages = EFI_SIZE_TO_PAGES(bytes);
+
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, pages, &address);
+	if (EFI_ERROR(err)) {
+		return FALSE;
+	}
+
+	block = (ArenaBlock *)(UINTN)address;
+	block->next = arena->blocks;
+	block->pages = pages;
+	arena->blocks = block;
+
+	arena->next = (UINT8 *)block + ARENA_ALIGN(sizeof(ArenaBlock));
+	arena->remaining = pages * EFI_PAGE_SIZE - ARENA_ALIGN(sizeof(ArenaBlock));
+	return TRUE;
+}
+
+/*
+ * Returns memory that lives until the arena is released. If no arena is
+ * given the memory comes from the pool instead, and the caller owns it.
+ */
+VOID* ArenaAllocate(MemoryArena *arena, UINTN size) {
+	VOID *p;
+
+	if (!arena) {
+		return AllocatePool(size);
+	}
+
+	size = ARENA_ALIGN(size);
+	if (size > arena->remaining && !ArenaGrow(arena, size)) {
+		return NULL;
+	}
+
+	p = arena->next;
+	arena->next += size;
+	arena->remaining -= size;
+	return p;
+}
+
+VOID* ArenaAllocateZero(MemoryArena *arena, UINTN size) {
+	VOID *p = ArenaAllocate(arena, size);
+	if (p) {
+		ZeroMem(p, size);
+	}
+	return p;
+}
+
+VOID ArenaRelease(MemoryArena *arena) {
+	while (arena->blocks) {
+		ArenaBlock *block = arena->blocks;
+
+		arena->blocks = block->next;
+		uefi_call_wrapper(BS->FreePages, 2, (EFI_PHYSICAL_ADDRESS)(UINTN)block, block->pages);
+	}
+
+	arena->next = NULL;
+	arena->remaining = 0;
+}
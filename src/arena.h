@@ -0,0 +1,43 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _arena_h
+#define _arena_h
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+struct ArenaBlock;
+
+/*
+ * A bump allocator backed by whole pages from the firmware. Allocations are
+ * never freed individually; ArenaRelease() hands every page back at once.
+ */
+typedef struct MemoryArena {
+	struct ArenaBlock *blocks;
+	UINT8 *next;
+	UINTN remaining;
+	UINTN block_size;
+} MemoryArena;
+
+VOID ArenaInitialize(MemoryArena *arena, UINTN block_size);
+VOID* ArenaAllocate(MemoryArena *arena, UINTN size);
+VOID* ArenaAllocateZero(MemoryArena *arena, UINTN size);
+VOID ArenaRelease(MemoryArena *arena);
+
+#endif
@@ -0,0 +1,923 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Host-side microbenchmarks for the configuration parser and the string
+ * converters. Synthetic .MLUL-Live-USB files are generated in memory and run
+ * through the loader's own ParseConfiguration(); the cost is reported per
+ * line along with the number of firmware pool allocations and the peak
+ * memory held. The same entries are then laid out as a boot plan, the way
+ * compile-config.py would, and loaded with BootPlanLoad(). Last, a boot
+ * is played against a simulated USB stick to count the firmware calls it
+ * makes and estimate the time they take.
+ *
+ * What is timed is also checked: a parser or converter that gets faster by
+ * getting the answer wrong makes the benchmark exit with a failure.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "../main.h"
+#include "../arena.h"
+#include "../utils.h"
+#include "../convert.h"
+#include "../config.h"
+#include "../discovery.h"
+#include "../sha256.h"
+#include "../iso9660.h"
+#include "../snapshot.h"
+#include "../verify.h"
+#include "../screen.h"
+#include "../log.h"
+#include "../plan.h"
+#include "../disk.h"
+#include "shim.h"
+
+#define MINIMUM_LINES_PER_SIZE 500000
+
+static const char *families[] = { "Ubuntu", "Debian", "Mint" };
+static UINTN failures = 0;
+
+/* Reports a wrong result; main() turns any of them into a failing exit code. */
+static VOID Check(BOOLEAN condition, const char *what, UINTN index) {
+	if (!condition) {
+		fprintf(stderr, "error: %s (%lu)\n", what, (unsigned long)index);
+		failures++;
+	}
+}
+
+static BOOLEAN SameString(CHAR8 *actual, const char *expected) {
+	return actual && strcmp((char *)actual, expected) == 0;
+}
+
+/* Checks a table against what GenerateConfiguration() wrote for it. */
+static VOID CheckEntries(BootEntryTable *table, UINTN entries) {
+	char name[64];
+	UINTN i;
+
+	Check(table->count == entries, "wrong number of entries", table->count);
+	for (i = 0; i < table->count && i < entries; i++) {
+		LinuxBootOption *option = &table->entries[i];
+
+		sprintf(name, "%s Live %lu", families[i % 3], (unsigned long)i);
+		Check(SameString(option->name, name), "wrong entry name", i);
+		Check(SameString(option->distro_family, families[i % 3]), "wrong family", i);
+		if (i % 4 == 3) {
+			Check(SameString(option->kernel_path, "/casper/vmlinuz.efi"), "wrong kernel", i);
+			Check(SameString(option->initrd_path, "/casper/initrd.lz"), "wrong initrd", i);
+			Check(SameString(option->boot_folder, "casper"), "wrong boot folder", i);
+		} else {
+			Check(option->kernel_path && option->kernel_path[0], "no kernel", i);
+			Check(option->initrd_path && option->initrd_path[0], "no initrd", i);
+		}
+	}
+}
+
+/* Generates a configuration file with the given number of entries. Every
+ * fourth entry overrides its kernel and initrd, and comments, blank lines
+ * and mixed indentation are sprinkled in the way hand-edited files have them. */
+static CHAR8* GenerateConfiguration(UINTN entries, UINTN *size, UINTN *lines) {
+	UINTN capacity = 64 + entries * 192;
+	char *buf = malloc(capacity);
+	UINTN len = 0, n = 0, i;
+
+	len += sprintf(buf + len, "# Generated by the Enterprise benchmark\n\n");
+	n += 2;
+	for (i = 0; i < entries; i++) {
+		const char *family = families[i % 3];
+
+		len += sprintf(buf + len, "entry %s Live %lu\n", family, (unsigned long)i);
+		len += sprintf(buf + len, "\tfamily %s\n", family);
+		n += 2;
+		if (i % 4 == 3) {
+			len += sprintf(buf + len, "  kernel  /casper/vmlinuz.efi\n");
+			len += sprintf(buf + len, "  initrd\t/casper/initrd.lz  \n");
+			len += sprintf(buf + len, "root casper\n");
+			n += 3;
+		}
+		if (i % 8 == 0) {
+			len += sprintf(buf + len, "# entry %lu\n\n", (unsigned long)i);
+			n += 2;
+		}
+	}
+
+	buf[len] = '\0';
+	*size = len;
+	*lines = n;
+	return (CHAR8 *)buf;
+}
+
+static VOID BenchmarkParser(UINTN entries) {
+	UINTN size, lines, reps, i;
+	CHAR8 *config = GenerateConfiguration(entries, &size, &lines);
+	CHAR8 *work = malloc(size + 1);
+	UINT64 best = ~0ULL, allocs = 0, peak = 0;
+
+	reps = MINIMUM_LINES_PER_SIZE / lines;
+	if (reps < 3) {
+		reps = 3;
+	}
+
+	for (i = 0; i < reps; i++) {
+		BootEntryTable table;
+		MemoryArena arena;
+		UINT64 start, elapsed;
+
+		memcpy(work, config, size + 1);
+		ShimResetStats();
+
+		start = ShimNanoseconds();
+		ArenaInitialize(&arena, 0);
+		ParseConfiguration(work, &arena, NULL, &table);
+		elapsed = ShimNanoseconds() - start;
+
+		if (elapsed < best) {
+			best = elapsed;
+		}
+		allocs = shim_stats.pool_allocations + shim_stats.page_allocations;
+		peak = shim_stats.peak_bytes;
+		if (i == 0) {
+			CheckEntries(&table, entries);
+		}
+		ArenaRelease(&arena);
+	}
+
+	printf("%8lu %8lu %9lu %10.1f %13.2f %12lu\n", (unsigned long)entries, (unsigned long)lines,
+		(unsigned long)size, (double)best / lines, (double)allocs / entries, (unsigned long)peak);
+
+	free(work);
+	free(config);
+}
+
+/* Appends a string to the plan's string table and returns its offset. Like
+ * compile-config.py, paths and families that repeat are stored only once;
+ * there are few enough of them that a short list of recent ones will do. */
+static UINT32 AddPlanString(CHAR8 *strings, UINT32 *length, CHAR8 *string, BOOLEAN shared) {
+	static UINT32 recent[16];
+	static UINTN recent_count;
+	UINT32 offset = *length;
+	UINTN i;
+
+	if (!string) {
+		return 0;
+	} else if (*length == 1) {
+		recent_count = 0;
+	}
+
+	for (i = 0; shared && i < recent_count; i++) {
+		if (strcmp((char *)strings + recent[i], (char *)string) == 0) {
+			return recent[i];
+		}
+	}
+	if (shared && recent_count < 16) {
+		recent[recent_count++] = offset;
+	}
+
+	strcpy((char *)strings + offset, (char *)string);
+	*length += strlen((char *)string) + 1;
+	return offset;
+}
+
+static UINT32 Adler32(CHAR8 *data, UINTN size) {
+	UINT32 a = 1, b = 0;
+	UINTN i;
+
+	for (i = 0; i < size; i++) {
+		a = (a + (UINT8)data[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+static CHAR8* BuildPlan(BootEntryTable *table, UINT64 source_size, UINTN *size) {
+	UINTN records = sizeof(BootPlanHeader) + table->count * sizeof(BootPlanEntry);
+	CHAR8 *plan = calloc(1, records + table->count * 256 + 1);
+	BootPlanHeader *header = (BootPlanHeader *)plan;
+	CHAR8 *strings = plan + records;
+	UINT32 length = 1;
+	UINTN i;
+
+	for (i = 0; i < table->count; i++) {
+		LinuxBootOption *option = &table->entries[i];
+		BootPlanEntry *record = (BootPlanEntry *)(plan + sizeof(BootPlanHeader)) + i;
+
+		record->name = AddPlanString(strings, &length, option->name, FALSE);
+		record->family = AddPlanString(strings, &length, option->distro_family, TRUE);
+		record->kernel = AddPlanString(strings, &length, option->kernel_path, TRUE);
+		record->initrd = AddPlanString(strings, &length, option->initrd_path, TRUE);
+		record->boot_folder = AddPlanString(strings, &length, option->boot_folder, TRUE);
+	}
+
+	header->signature = BOOT_PLAN_SIGNATURE;
+	header->version = BOOT_PLAN_VERSION;
+	header->header_size = sizeof(BootPlanHeader);
+	header->size = records + length;
+	header->source_size = source_size;
+	header->entry_count = table->count;
+	header->entry_size = sizeof(BootPlanEntry);
+	header->strings_offset = records;
+	header->strings_size = length;
+	header->checksum = Adler32(plan, header->size);
+
+	*size = header->size;
+	return plan;
+}
+
+static VOID BenchmarkPlan(UINTN entries) {
+	UINTN size, lines, plan_size, reps, i;
+	CHAR8 *config = GenerateConfiguration(entries, &size, &lines);
+	CHAR8 *plan;
+	BootEntryTable table;
+	MemoryArena arena;
+	UINT64 best = ~0ULL, allocs = 0;
+
+	ArenaInitialize(&arena, 0);
+	ParseConfiguration(config, &arena, NULL, &table);
+	plan = BuildPlan(&table, size, &plan_size);
+	ArenaRelease(&arena);
+
+	reps = MINIMUM_LINES_PER_SIZE / lines;
+	if (reps < 3) {
+		reps = 3;
+	}
+
+	for (i = 0; i < reps; i++) {
+		UINT64 start, elapsed;
+
+		ShimResetStats();
+		start = ShimNanoseconds();
+		ArenaInitialize(&arena, 0);
+		BootPlanLoad(plan, plan_size, size, &arena, NULL, &table);
+		elapsed = ShimNanoseconds() - start;
+
+		if (elapsed < best) {
+			best = elapsed;
+		}
+		allocs = shim_stats.pool_allocations + shim_stats.page_allocations;
+		if (i == 0) {
+			CheckEntries(&table, entries);
+		}
+		ArenaRelease(&arena);
+	}
+
+	printf("%8lu %9lu %10.1f %13.2f\n", (unsigned long)entries, (unsigned long)plan_size,
+		(double)best / entries, (double)allocs / entries);
+
+	free(plan);
+	free(config);
+}
+
+static VOID BenchmarkASCIItoUTF16(VOID) {
+	CHAR8 *samples[] = {
+		(CHAR8 *)"Ubuntu", (CHAR8 *)"/casper/vmlinuz.efi", (CHAR8 *)"/live/initrd.img",
+		(CHAR8 *)"Linux Mint 17 \"Qiana\" - Cinnamon (64-bit)",
+	};
+	UINTN count = sizeof(samples) / sizeof(samples[0]);
+	UINTN reps = 200000, i, j, chars = 0;
+	UINT64 start, elapsed;
+
+	CHAR16 *expected[] = {
+		L"Ubuntu", L"/casper/vmlinuz.efi", L"/live/initrd.img", L"Linux Mint 17 \"Qiana\" - Cinnamon (64-bit)",
+	};
+
+	for (j = 0; j < count; j++) {
+		CHAR16 *converted = ASCIItoUTF16(samples[j], strlena(samples[j]), NULL);
+
+		Check(converted && StrCmp(converted, expected[j]) == 0, "ASCIItoUTF16 converted wrongly", j);
+		FreePool(converted);
+		chars += strlena(samples[j]);
+	}
+
+	ShimResetStats();
+	start = ShimNanoseconds();
+	for (i = 0; i < reps; i++) {
+		for (j = 0; j < count; j++) {
+			FreePool(ASCIItoUTF16(samples[j], strlena(samples[j]), NULL));
+		}
+	}
+	elapsed = ShimNanoseconds() - start;
+
+	printf("%-16s %10.2f %10.1f %12.2f\n", "ASCIItoUTF16", (double)elapsed / (reps * chars),
+		(double)elapsed / (reps * count), (double)shim_stats.pool_allocations / (reps * count));
+}
+
+static VOID BenchmarkUTF16toASCII(VOID) {
+	CHAR16 *sample = L"nomodeset acpi=off noefi vga=ask persistent toram debug gpt ";
+	UINTN reps = 200000, i, chars = StrLen(sample);
+	UINT64 start, elapsed;
+	CHAR8 *converted = UTF16toASCII(sample, chars + 1, NULL);
+
+	Check(SameString(converted, "nomodeset acpi=off noefi vga=ask persistent toram debug gpt "),
+		"UTF16toASCII converted wrongly", 0);
+	FreePool(converted);
+
+	ShimResetStats();
+	start = ShimNanoseconds();
+	for (i = 0; i < reps; i++) {
+		FreePool(UTF16toASCII(sample, chars + 1, NULL));
+	}
+	elapsed = ShimNanoseconds() - start;
+
+	printf("%-16s %10.2f %10.1f %12.2f\n", "UTF16toASCII", (double)elapsed / (reps * chars),
+		(double)elapsed / reps, (double)shim_stats.pool_allocations / reps);
+}
+
+/* The same conversions into a caller's buffer, which needs no allocation. */
+static VOID BenchmarkBufferConversion(VOID) {
+	CHAR8 *narrow = (CHAR8 *)"Linux Mint 17 \"Qiana\" - Cinnamon (64-bit)";
+	CHAR16 *wide = L"nomodeset acpi=off noefi vga=ask persistent toram debug gpt ";
+	CHAR16 wide_buffer[64];
+	CHAR8 narrow_buffer[256];
+	UINTN reps = 1000000, i, narrow_chars = strlena(narrow), wide_chars = StrLen(wide);
+	UINT64 start, elapsed;
+
+	Check(Utf8ToUtf16(narrow, narrow_chars, wide_buffer, 64) == narrow_chars &&
+		StrCmp(wide_buffer, L"Linux Mint 17 \"Qiana\" - Cinnamon (64-bit)") == 0, "Utf8ToUtf16 converted wrongly", 0);
+	Check(Utf16ToUtf8(wide, wide_chars, narrow_buffer, sizeof(narrow_buffer)) == wide_chars &&
+		SameString(narrow_buffer, "nomodeset acpi=off noefi vga=ask persistent toram debug gpt "),
+		"Utf16ToUtf8 converted wrongly", 0);
+
+	ShimResetStats();
+	start = ShimNanoseconds();
+	for (i = 0; i < reps; i++) {
+		Utf8ToUtf16(narrow, narrow_chars, wide_buffer, 64);
+		__asm__ __volatile__("" : : "r" (wide_buffer) : "memory");
+	}
+	elapsed = ShimNanoseconds() - start;
+	printf("%-16s %10.2f %10.1f %12.2f\n", "Utf8ToUtf16", (double)elapsed / (reps * narrow_chars),
+		(double)elapsed / reps, (double)shim_stats.pool_allocations / reps);
+
+	ShimResetStats();
+	start = ShimNanoseconds();
+	for (i = 0; i < reps; i++) {
+		Utf16ToUtf8(wide, wide_chars, narrow_buffer, sizeof(narrow_buffer));
+		__asm__ __volatile__("" : : "r" (narrow_buffer) : "memory");
+	}
+	elapsed = ShimNanoseconds() - start;
+	printf("%-16s %10.2f %10.1f %12.2f\n", "Utf16ToUtf8", (double)elapsed / (reps * wide_chars),
+		(double)elapsed / reps, (double)shim_stats.pool_allocations / reps);
+}
+
+/*
+ * Converts short strings that end right before an inaccessible page, given
+ * a capacity far beyond them the way the menu passes one, so a converter
+ * that reads past the terminator crashes here instead of on a real machine.
+ */
+static VOID CheckConversionBounds(VOID) {
+	long page = sysconf(_SC_PAGESIZE);
+	UINT8 *guarded = mmap(NULL, page * 2, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	CHAR8 *narrow;
+	CHAR16 *wide, wide_buffer[128];
+	CHAR8 narrow_buffer[128];
+
+	if (guarded == MAP_FAILED) {
+		Check(FALSE, "cannot map a guarded buffer", 0);
+		return;
+	}
+	mprotect(guarded + page, page, PROT_NONE);
+	narrow = (CHAR8 *)(guarded + page - sizeof("Ubuntu"));
+	wide = (CHAR16 *)(guarded + page - sizeof(L"Ubuntu"));
+
+	memcpy(narrow, "Ubuntu", sizeof("Ubuntu"));
+	Check(Utf8ToUtf16(narrow, 80, wide_buffer, 128) == 6 && StrCmp(wide_buffer, L"Ubuntu") == 0,
+		"Utf8ToUtf16 converted a guarded string wrongly", 0);
+	memcpy(wide, L"Ubuntu", sizeof(L"Ubuntu"));
+	Check(Utf16ToUtf8(wide, 80, narrow_buffer, 128) == 6 && SameString(narrow_buffer, "Ubuntu"),
+		"Utf16ToUtf8 converted a guarded string wrongly", 0);
+
+	munmap(guarded, page * 2);
+}
+
+/* Hashes one ISO verification segment at a time, as each processor does. */
+static VOID BenchmarkSha256(VOID) {
+	UINT8 *segment = malloc(VERIFY_SEGMENT_SIZE), digest[SHA256_DIGEST_SIZE];
+	UINTN reps = 32, i;
+	UINT64 start, elapsed;
+
+	for (i = 0; i < VERIFY_SEGMENT_SIZE; i++) {
+		segment[i] = (UINT8)(i * 131 + (i >> 12));
+	}
+
+	start = ShimNanoseconds();
+	for (i = 0; i < reps; i++) {
+		Sha256Digest(segment, VERIFY_SEGMENT_SIZE, digest);
+	}
+	elapsed = ShimNanoseconds() - start;
+
+	printf("%-16s %10s %10.1f\n", "SHA-256", Sha256Accelerated() ? "sha-ni" : "portable",
+		(double)reps * VERIFY_SEGMENT_SIZE * 1000 / elapsed);
+	free(segment);
+}
+
+/*
+ * Toggles one line of a menu per simulated keypress, once by clearing the
+ * screen and drawing everything again, as the menus used to, and once
+ * through the damage-tracking screen model.
+ */
+static VOID BenchmarkMenuRedraw(UINTN lines) {
+	static Screen screen;
+	CHAR16 text[SCREEN_MAX_COLUMNS];
+	UINTN reps = 10000, i, j, pass;
+
+	for (pass = 0; pass < 2; pass++) {
+		UINT64 start, elapsed;
+
+		ScreenInitialize(&screen, 0, TRUE);
+		ShimResetStats();
+		start = ShimNanoseconds();
+		for (i = 0; i < reps; i++) {
+			if (pass == 0) {
+				ScreenInitialize(&screen, 0, TRUE);
+			}
+			for (j = 0; j < lines; j++) {
+				SPrint(text, sizeof(text), L"    %d) option number %d", j, j);
+				ScreenSetLine(&screen, j, text, j == i % lines ?
+					EFI_YELLOW|EFI_BACKGROUND_BLACK : EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+			}
+			ScreenFlush(&screen);
+		}
+		elapsed = ShimNanoseconds() - start;
+
+		printf("%8lu %-10s %10.1f %14.2f\n", (unsigned long)lines, pass == 0 ? "full" : "damage",
+			(double)elapsed / reps, (double)shim_stats.console_calls / reps);
+	}
+}
+
+/*
+ * Writes a batch of log lines, once with a Print call per line, as the
+ * loader used to, and once through the buffered log.
+ */
+static VOID BenchmarkLogging(UINTN lines) {
+	UINTN reps = 1000, i, j, pass;
+
+	LogInitialize(NULL);
+	for (pass = 0; pass < 2; pass++) {
+		ShimResetStats();
+		for (i = 0; i < reps; i++) {
+			for (j = 0; j < lines; j++) {
+				if (pass == 0) {
+					Print(L"%d Ubuntu 14.04 LTS (64-bit)\n", j);
+				} else {
+					LogInfo(LogTagMain, L"%d Ubuntu 14.04 LTS (64-bit)\n", j);
+				}
+			}
+			LogFlush();
+			LogInitialize(NULL);
+		}
+
+		// The shim's Print does no work when quiet, so only the calls compare.
+		printf("%8lu %-10s %14.3f\n", (unsigned long)lines, pass == 0 ? "Print" : "log",
+			(double)(shim_stats.print_calls + shim_stats.console_calls) / (reps * lines));
+	}
+}
+
+#ifdef __APPLE__
+	#pragma mark - Boot media
+#endif
+#define MEDIA_KERNEL_SIZE (6 * 1024 * 1024)
+#define MEDIA_INITRD_SIZE (24 * 1024 * 1024)
+#define MEDIA_CLUSTER_SIZE 4096
+#define MEDIA_DISCOVERED_ISOS 8
+
+static VOID PutBothEndian32(UINT8 *p, UINT32 value) {
+	UINTN i;
+
+	for (i = 0; i < 4; i++) {
+		p[i] = value >> (8 * i);
+		p[7 - i] = value >> (8 * i);
+	}
+}
+
+/* Writes an ISO9660 directory record and returns its length. */
+static UINTN PutIsoRecord(UINT8 *p, const char *name, UINT32 sector, UINT32 size, BOOLEAN directory) {
+	UINTN name_length = name ? strlen(name) : 1;
+	UINTN length = 33 + name_length + (name_length % 2 == 0 ? 1 : 0);
+
+	memset(p, 0, length);
+	p[0] = length;
+	PutBothEndian32(p + 2, sector);
+	PutBothEndian32(p + 10, size);
+	p[25] = directory ? 0x02 : 0;
+	p[28] = p[31] = 1;
+	p[32] = name_length;
+	if (name) {
+		memcpy(p + 33, name, name_length);
+	}
+	return length;
+}
+
+/*
+ * Lays out a minimal live image: /casper/vmlinuz.efi and /casper/initrd.lz,
+ * filled with a pattern, behind plain ISO9660 names. /casper/vmlinuz is the
+ * same kernel again, for discovery to recognise the image by.
+ */
+static UINT8* GenerateIso(UINTN *size) {
+	UINT32 kernel = 20, initrd = kernel + MEDIA_KERNEL_SIZE / ISO_SECTOR_SIZE;
+	UINT32 sectors = initrd + MEDIA_INITRD_SIZE / ISO_SECTOR_SIZE;
+	UINT8 *iso = calloc(sectors, ISO_SECTOR_SIZE), *p;
+	UINTN i;
+
+	p = iso + 16 * ISO_SECTOR_SIZE;
+	p[0] = 1;
+	memcpy(p + 1, "CD001", 5);
+	p[6] = 1;
+	PutBothEndian32(p + 80, sectors);
+	p[128] = ISO_SECTOR_SIZE & 0xFF;
+	p[129] = ISO_SECTOR_SIZE >> 8;
+	PutIsoRecord(p + 156, NULL, 18, ISO_SECTOR_SIZE, TRUE);
+
+	p = iso + 17 * ISO_SECTOR_SIZE;
+	p[0] = 255;
+	memcpy(p + 1, "CD001", 5);
+	p[6] = 1;
+
+	p = iso + 18 * ISO_SECTOR_SIZE;
+	p += PutIsoRecord(p, NULL, 18, ISO_SECTOR_SIZE, TRUE);
+	p += PutIsoRecord(p, "\1", 18, ISO_SECTOR_SIZE, TRUE);
+	PutIsoRecord(p, "CASPER", 19, ISO_SECTOR_SIZE, TRUE);
+
+	p = iso + 19 * ISO_SECTOR_SIZE;
+	p += PutIsoRecord(p, NULL, 19, ISO_SECTOR_SIZE, TRUE);
+	p += PutIsoRecord(p, "\1", 18, ISO_SECTOR_SIZE, TRUE);
+	p += PutIsoRecord(p, "INITRD.LZ;1", initrd, MEDIA_INITRD_SIZE, FALSE);
+	p += PutIsoRecord(p, "VMLINUZ.;1", kernel, MEDIA_KERNEL_SIZE, FALSE);
+	PutIsoRecord(p, "VMLINUZ.EFI;1", kernel, MEDIA_KERNEL_SIZE, FALSE);
+
+	for (i = (UINTN)kernel * ISO_SECTOR_SIZE; i < (UINTN)sectors * ISO_SECTOR_SIZE; i += 4) {
+		*(UINT32 *)(iso + i) = i * 2654435761U;
+	}
+
+	*size = (UINTN)sectors * ISO_SECTOR_SIZE;
+	return iso;
+}
+
+/* Writes a FAT directory entry. */
+static VOID PutFatEntry(UINT8 *p, const char *name, UINT8 attributes, UINT16 cluster, UINT32 size) {
+	memcpy(p, name, 11);
+	p[11] = attributes;
+	p[26] = cluster;
+	p[27] = cluster >> 8;
+	memcpy(p + 28, &size, 4);
+}
+
+/*
+ * Writes a FAT16 image holding \EFI\BOOT\BOOT.ISO, with the file in one
+ * contiguous run, the way a freshly written stick has it.
+ */
+static BOOLEAN WriteFatImage(const char *path, UINT8 *iso, UINTN iso_size) {
+	UINT32 iso_clusters = (iso_size + MEDIA_CLUSTER_SIZE - 1) / MEDIA_CLUSTER_SIZE;
+	UINT32 clusters = iso_clusters + 16 < 4200 ? 4200 : iso_clusters + 16;
+	UINT32 fat_sectors = ((clusters + 2) * 2 + 511) / 512, root_sectors = 32;
+	UINT32 data_sector = 1 + fat_sectors + root_sectors;
+	UINT32 total = data_sector + clusters * (MEDIA_CLUSTER_SIZE / 512);
+	UINT8 boot[512] = { 0xEB, 0x3C, 0x90 }, entries[3 * 32];
+	UINT16 *fat = calloc(clusters + 2, sizeof(UINT16));
+	UINT64 data = (UINT64)data_sector * 512;
+	BOOLEAN written;
+	UINT32 i;
+	int fd;
+
+	memcpy(boot + 3, "MSWIN4.1", 8);
+	boot[11] = 0;
+	boot[12] = 2;
+	boot[13] = MEDIA_CLUSTER_SIZE / 512;
+	boot[14] = 1;
+	boot[16] = 1;
+	boot[17] = (root_sectors * 16) & 0xFF;
+	boot[18] = (root_sectors * 16) >> 8;
+	boot[21] = 0xF8;
+	boot[22] = fat_sectors & 0xFF;
+	boot[23] = fat_sectors >> 8;
+	memcpy(boot + 32, &total, 4);
+	boot[510] = 0x55;
+	boot[511] = 0xAA;
+
+	fat[0] = 0xFFF8;
+	fat[1] = fat[2] = fat[3] = 0xFFFF;
+	for (i = 0; i < iso_clusters; i++) {
+		fat[4 + i] = i + 1 < iso_clusters ? 5 + i : 0xFFFF;
+	}
+
+	fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	if (fd < 0) {
+		free(fat);
+		return FALSE;
+	}
+
+	written = pwrite(fd, boot, 512, 0) == 512 &&
+		pwrite(fd, fat, (clusters + 2) * 2, 512) == (ssize_t)(clusters + 2) * 2;
+
+	memset(entries, 0, sizeof(entries));
+	PutFatEntry(entries, "EFI        ", 0x10, 2, 0);
+	written = written && pwrite(fd, entries, 32, (1 + fat_sectors) * 512) == 32;
+
+	PutFatEntry(entries, ".          ", 0x10, 2, 0);
+	PutFatEntry(entries + 32, "..         ", 0x10, 0, 0);
+	PutFatEntry(entries + 64, "BOOT       ", 0x10, 3, 0);
+	written = written && pwrite(fd, entries, 96, data) == 96;
+
+	PutFatEntry(entries, ".          ", 0x10, 3, 0);
+	PutFatEntry(entries + 32, "..         ", 0x10, 2, 0);
+	PutFatEntry(entries + 64, "BOOT    ISO", 0x20, 4, iso_size);
+	written = written && pwrite(fd, entries, 96, data + MEDIA_CLUSTER_SIZE) == 96 &&
+		pwrite(fd, iso, iso_size, data + 2 * MEDIA_CLUSTER_SIZE) == (ssize_t)iso_size &&
+		ftruncate(fd, (off_t)total * 512) == 0;
+
+	close(fd);
+	free(fat);
+	return written;
+}
+
+static BOOLEAN WriteHostFile(const char *path, VOID *data, UINTN size) {
+	FILE *f = fopen(path, "wb");
+	BOOLEAN written;
+
+	if (!f) {
+		return FALSE;
+	}
+	written = fwrite(data, 1, size, f) == size;
+	return fclose(f) == 0 && written;
+}
+
+/* The stick as the file system sees it, and the partition underneath. */
+static BOOLEAN CreateBootMedia(char *directory, char stick[64], char image[64]) {
+	UINTN iso_size, config_size, lines, i;
+	CHAR8 *config = GenerateConfiguration(4, &config_size, &lines);
+	UINT8 *iso = GenerateIso(&iso_size);
+	char path[128];
+	BOOLEAN created;
+
+	sprintf(stick, "%s/stick", directory);
+	sprintf(image, "%s/stick.img", directory);
+	sprintf(path, "%s/efi", stick);
+	created = mkdir(stick, 0755) == 0 && mkdir(path, 0755) == 0;
+	sprintf(path, "%s/efi/boot", stick);
+	created = created && mkdir(path, 0755) == 0;
+	sprintf(path, "%s/efi/boot/.MLUL-Live-USB", stick);
+	created = created && WriteHostFile(path, config, config_size);
+	sprintf(path, "%s/efi/boot/boot.iso", stick);
+	created = created && WriteHostFile(path, iso, iso_size) && WriteFatImage(image, iso, iso_size);
+
+	// More images for discovery to find, which need not take up the space.
+	sprintf(path, "%s/isos", stick);
+	created = created && mkdir(path, 0755) == 0;
+	for (i = 0; i < MEDIA_DISCOVERED_ISOS; i++) {
+		char link_path[128];
+
+		sprintf(path, "%s/efi/boot/boot.iso", stick);
+		sprintf(link_path, "%s/isos/live-%lu.iso", stick, (unsigned long)i + 1);
+		created = created && link(path, link_path) == 0;
+	}
+
+	free(config);
+	free(iso);
+	return created;
+}
+
+static VOID RemoveBootMedia(char *directory, char stick[64], char image[64]) {
+	const char *paths[] = { "efi/boot/.MLUL-Live-USB", "efi/boot/boot.iso", "efi/boot", "efi", "" };
+	char path[128];
+	UINTN i;
+
+	for (i = 0; i < MEDIA_DISCOVERED_ISOS; i++) {
+		sprintf(path, "%s/isos/live-%lu.iso", stick, (unsigned long)i + 1);
+		remove(path);
+	}
+	sprintf(path, "%s/isos", stick);
+	remove(path);
+	for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+		sprintf(path, "%s/%s", stick, paths[i]);
+		remove(path);
+	}
+	remove(image);
+	remove(directory);
+}
+
+static VOID PrintMediaRow(const char *step, const char *reader, const char *reads) {
+	printf("%-10s %-8s %8s %8lu %6lu %8.1f %10.1f\n", step, reader, reads,
+		(unsigned long)(shim_stats.file_calls + shim_stats.disk_calls), (unsigned long)shim_stats.media_seeks,
+		(double)shim_stats.media_bytes / (1024 * 1024), (double)shim_stats.media_nanoseconds / 1000000);
+}
+
+/* What main() does before the menu: list the stick and read the configuration. */
+static VOID BenchmarkMediaStartup(EFI_HANDLE device) {
+	DirectorySnapshot snapshot;
+	EFI_FILE_HANDLE root;
+	CHAR8 *content = NULL;
+
+	ShimResetStats();
+	root = LibOpenRoot(device);
+	SnapshotInitialize(&snapshot);
+	SnapshotAddDirectory(&snapshot, root, L"\\");
+	SnapshotAddDirectory(&snapshot, root, L"\\efi\\boot");
+	if (SnapshotFileExists(&snapshot, L"\\efi\\boot\\.MLUL-Live-USB")) {
+		FileRead(root, L"\\efi\\boot\\.MLUL-Live-USB", &content, NULL);
+	}
+	uefi_call_wrapper(root->Close, 1, root);
+	PrintMediaRow("startup", "file", "-");
+
+	if (!content) {
+		fprintf(stderr, "warning: the configuration was not read\n");
+	} else {
+		FreePool(content);
+	}
+	SnapshotRelease(&snapshot);
+}
+
+/*
+ * Loads the kernel and initrd out of boot.iso, through the file protocol or
+ * straight from the partition, in reads of chunk bytes (0 for whole files).
+ */
+static VOID BenchmarkMediaLoad(EFI_HANDLE device, BOOLEAN direct, UINTN chunk) {
+	CHAR8 *paths[] = { (CHAR8 *)"/casper/vmlinuz.efi", (CHAR8 *)"/casper/initrd.lz" };
+	EFI_FILE_HANDLE root, iso_file;
+	DiskImage disk;
+	IsoImage iso;
+	char reads[24];
+	UINTN i;
+	EFI_STATUS err;
+
+	ShimResetStats();
+	root = LibOpenRoot(device);
+	err = uefi_call_wrapper(root->Open, 5, root, &iso_file, L"\\efi\\boot\\boot.iso", EFI_FILE_MODE_READ, 0);
+	if (!EFI_ERROR(err) && direct) {
+		err = DiskImageOpen(&disk, device, L"\\efi\\boot\\boot.iso", iso_file);
+	}
+	if (!EFI_ERROR(err)) {
+		err = direct ? IsoOpen(&iso, DiskImageReader, &disk) : IsoOpen(&iso, IsoFileReader, iso_file);
+	}
+
+	for (i = 0; i < 2 && !EFI_ERROR(err); i++) {
+		IsoExtent extent;
+		UINT8 *buffer;
+		UINT64 offset;
+
+		err = IsoLookup(&iso, paths[i], &extent);
+		if (EFI_ERROR(err)) {
+			break;
+		}
+
+		buffer = malloc(extent.size);
+		for (offset = 0; offset < extent.size && !EFI_ERROR(err); offset += chunk ? chunk : extent.size) {
+			UINTN size = chunk && chunk < extent.size - offset ? chunk : extent.size - offset;
+
+			err = IsoReadExtent(&iso, &extent, offset, size, buffer + offset);
+		}
+		free(buffer);
+	}
+
+	if (EFI_ERROR(err)) {
+		fprintf(stderr, "warning: loading from the %s failed: %lx\n", direct ? "disk" : "file system",
+			(unsigned long)err);
+	}
+	IsoClose(&iso);
+	if (direct) {
+		DiskImageClose(&disk);
+	}
+	uefi_call_wrapper(iso_file->Close, 1, iso_file);
+	uefi_call_wrapper(root->Close, 1, root);
+
+	if (chunk) {
+		sprintf(reads, "%luK", (unsigned long)chunk / 1024);
+	} else {
+		strcpy(reads, "whole");
+	}
+	PrintMediaRow("load", direct ? "disk" : "file", reads);
+}
+
+/*
+ * Looks for ISO files on the stick, as a boot with discover set does: with
+ * no index, which opens every image, and again with the index just written.
+ */
+static VOID BenchmarkMediaDiscovery(BOOLEAN indexed) {
+	static const EFI_GUID vendor = {0x4a67b082, 0x0a4c, 0x41cf, {0xb6, 0xc7, 0x44, 0x0b, 0x29, 0xbb, 0x8c, 0x4f}};
+	BootEntryTable table;
+	MemoryArena arena;
+	char found[24];
+
+	if (!indexed) {
+		efi_delete_variable(&vendor, DISCOVERY_VARIABLE_NAME);
+	}
+	ArenaInitialize(&arena, 0);
+	ZeroMem(&table, sizeof(table));
+
+	ShimResetStats();
+	DiscoverISOFiles(&vendor, (CHAR8 *)"isos", NULL, &arena, &table);
+	sprintf(found, "%lu", (unsigned long)table.count);
+	PrintMediaRow("discover", indexed ? "index" : "probe", found);
+
+	if (table.count != MEDIA_DISCOVERED_ISOS) {
+		fprintf(stderr, "warning: discovery found %lu of %d images\n", (unsigned long)table.count,
+			MEDIA_DISCOVERED_ISOS);
+	}
+	ArenaRelease(&arena);
+}
+
+/*
+ * Replays the I/O of a boot against a USB 2.0 stick with Apple's FAT driver
+ * on top, as modelled in media.c. The times are the model's, not measured.
+ */
+static VOID BenchmarkBootMedia(VOID) {
+	char directory[] = "/tmp/enterprise-bench-XXXXXX", stick[64], image[64];
+	UINTN chunks[] = { 64 * 1024, 1024 * 1024, 0 };
+	EFI_HANDLE device;
+	UINTN i;
+
+	if (!mkdtemp(directory)) {
+		fprintf(stderr, "warning: no temporary directory for the boot media\n");
+		return;
+	}
+
+	if (!CreateBootMedia(directory, stick, image)) {
+		fprintf(stderr, "warning: could not create the boot media in %s\n", directory);
+	} else {
+		device = ShimMediaCreate(stick, image, &shim_latency_apple_fat, &shim_latency_usb_disk);
+		BenchmarkMediaStartup(device);
+		for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+			BenchmarkMediaLoad(device, FALSE, chunks[i]);
+		}
+		BenchmarkMediaLoad(device, TRUE, 64 * 1024);
+		BenchmarkMediaLoad(device, TRUE, 0);
+		BenchmarkMediaDiscovery(FALSE);
+		BenchmarkMediaDiscovery(TRUE);
+		ShimMediaDestroy(device);
+	}
+
+	RemoveBootMedia(directory, stick, image);
+}
+
+int main(int argc, char **argv) {
+	UINTN sizes[] = { 10, 100, 1000, 10000 };
+	UINTN i;
+
+	ShimInitialize();
+
+	printf("Configuration parser\n");
+	printf("%8s %8s %9s %10s %13s %12s\n", "entries", "lines", "bytes", "ns/line", "allocs/entry", "peak bytes");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		BenchmarkParser(sizes[i]);
+	}
+
+	printf("\nBoot plan\n");
+	printf("%8s %9s %10s %13s\n", "entries", "bytes", "ns/entry", "allocs/entry");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		BenchmarkPlan(sizes[i]);
+	}
+
+	printf("\nString conversion\n");
+	printf("%-16s %10s %10s %12s\n", "function", "ns/char", "ns/call", "allocs/call");
+	BenchmarkASCIItoUTF16();
+	BenchmarkUTF16toASCII();
+	BenchmarkBufferConversion();
+	CheckConversionBounds();
+
+	printf("\nISO verification, per processor\n");
+	printf("%-16s %10s %10s\n", "function", "kernel", "MB/s");
+	BenchmarkSha256();
+
+	printf("\nMenu redraw, per keypress\n");
+	printf("%8s %-10s %10s %14s\n", "lines", "renderer", "ns/key", "console calls");
+	BenchmarkMenuRedraw(8);
+	BenchmarkMenuRedraw(20);
+
+	printf("\nConsole logging, per line\n");
+	printf("%8s %-10s %14s\n", "lines", "writer", "console calls");
+	BenchmarkLogging(10);
+	BenchmarkLogging(100);
+
+	printf("\nBoot media, simulated USB 2.0 stick\n");
+	printf("%-10s %-8s %8s %8s %6s %8s %10s\n", "step", "reader", "reads", "calls", "seeks", "MiB", "model ms");
+	BenchmarkBootMedia();
+
+	if (failures) {
+		fprintf(stderr, "%lu check%s failed\n", (unsigned long)failures, failures == 1 ? "" : "s");
+		return 1;
+	}
+	return 0;
+}
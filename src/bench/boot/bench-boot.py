@@ -0,0 +1,346 @@
+#! /usr/bin/env python2.7
+#
+# Tool intended to help facilitate the process of booting Linux on Intel
+# Macintosh computers made by Apple from a USB stick or similar.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# Lesser General Public License for more details.
+#
+# Copyright (C) 2014 SevenBits
+#
+#
+from __future__ import print_function
+import argparse
+import json
+import os
+import re
+import select
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+""" Measures how long Enterprise takes to boot, end to end, on a virtual
+ machine: make bench-boot runs it with the loader and the stub boot.efi
+ that were just built.
+
+ 	It lays out a drive the way an installation would be, with a small
+ boot.iso and a configuration file with one entry, and boots it headless
+ under QEMU with OVMF as many times as asked. Each time, it presses Enter
+ over the serial console as soon as the menu is drawn; the stub then prints
+ the phase timestamps Enterprise published (see src/timing.c) and powers
+ the machine off. The time from the loader being started to it calling
+ StartImage is reported per run, with and without the time the menu was
+ up, as JSON."""
+
+clock = getattr(time, "perf_counter", time.time)
+
+BENCH_BEGIN_MARKER = b"ENTERPRISE-BENCH-BEGIN"
+BENCH_END_MARKER = b"ENTERPRISE-BENCH-END"
+BENCH_ENTRY_NAME = "Boot benchmark"
+
+## Where distributions commonly install OVMF, as (code, variables) pairs;
+## a variables file of None means the code file is a whole flash image.
+OVMF_LOCATIONS = [
+	("/usr/share/OVMF/OVMF_CODE.fd", "/usr/share/OVMF/OVMF_VARS.fd"),
+	("/usr/share/OVMF/OVMF_CODE_4M.fd", "/usr/share/OVMF/OVMF_VARS_4M.fd"),
+	("/usr/share/edk2/ovmf/OVMF_CODE.fd", "/usr/share/edk2/ovmf/OVMF_VARS.fd"),
+	("/usr/share/edk2-ovmf/x64/OVMF_CODE.fd", "/usr/share/edk2-ovmf/x64/OVMF_VARS.fd"),
+	("/usr/share/qemu/edk2-x86_64-code.fd", "/usr/share/qemu/edk2-i386-vars.fd"),
+	("/usr/share/ovmf/OVMF.fd", None),
+	("/usr/share/qemu/OVMF.fd", None),
+]
+
+ISO_SECTOR_SIZE = 2048
+ANSI_ESCAPE = re.compile(b"\x1b\\[[0-9;?]*[A-Za-z]")
+
+def main():
+	"""The program's main method."""
+	parser = argparse.ArgumentParser(description="Time Enterprise booting under QEMU and OVMF.")
+	parser.add_argument("--loader", required=True, help="the enterprise.efi to boot")
+	parser.add_argument("--stub", required=True, help="the stub to install as boot.efi")
+	parser.add_argument("--runs", type=int, default=10, help="number of timed boots (default: 10)")
+	parser.add_argument("--warmup", type=int, default=1,
+		help="boots to run first and leave out of the results (default: 1)")
+	parser.add_argument("--qemu", default="qemu-system-x86_64", help="the QEMU binary to use")
+	parser.add_argument("--ovmf", help="OVMF code image (default: search the usual places)")
+	parser.add_argument("--ovmf-vars", help="OVMF variable store to start each boot from")
+	parser.add_argument("--bus", choices=["usb", "virtio", "ahci"], default="usb",
+		help="how the drive is attached (default: usb, like the real thing)")
+	parser.add_argument("--kernel-size", type=int, default=8, help="size of the kernel in boot.iso, in MiB")
+	parser.add_argument("--initrd-size", type=int, default=32, help="size of the initrd in boot.iso, in MiB")
+	parser.add_argument("--timeout", type=float, default=120, help="seconds to allow each boot")
+	parser.add_argument("--no-kvm", action="store_true", help="emulate the CPU even if KVM is available")
+	parser.add_argument("--output", help="write the JSON results here instead of to standard output")
+	args = parser.parse_args()
+
+	code, variables = findFirmware(args)
+	workDirectory = tempfile.mkdtemp(prefix="enterprise-bench-")
+	try:
+		image = buildDrive(workDirectory, args)
+		accelerator = "tcg" if args.no_kvm or not os.access("/dev/kvm", os.R_OK | os.W_OK) else "kvm"
+		results = []
+		for run in range(args.warmup + args.runs):
+			result = bootOnce(workDirectory, image, code, variables, accelerator, args)
+			result["warmup"] = run < args.warmup
+			results.append(result)
+			printProgress(run - args.warmup + 1, args.runs, result)
+	finally:
+		shutil.rmtree(workDirectory, ignore_errors=True)
+
+	report = {
+		"loader": os.path.abspath(args.loader),
+		"qemu": qemuVersion(args.qemu),
+		"firmware": code,
+		"accelerator": accelerator,
+		"bus": args.bus,
+		"runs": [r for r in results if not r["warmup"]],
+		"summary": summarize([r for r in results if not r["warmup"]]),
+	}
+	output = json.dumps(report, indent=2, sort_keys=True)
+	if args.output:
+		with open(args.output, "w") as f:
+			f.write(output + "\n")
+	else:
+		print(output)
+
+	if any(not r["ok"] for r in report["runs"]):
+		sys.exit(1)
+
+def findFirmware(args):
+	"""Returns the OVMF code image and variable store to boot with."""
+	if args.ovmf:
+		return (args.ovmf, args.ovmf_vars)
+	for code, variables in OVMF_LOCATIONS:
+		if os.path.isfile(code) and (variables is None or os.path.isfile(variables)):
+			return (code, variables)
+	sys.exit("Could not find OVMF; install it, or give its location with --ovmf.")
+
+def qemuVersion(qemu):
+	try:
+		output = subprocess.check_output([qemu, "--version"])
+	except OSError:
+		sys.exit("Could not run %s; install QEMU, or give its location with --qemu." % qemu)
+	return output.decode("utf-8", "replace").splitlines()[0]
+
+#
+# The drive.
+#
+
+def bothEndian(format, value):
+	"""ECMA-119 stores most numbers twice, little-endian first."""
+	return struct.pack("<" + format, value) + struct.pack(">" + format, value)
+
+def isoRecord(name, sector, size, directory):
+	"""A directory record (ECMA-119 9.1), padded to an even length."""
+	length = 33 + len(name) + (1 - len(name) % 2)
+	record = struct.pack("<BB", length, 0) + bothEndian("I", sector) + bothEndian("I", size) + b"\0" * 7 + \
+		struct.pack("<BBB", 2 if directory else 0, 0, 0) + bothEndian("H", 1) + struct.pack("<B", len(name)) + name
+	return record.ljust(length, b"\0")
+
+def buildIso(path, files):
+	"""Writes a plain ISO9660 image holding files, a dictionary from paths
+		one directory deep, such as "/casper/vmlinuz", to their contents."""
+	directories = sorted(set(p.strip("/").split("/")[0] for p in files))
+	directorySector = {name: 19 + i for i, name in enumerate(directories)}
+	sector = 19 + len(directories)
+	placed = []
+	for filePath in sorted(files):
+		directory, name = filePath.strip("/").split("/")
+		placed.append((directory, name, sector, len(files[filePath])))
+		sector += (len(files[filePath]) + ISO_SECTOR_SIZE - 1) // ISO_SECTOR_SIZE
+
+	with open(path, "wb") as iso:
+		iso.truncate(sector * ISO_SECTOR_SIZE)
+
+		root = isoRecord(b"\0", 18, ISO_SECTOR_SIZE, True) + isoRecord(b"\1", 18, ISO_SECTOR_SIZE, True)
+		for directory in directories:
+			root += isoRecord(directory.upper().encode("ascii"), directorySector[directory], ISO_SECTOR_SIZE, True)
+		writeAt(iso, 18 * ISO_SECTOR_SIZE, root)
+
+		for directory in directories:
+			records = isoRecord(b"\0", directorySector[directory], ISO_SECTOR_SIZE, True) + \
+				isoRecord(b"\1", 18, ISO_SECTOR_SIZE, True)
+			for fileDirectory, name, fileSector, size in placed:
+				if fileDirectory == directory:
+					plainName = name.upper() + ("" if "." in name else ".") + ";1"
+					records += isoRecord(plainName.encode("ascii"), fileSector, size, False)
+			writeAt(iso, directorySector[directory] * ISO_SECTOR_SIZE, records)
+
+		for directory, name, fileSector, size in placed:
+			writeAt(iso, fileSector * ISO_SECTOR_SIZE, files["/%s/%s" % (directory, name)])
+
+		primary = bytearray(ISO_SECTOR_SIZE)
+		primary[0:6] = b"\1CD001"
+		primary[6] = 1
+		primary[80:88] = bothEndian("I", sector)
+		primary[120:124] = bothEndian("H", 1)
+		primary[124:128] = bothEndian("H", 1)
+		primary[128:132] = bothEndian("H", ISO_SECTOR_SIZE)
+		primary[156:190] = isoRecord(b"\0", 18, ISO_SECTOR_SIZE, True)[:34]
+		writeAt(iso, 16 * ISO_SECTOR_SIZE, bytes(primary))
+		writeAt(iso, 17 * ISO_SECTOR_SIZE, b"\xffCD001\1")
+
+def writeAt(f, offset, data):
+	f.seek(offset)
+	f.write(data)
+
+def haveCommand(name):
+	return any(os.access(os.path.join(d, name), os.X_OK) for d in os.environ.get("PATH", "").split(os.pathsep))
+
+def buildDrive(workDirectory, args):
+	"""Lays out the drive in a directory, and turns it into a FAT image when
+		mtools is installed. Otherwise QEMU presents the directory itself as
+		a FAT drive, which works as well but is not quite a real one."""
+	root = os.path.join(workDirectory, "drive")
+	boot = os.path.join(root, "efi", "boot")
+	os.makedirs(boot)
+	shutil.copy(args.loader, os.path.join(boot, "bootx64.efi"))
+	shutil.copy(args.stub, os.path.join(boot, "boot.efi"))
+
+	## Ubuntu entries boot /casper/vmlinuz and /casper/initrd.lz.
+	buildIso(os.path.join(boot, "boot.iso"), {
+		"/casper/vmlinuz": os.urandom(args.kernel_size * 1024 * 1024),
+		"/casper/initrd.lz": os.urandom(args.initrd_size * 1024 * 1024),
+	})
+	with open(os.path.join(boot, ".MLUL-Live-USB"), "w") as f:
+		f.write("entry %s\nfamily Ubuntu\n" % BENCH_ENTRY_NAME)
+
+	if not (haveCommand("mformat") and haveCommand("mcopy")):
+		return "fat:ro:" + root
+
+	image = os.path.join(workDirectory, "drive.img")
+	size = sum(os.path.getsize(os.path.join(d, f)) for d, _, fs in os.walk(root) for f in fs)
+	with open(image, "wb") as f:
+		f.truncate(max(64 * 1024 * 1024, size + 32 * 1024 * 1024))
+	subprocess.check_call(["mformat", "-i", image, "-F", "::"])
+	subprocess.check_call(["mcopy", "-s", "-i", image, os.path.join(root, "efi"), "::/"])
+	return image
+
+#
+# Booting.
+#
+
+def qemuCommand(workDirectory, image, code, variables, accelerator, args):
+	command = [args.qemu, "-machine", "q35,accel=" + accelerator, "-m", "1024",
+		"-display", "none", "-monitor", "none", "-serial", "stdio", "-no-reboot", "-net", "none"]
+
+	## Each boot starts from the same variable store, so no run sees
+	## what an earlier one left behind.
+	if variables:
+		store = os.path.join(workDirectory, "vars.fd")
+		shutil.copy(variables, store)
+		command += ["-drive", "if=pflash,format=raw,readonly=on,file=" + code,
+			"-drive", "if=pflash,format=raw,file=" + store]
+	else:
+		command += ["-bios", code]
+
+	drive = "id=stick,if=none,format=raw,file=" + image
+	if args.bus == "usb":
+		command += ["-drive", drive, "-device", "qemu-xhci", "-device", "usb-storage,drive=stick"]
+	elif args.bus == "ahci":
+		command += ["-drive", drive, "-device", "ide-hd,drive=stick,bus=ide.0"]
+	else:
+		command += ["-drive", drive, "-device", "virtio-blk-pci,drive=stick"]
+	return command
+
+def bootOnce(workDirectory, image, code, variables, accelerator, args):
+	"""Boots once, and returns what Enterprise recorded about it."""
+	result = {"ok": False}
+	started = clock()
+	qemu = subprocess.Popen(qemuCommand(workDirectory, image, code, variables, accelerator, args),
+		stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+	output = b""
+	pressed = False
+	try:
+		while clock() - started < args.timeout:
+			ready, _, _ = select.select([qemu.stdout], [], [], 0.1)
+			if not ready:
+				continue
+			chunk = os.read(qemu.stdout.fileno(), 65536)
+			if not chunk:
+				break
+			output += chunk
+			text = ANSI_ESCAPE.sub(b"", output)
+
+			## The entry is drawn once the menu is up; Enter boots it.
+			if not pressed and BENCH_ENTRY_NAME.encode("ascii") in text:
+				qemu.stdin.write(b"\r")
+				qemu.stdin.flush()
+				pressed = True
+				result["menu_seconds"] = clock() - started
+			if BENCH_END_MARKER in text.split(BENCH_BEGIN_MARKER, 1)[-1]:
+				result.update(parsePhases(text))
+				result["ok"] = "StartImage" in result.get("phases_us", {})
+				break
+	finally:
+		## The stub powers the machine off; give it a moment to get there.
+		while qemu.poll() is None and result["ok"] and clock() - started < args.timeout:
+			time.sleep(0.05)
+		if qemu.poll() is None:
+			qemu.kill()
+		qemu.wait()
+
+	result["wall_seconds"] = clock() - started
+	if not result["ok"]:
+		result["error"] = "timed out" if clock() - started >= args.timeout else "no timestamps"
+		result["console_tail"] = ANSI_ESCAPE.sub(b"", output)[-2000:].decode("utf-8", "replace")
+	return result
+
+def parsePhases(text):
+	"""Reads the stub's report: one "<phase> <microseconds>" line each."""
+	report = text.split(BENCH_BEGIN_MARKER, 1)[1].split(BENCH_END_MARKER, 1)[0]
+	phases = {}
+	for line in report.decode("utf-8", "replace").replace("\r", "").split("\n"):
+		parts = line.split()
+		if len(parts) == 2 and parts[1].isdigit():
+			phases[parts[0]] = int(parts[1])
+
+	result = {"phases_us": phases}
+	if "Entry" in phases and "StartImage" in phases:
+		result["handoff_to_start_image_us"] = phases["StartImage"] - phases["Entry"]
+		if "ConfigParse" in phases and "Discovery" in phases:
+			result["discovery_us"] = phases["Discovery"] - phases["ConfigParse"]
+		# The menu is up from the moment discovery, if any, is over.
+		menu_start = "Discovery" if "Discovery" in phases else "ConfigParse"
+		if menu_start in phases and "MenuWait" in phases:
+			result["menu_us"] = phases["MenuWait"] - phases[menu_start]
+			result["loader_us"] = result["handoff_to_start_image_us"] - result["menu_us"]
+	return result
+
+#
+# Results.
+#
+
+def summarize(runs):
+	summary = {"runs": len(runs), "failed": sum(1 for r in runs if not r["ok"])}
+	for key in ("handoff_to_start_image_us", "loader_us", "menu_us", "discovery_us"):
+		values = sorted(r[key] for r in runs if key in r)
+		if values:
+			summary[key] = {
+				"min": values[0],
+				"median": values[len(values) // 2],
+				"mean": sum(values) // len(values),
+				"max": values[-1],
+			}
+	return summary
+
+def printProgress(run, runs, result):
+	label = "warmup" if result["warmup"] else "run %d/%d" % (run, runs)
+	if result["ok"]:
+		detail = "%d us to StartImage, %d us without the menu" % (result.get("handoff_to_start_image_us", 0),
+			result.get("loader_us", 0))
+	else:
+		detail = "failed: " + result["error"]
+	print("%s: %s" % (label, detail), file=sys.stderr)
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,51 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Stands in for GRUB in the boot-time benchmark (make bench-boot). All it
+ * does is print the timestamps Enterprise left behind to the console, which
+ * the benchmark reads from the serial port, and power the machine off.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#define BENCH_BEGIN_MARKER L"ENTERPRISE-BENCH-BEGIN"
+#define BENCH_END_MARKER L"ENTERPRISE-BENCH-END"
+
+static EFI_GUID enterprise_variable_guid = {0x4a67b082, 0x0a4c, 0x41cf, {0xb6, 0xc7, 0x44, 0x0b, 0x29, 0xbb, 0x8c, 0x4f}};
+
+EFI_STATUS efi_main(EFI_HANDLE image, EFI_SYSTEM_TABLE *systab) {
+	CHAR16 phases[1024];
+	UINTN size = sizeof(phases) - sizeof(CHAR16);
+	EFI_STATUS err;
+
+	InitializeLib(image, systab);
+
+	err = uefi_call_wrapper(RT->GetVariable, 5, L"EnterpriseBootPhases", &enterprise_variable_guid, NULL,
+		&size, phases);
+	if (EFI_ERROR(err)) {
+		size = 0;
+	}
+	phases[size / sizeof(CHAR16)] = '\0';
+
+	// The phases come one per line, as "<name> <microseconds since reset>".
+	Print(L"\n%s\n%s%s\n", BENCH_BEGIN_MARKER, phases, BENCH_END_MARKER);
+	uefi_call_wrapper(RT->ResetSystem, 4, EfiResetShutdown, EFI_SUCCESS, 0, NULL);
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,619 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * A small stand-in for the GNU-EFI headers so that the portable parts of
+ * Enterprise can be compiled and benchmarked as an ordinary Linux program.
+ * Only the types, constants and services that Enterprise actually uses are
+ * declared here; names and layouts follow GNU-EFI so that the real sources
+ * compile unmodified against either.
+ */
+
+#pragma once
+#ifndef _bench_efi_h
+#define _bench_efi_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#define VA_LIST va_list
+#define VA_START(ap, last) va_start(ap, last)
+#define VA_END(ap) va_end(ap)
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define EFIAPI
+#define CONST const
+
+typedef uint8_t			UINT8;
+typedef int8_t			INT8;
+typedef uint16_t		UINT16;
+typedef int16_t			INT16;
+typedef uint32_t		UINT32;
+typedef int32_t			INT32;
+typedef uint64_t		UINT64;
+typedef int64_t			INT64;
+typedef uintptr_t		UINTN;
+typedef intptr_t		INTN;
+typedef UINT8			BOOLEAN;
+typedef UINT8			CHAR8;
+typedef UINT16			CHAR16;
+typedef void			VOID;
+
+typedef UINTN			EFI_STATUS;
+typedef VOID			*EFI_HANDLE;
+typedef VOID			*EFI_EVENT;
+typedef UINTN			EFI_TPL;
+typedef UINT64			EFI_LBA;
+typedef UINT64			EFI_PHYSICAL_ADDRESS;
+typedef UINT64			EFI_VIRTUAL_ADDRESS;
+
+#ifndef TRUE
+	#define TRUE	((BOOLEAN) 1)
+	#define FALSE	((BOOLEAN) 0)
+#endif
+
+#ifndef NULL
+	#define NULL	((VOID *) 0)
+#endif
+
+typedef struct {
+	UINT32 Data1;
+	UINT16 Data2;
+	UINT16 Data3;
+	UINT8 Data4[8];
+} EFI_GUID;
+
+typedef struct {
+	UINT16 Year;
+	UINT8 Month;
+	UINT8 Day;
+	UINT8 Hour;
+	UINT8 Minute;
+	UINT8 Second;
+	UINT8 Pad1;
+	UINT32 Nanosecond;
+	INT16 TimeZone;
+	UINT8 Daylight;
+	UINT8 Pad2;
+} EFI_TIME;
+
+#define uefi_call_wrapper(func, va_num, ...) func(__VA_ARGS__)
+
+#define MAX_BIT				(((UINTN) 1) << (sizeof(UINTN) * 8 - 1))
+#define EFIERR(a)			(MAX_BIT | (a))
+#define EFI_ERROR(a)		(((INTN) (a)) < 0)
+
+#define EFI_SUCCESS					0
+#define EFI_LOAD_ERROR				EFIERR(1)
+#define EFI_INVALID_PARAMETER		EFIERR(2)
+#define EFI_UNSUPPORTED				EFIERR(3)
+#define EFI_BAD_BUFFER_SIZE			EFIERR(4)
+#define EFI_BUFFER_TOO_SMALL		EFIERR(5)
+#define EFI_NOT_READY				EFIERR(6)
+#define EFI_DEVICE_ERROR			EFIERR(7)
+#define EFI_WRITE_PROTECTED			EFIERR(8)
+#define EFI_OUT_OF_RESOURCES		EFIERR(9)
+#define EFI_VOLUME_CORRUPTED		EFIERR(10)
+#define EFI_VOLUME_FULL				EFIERR(11)
+#define EFI_NO_MEDIA				EFIERR(12)
+#define EFI_MEDIA_CHANGED			EFIERR(13)
+#define EFI_NOT_FOUND				EFIERR(14)
+#define EFI_ACCESS_DENIED			EFIERR(15)
+#define EFI_NO_RESPONSE				EFIERR(16)
+#define EFI_NO_MAPPING				EFIERR(17)
+#define EFI_TIMEOUT					EFIERR(18)
+#define EFI_NOT_STARTED				EFIERR(19)
+#define EFI_ALREADY_STARTED			EFIERR(20)
+#define EFI_ABORTED					EFIERR(21)
+#define EFI_INCOMPATIBLE_VERSION	EFIERR(25)
+#define EFI_SECURITY_VIOLATION		EFIERR(26)
+#define EFI_CRC_ERROR				EFIERR(27)
+#define EFI_END_OF_MEDIA			EFIERR(28)
+#define EFI_END_OF_FILE				EFIERR(31)
+
+#define EFI_PAGE_SIZE				4096
+#define EFI_PAGE_MASK				0xFFF
+#define EFI_PAGE_SHIFT				12
+#define EFI_SIZE_TO_PAGES(a)		(((a) >> EFI_PAGE_SHIFT) + ((a) & EFI_PAGE_MASK ? 1 : 0))
+
+#define EFI_MAXIMUM_VARIABLE_SIZE	1024
+
+#define EFI_VARIABLE_NON_VOLATILE			0x00000001
+#define EFI_VARIABLE_BOOTSERVICE_ACCESS		0x00000002
+#define EFI_VARIABLE_RUNTIME_ACCESS			0x00000004
+
+/* Text attributes. */
+#define EFI_BLACK				0x00
+#define EFI_BLUE				0x01
+#define EFI_GREEN				0x02
+#define EFI_CYAN				0x03
+#define EFI_RED					0x04
+#define EFI_MAGENTA				0x05
+#define EFI_BROWN				0x06
+#define EFI_LIGHTGRAY			0x07
+#define EFI_BRIGHT				0x08
+#define EFI_DARKGRAY			0x08
+#define EFI_LIGHTBLUE			0x09
+#define EFI_LIGHTGREEN			0x0A
+#define EFI_LIGHTCYAN			0x0B
+#define EFI_LIGHTRED			0x0C
+#define EFI_LIGHTMAGENTA		0x0D
+#define EFI_YELLOW				0x0E
+#define EFI_WHITE				0x0F
+#define EFI_BACKGROUND_BLACK	0x00
+#define EFI_BACKGROUND_BLUE		0x10
+#define EFI_BACKGROUND_GREEN	0x20
+#define EFI_BACKGROUND_CYAN		0x30
+#define EFI_BACKGROUND_RED		0x40
+#define EFI_BACKGROUND_MAGENTA	0x50
+#define EFI_BACKGROUND_BROWN	0x60
+#define EFI_BACKGROUND_LIGHTGRAY	0x70
+
+typedef enum {
+	AllocateAnyPages,
+	AllocateMaxAddress,
+	AllocateAddress,
+	MaxAllocateType
+} EFI_ALLOCATE_TYPE;
+
+typedef enum {
+	EfiReservedMemoryType,
+	EfiLoaderCode,
+	EfiLoaderData,
+	EfiBootServicesCode,
+	EfiBootServicesData,
+	EfiRuntimeServicesCode,
+	EfiRuntimeServicesData,
+	EfiConventionalMemory,
+	EfiUnusableMemory,
+	EfiACPIReclaimMemory,
+	EfiACPIMemoryNVS,
+	EfiMemoryMappedIO,
+	EfiMemoryMappedIOPortSpace,
+	EfiPalCode,
+	EfiMaxMemoryType
+} EFI_MEMORY_TYPE;
+
+typedef enum {
+	EfiResetCold,
+	EfiResetWarm,
+	EfiResetShutdown
+} EFI_RESET_TYPE;
+
+typedef enum {
+	TimerCancel,
+	TimerPeriodic,
+	TimerRelative,
+	TimerTypeMax
+} EFI_TIMER_DELAY;
+
+typedef enum {
+	EFI_NATIVE_INTERFACE
+} EFI_INTERFACE_TYPE;
+
+typedef enum {
+	AllHandles,
+	ByRegisterNotify,
+	ByProtocol
+} EFI_LOCATE_SEARCH_TYPE;
+
+#define EVT_TIMER							0x80000000
+#define EVT_RUNTIME							0x40000000
+#define EVT_NOTIFY_WAIT						0x00000100
+#define EVT_NOTIFY_SIGNAL					0x00000200
+
+#define TPL_APPLICATION						4
+#define TPL_CALLBACK						8
+#define TPL_NOTIFY							16
+#define TPL_HIGH_LEVEL						31
+
+/* Device paths. */
+typedef struct _EFI_DEVICE_PATH {
+	UINT8 Type;
+	UINT8 SubType;
+	UINT8 Length[2];
+} EFI_DEVICE_PATH;
+
+typedef EFI_DEVICE_PATH EFI_DEVICE_PATH_PROTOCOL;
+
+#define HARDWARE_DEVICE_PATH		0x01
+#define MEDIA_DEVICE_PATH			0x04
+#define END_DEVICE_PATH_TYPE		0x7f
+#define END_ENTIRE_DEVICE_PATH_SUBTYPE	0xff
+#define END_DEVICE_PATH_LENGTH		(sizeof(EFI_DEVICE_PATH))
+#define MEDIA_HARDDRIVE_DP			0x01
+#define MEDIA_VENDOR_DP				0x03
+#define MEDIA_FILEPATH_DP			0x04
+
+#define DevicePathType(a)			(((a)->Type) & 0x7f)
+#define DevicePathSubType(a)		((a)->SubType)
+#define DevicePathNodeLength(a)		((UINTN) (((a)->Length[0]) | ((a)->Length[1] << 8)))
+#define NextDevicePathNode(a)		((EFI_DEVICE_PATH *) (((UINT8 *) (a)) + DevicePathNodeLength(a)))
+#define IsDevicePathEnd(a)			(DevicePathType(a) == END_DEVICE_PATH_TYPE && \
+										DevicePathSubType(a) == END_ENTIRE_DEVICE_PATH_SUBTYPE)
+#define SetDevicePathNodeLength(a, l) { \
+		(a)->Length[0] = (UINT8) (l); \
+		(a)->Length[1] = (UINT8) ((l) >> 8); \
+	}
+#define SetDevicePathEndNode(a) { \
+		(a)->Type = END_DEVICE_PATH_TYPE; \
+		(a)->SubType = END_ENTIRE_DEVICE_PATH_SUBTYPE; \
+		(a)->Length[0] = sizeof(EFI_DEVICE_PATH); \
+		(a)->Length[1] = 0; \
+	}
+
+typedef struct _VENDOR_DEVICE_PATH {
+	EFI_DEVICE_PATH Header;
+	EFI_GUID Guid;
+} VENDOR_DEVICE_PATH;
+
+typedef struct _HARDDRIVE_DEVICE_PATH {
+	EFI_DEVICE_PATH Header;
+	UINT32 PartitionNumber;
+	UINT64 PartitionStart;
+	UINT64 PartitionSize;
+	UINT8 Signature[16];
+	UINT8 MBRType;
+	UINT8 SignatureType;
+} __attribute__((packed)) HARDDRIVE_DEVICE_PATH;
+
+#define SIGNATURE_TYPE_MBR			0x01
+#define SIGNATURE_TYPE_GUID			0x02
+
+/* Console. */
+typedef struct {
+	UINT16 ScanCode;
+	CHAR16 UnicodeChar;
+} EFI_INPUT_KEY;
+
+#define CHAR_NULL				0x0000
+#define CHAR_BACKSPACE			0x0008
+#define CHAR_TAB				0x0009
+#define CHAR_LINEFEED			0x000A
+#define CHAR_CARRIAGE_RETURN	0x000D
+
+#define SCAN_NULL				0x0000
+#define SCAN_UP					0x0001
+#define SCAN_DOWN				0x0002
+#define SCAN_RIGHT				0x0003
+#define SCAN_LEFT				0x0004
+#define SCAN_HOME				0x0005
+#define SCAN_END				0x0006
+#define SCAN_INSERT				0x0007
+#define SCAN_DELETE				0x0008
+#define SCAN_PAGE_UP			0x0009
+#define SCAN_PAGE_DOWN			0x000A
+#define SCAN_F1					0x000B
+#define SCAN_F2					0x000C
+#define SCAN_F3					0x000D
+#define SCAN_F10				0x0014
+#define SCAN_ESC				0x0017
+
+struct _SIMPLE_INPUT_INTERFACE;
+struct _SIMPLE_TEXT_OUTPUT_INTERFACE;
+
+typedef EFI_STATUS (EFIAPI *EFI_INPUT_RESET)(struct _SIMPLE_INPUT_INTERFACE *This, BOOLEAN ExtendedVerification);
+typedef EFI_STATUS (EFIAPI *EFI_INPUT_READ_KEY)(struct _SIMPLE_INPUT_INTERFACE *This, EFI_INPUT_KEY *Key);
+
+typedef struct _SIMPLE_INPUT_INTERFACE {
+	EFI_INPUT_RESET Reset;
+	EFI_INPUT_READ_KEY ReadKeyStroke;
+	EFI_EVENT WaitForKey;
+} SIMPLE_INPUT_INTERFACE;
+
+typedef struct {
+	INT32 MaxMode;
+	INT32 Mode;
+	INT32 Attribute;
+	INT32 CursorColumn;
+	INT32 CursorRow;
+	BOOLEAN CursorVisible;
+} SIMPLE_TEXT_OUTPUT_MODE;
+
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_RESET)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, BOOLEAN ExtendedVerification);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_OUTPUT_STRING)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, CHAR16 *String);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_TEST_STRING)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, CHAR16 *String);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_QUERY_MODE)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN ModeNumber,
+	UINTN *Columns, UINTN *Rows);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_SET_MODE)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN ModeNumber);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_SET_ATTRIBUTE)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN Attribute);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_CLEAR_SCREEN)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_SET_CURSOR_POSITION)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN Column,
+	UINTN Row);
+typedef EFI_STATUS (EFIAPI *EFI_TEXT_ENABLE_CURSOR)(struct _SIMPLE_TEXT_OUTPUT_INTERFACE *This, BOOLEAN Enable);
+
+typedef struct _SIMPLE_TEXT_OUTPUT_INTERFACE {
+	EFI_TEXT_RESET Reset;
+	EFI_TEXT_OUTPUT_STRING OutputString;
+	EFI_TEXT_TEST_STRING TestString;
+	EFI_TEXT_QUERY_MODE QueryMode;
+	EFI_TEXT_SET_MODE SetMode;
+	EFI_TEXT_SET_ATTRIBUTE SetAttribute;
+	EFI_TEXT_CLEAR_SCREEN ClearScreen;
+	EFI_TEXT_SET_CURSOR_POSITION SetCursorPosition;
+	EFI_TEXT_ENABLE_CURSOR EnableCursor;
+	SIMPLE_TEXT_OUTPUT_MODE *Mode;
+} SIMPLE_TEXT_OUTPUT_INTERFACE;
+
+/* File access. */
+#define EFI_FILE_MODE_READ			0x0000000000000001
+#define EFI_FILE_MODE_WRITE			0x0000000000000002
+#define EFI_FILE_MODE_CREATE		0x8000000000000000
+
+#define EFI_FILE_READ_ONLY			0x0000000000000001
+#define EFI_FILE_HIDDEN				0x0000000000000002
+#define EFI_FILE_SYSTEM				0x0000000000000004
+#define EFI_FILE_RESERVIED			0x0000000000000008
+#define EFI_FILE_DIRECTORY			0x0000000000000010
+#define EFI_FILE_ARCHIVE			0x0000000000000020
+
+typedef struct {
+	UINT64 Size;
+	UINT64 FileSize;
+	UINT64 PhysicalSize;
+	EFI_TIME CreateTime;
+	EFI_TIME LastAccessTime;
+	EFI_TIME ModificationTime;
+	UINT64 Attribute;
+	CHAR16 FileName[1];
+} EFI_FILE_INFO;
+
+#define SIZE_OF_EFI_FILE_INFO		((UINTN) &((EFI_FILE_INFO *) 0)->FileName)
+
+struct _EFI_FILE_HANDLE;
+
+typedef EFI_STATUS (EFIAPI *EFI_FILE_OPEN)(struct _EFI_FILE_HANDLE *File, struct _EFI_FILE_HANDLE **NewHandle,
+	CHAR16 *FileName, UINT64 OpenMode, UINT64 Attributes);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_CLOSE)(struct _EFI_FILE_HANDLE *File);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_DELETE)(struct _EFI_FILE_HANDLE *File);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_READ)(struct _EFI_FILE_HANDLE *File, UINTN *BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_WRITE)(struct _EFI_FILE_HANDLE *File, UINTN *BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_SET_POSITION)(struct _EFI_FILE_HANDLE *File, UINT64 Position);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_GET_POSITION)(struct _EFI_FILE_HANDLE *File, UINT64 *Position);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_GET_INFO)(struct _EFI_FILE_HANDLE *File, EFI_GUID *InformationType,
+	UINTN *BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_SET_INFO)(struct _EFI_FILE_HANDLE *File, EFI_GUID *InformationType,
+	UINTN BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_FILE_FLUSH)(struct _EFI_FILE_HANDLE *File);
+
+typedef struct _EFI_FILE_HANDLE {
+	UINT64 Revision;
+	EFI_FILE_OPEN Open;
+	EFI_FILE_CLOSE Close;
+	EFI_FILE_DELETE Delete;
+	EFI_FILE_READ Read;
+	EFI_FILE_WRITE Write;
+	EFI_FILE_GET_POSITION GetPosition;
+	EFI_FILE_SET_POSITION SetPosition;
+	EFI_FILE_GET_INFO GetInfo;
+	EFI_FILE_SET_INFO SetInfo;
+	EFI_FILE_FLUSH Flush;
+} EFI_FILE, *EFI_FILE_HANDLE;
+
+/* Block devices. */
+typedef struct {
+	UINT32 MediaId;
+	BOOLEAN RemovableMedia;
+	BOOLEAN MediaPresent;
+	BOOLEAN LogicalPartition;
+	BOOLEAN ReadOnly;
+	BOOLEAN WriteCaching;
+	UINT32 BlockSize;
+	UINT32 IoAlign;
+	EFI_LBA LastBlock;
+} EFI_BLOCK_IO_MEDIA;
+
+struct _EFI_BLOCK_IO;
+struct _EFI_DISK_IO;
+
+typedef EFI_STATUS (EFIAPI *EFI_BLOCK_RESET)(struct _EFI_BLOCK_IO *This, BOOLEAN ExtendedVerification);
+typedef EFI_STATUS (EFIAPI *EFI_BLOCK_READ)(struct _EFI_BLOCK_IO *This, UINT32 MediaId, EFI_LBA LBA,
+	UINTN BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_BLOCK_WRITE)(struct _EFI_BLOCK_IO *This, UINT32 MediaId, EFI_LBA LBA,
+	UINTN BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_BLOCK_FLUSH)(struct _EFI_BLOCK_IO *This);
+
+typedef struct _EFI_BLOCK_IO {
+	UINT64 Revision;
+	EFI_BLOCK_IO_MEDIA *Media;
+	EFI_BLOCK_RESET Reset;
+	EFI_BLOCK_READ ReadBlocks;
+	EFI_BLOCK_WRITE WriteBlocks;
+	EFI_BLOCK_FLUSH FlushBlocks;
+} EFI_BLOCK_IO;
+
+typedef EFI_STATUS (EFIAPI *EFI_DISK_READ)(struct _EFI_DISK_IO *This, UINT32 MediaId, UINT64 Offset,
+	UINTN BufferSize, VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_DISK_WRITE)(struct _EFI_DISK_IO *This, UINT32 MediaId, UINT64 Offset,
+	UINTN BufferSize, VOID *Buffer);
+
+typedef struct _EFI_DISK_IO {
+	UINT64 Revision;
+	EFI_DISK_READ ReadDisk;
+	EFI_DISK_WRITE WriteDisk;
+} EFI_DISK_IO;
+
+/* Runtime services. */
+typedef EFI_STATUS (EFIAPI *EFI_GET_TIME)(EFI_TIME *Time, VOID *Capabilities);
+typedef EFI_STATUS (EFIAPI *EFI_GET_VARIABLE)(CHAR16 *VariableName, EFI_GUID *VendorGuid, UINT32 *Attributes,
+	UINTN *DataSize, VOID *Data);
+typedef EFI_STATUS (EFIAPI *EFI_GET_NEXT_VARIABLE_NAME)(UINTN *VariableNameSize, CHAR16 *VariableName,
+	EFI_GUID *VendorGuid);
+typedef EFI_STATUS (EFIAPI *EFI_SET_VARIABLE)(CHAR16 *VariableName, EFI_GUID *VendorGuid, UINT32 Attributes,
+	UINTN DataSize, VOID *Data);
+typedef EFI_STATUS (EFIAPI *EFI_RESET_SYSTEM)(EFI_RESET_TYPE ResetType, EFI_STATUS ResetStatus, UINTN DataSize,
+	CHAR16 *ResetData);
+
+typedef struct {
+	UINT64 Signature;
+	UINT32 Revision;
+	UINT32 HeaderSize;
+	UINT32 CRC32;
+	UINT32 Reserved;
+} EFI_TABLE_HEADER;
+
+typedef struct {
+	EFI_TABLE_HEADER Hdr;
+	EFI_GET_TIME GetTime;
+	VOID *SetTime;
+	VOID *GetWakeupTime;
+	VOID *SetWakeupTime;
+	VOID *SetVirtualAddressMap;
+	VOID *ConvertPointer;
+	EFI_GET_VARIABLE GetVariable;
+	EFI_GET_NEXT_VARIABLE_NAME GetNextVariableName;
+	EFI_SET_VARIABLE SetVariable;
+	VOID *GetNextHighMonotonicCount;
+	EFI_RESET_SYSTEM ResetSystem;
+} EFI_RUNTIME_SERVICES;
+
+/* Boot services. */
+typedef VOID (EFIAPI *EFI_EVENT_NOTIFY)(EFI_EVENT Event, VOID *Context);
+
+typedef EFI_TPL (EFIAPI *EFI_RAISE_TPL)(EFI_TPL NewTpl);
+typedef VOID (EFIAPI *EFI_RESTORE_TPL)(EFI_TPL OldTpl);
+typedef EFI_STATUS (EFIAPI *EFI_ALLOCATE_PAGES)(EFI_ALLOCATE_TYPE Type, EFI_MEMORY_TYPE MemoryType,
+	UINTN NoPages, EFI_PHYSICAL_ADDRESS *Memory);
+typedef EFI_STATUS (EFIAPI *EFI_FREE_PAGES)(EFI_PHYSICAL_ADDRESS Memory, UINTN NoPages);
+typedef EFI_STATUS (EFIAPI *EFI_ALLOCATE_POOL)(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID **Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_FREE_POOL)(VOID *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_CREATE_EVENT)(UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction,
+	VOID *NotifyContext, EFI_EVENT *Event);
+typedef EFI_STATUS (EFIAPI *EFI_SET_TIMER)(EFI_EVENT Event, EFI_TIMER_DELAY Type, UINT64 TriggerTime);
+typedef EFI_STATUS (EFIAPI *EFI_WAIT_FOR_EVENT)(UINTN NumberOfEvents, EFI_EVENT *Event, UINTN *Index);
+typedef EFI_STATUS (EFIAPI *EFI_SIGNAL_EVENT)(EFI_EVENT Event);
+typedef EFI_STATUS (EFIAPI *EFI_CLOSE_EVENT)(EFI_EVENT Event);
+typedef EFI_STATUS (EFIAPI *EFI_CHECK_EVENT)(EFI_EVENT Event);
+typedef EFI_STATUS (EFIAPI *EFI_INSTALL_PROTOCOL_INTERFACE)(EFI_HANDLE *Handle, EFI_GUID *Protocol,
+	EFI_INTERFACE_TYPE InterfaceType, VOID *Interface);
+typedef EFI_STATUS (EFIAPI *EFI_UNINSTALL_PROTOCOL_INTERFACE)(EFI_HANDLE Handle, EFI_GUID *Protocol,
+	VOID *Interface);
+typedef EFI_STATUS (EFIAPI *EFI_HANDLE_PROTOCOL)(EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface);
+typedef EFI_STATUS (EFIAPI *EFI_LOCATE_HANDLE)(EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol,
+	VOID *SearchKey, UINTN *BufferSize, EFI_HANDLE *Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_LOCATE_DEVICE_PATH)(EFI_GUID *Protocol, EFI_DEVICE_PATH **DevicePath,
+	EFI_HANDLE *Device);
+typedef EFI_STATUS (EFIAPI *EFI_INSTALL_CONFIGURATION_TABLE)(EFI_GUID *Guid, VOID *Table);
+typedef EFI_STATUS (EFIAPI *EFI_IMAGE_LOAD)(BOOLEAN BootPolicy, EFI_HANDLE ParentImageHandle,
+	EFI_DEVICE_PATH *FilePath, VOID *SourceBuffer, UINTN SourceSize, EFI_HANDLE *ImageHandle);
+typedef EFI_STATUS (EFIAPI *EFI_IMAGE_START)(EFI_HANDLE ImageHandle, UINTN *ExitDataSize, CHAR16 **ExitData);
+typedef EFI_STATUS (EFIAPI *EFI_EXIT)(EFI_HANDLE ImageHandle, EFI_STATUS ExitStatus, UINTN ExitDataSize,
+	CHAR16 *ExitData);
+typedef EFI_STATUS (EFIAPI *EFI_IMAGE_UNLOAD)(EFI_HANDLE ImageHandle);
+typedef EFI_STATUS (EFIAPI *EFI_STALL)(UINTN Microseconds);
+typedef EFI_STATUS (EFIAPI *EFI_SET_WATCHDOG_TIMER)(UINTN Timeout, UINT64 WatchdogCode, UINTN DataSize,
+	CHAR16 *WatchdogData);
+typedef EFI_STATUS (EFIAPI *EFI_LOCATE_HANDLE_BUFFER)(EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol,
+	VOID *SearchKey, UINTN *NoHandles, EFI_HANDLE **Buffer);
+typedef EFI_STATUS (EFIAPI *EFI_LOCATE_PROTOCOL)(EFI_GUID *Protocol, VOID *Registration, VOID **Interface);
+typedef EFI_STATUS (EFIAPI *EFI_INSTALL_MULTIPLE_PROTOCOL_INTERFACES)(EFI_HANDLE *Handle, ...);
+typedef EFI_STATUS (EFIAPI *EFI_UNINSTALL_MULTIPLE_PROTOCOL_INTERFACES)(EFI_HANDLE Handle, ...);
+typedef EFI_STATUS (EFIAPI *EFI_CALCULATE_CRC32)(VOID *Data, UINTN DataSize, UINT32 *Crc32);
+typedef VOID (EFIAPI *EFI_COPY_MEM)(VOID *Destination, VOID *Source, UINTN Length);
+typedef VOID (EFIAPI *EFI_SET_MEM)(VOID *Buffer, UINTN Size, UINT8 Value);
+
+typedef struct {
+	EFI_TABLE_HEADER Hdr;
+	EFI_RAISE_TPL RaiseTPL;
+	EFI_RESTORE_TPL RestoreTPL;
+	EFI_ALLOCATE_PAGES AllocatePages;
+	EFI_FREE_PAGES FreePages;
+	VOID *GetMemoryMap;
+	EFI_ALLOCATE_POOL AllocatePool;
+	EFI_FREE_POOL FreePool;
+	EFI_CREATE_EVENT CreateEvent;
+	EFI_SET_TIMER SetTimer;
+	EFI_WAIT_FOR_EVENT WaitForEvent;
+	EFI_SIGNAL_EVENT SignalEvent;
+	EFI_CLOSE_EVENT CloseEvent;
+	EFI_CHECK_EVENT CheckEvent;
+	EFI_INSTALL_PROTOCOL_INTERFACE InstallProtocolInterface;
+	VOID *ReinstallProtocolInterface;
+	EFI_UNINSTALL_PROTOCOL_INTERFACE UninstallProtocolInterface;
+	EFI_HANDLE_PROTOCOL HandleProtocol;
+	EFI_HANDLE_PROTOCOL PCHandleProtocol;
+	VOID *Reserved;
+	VOID *RegisterProtocolNotify;
+	EFI_LOCATE_HANDLE LocateHandle;
+	EFI_LOCATE_DEVICE_PATH LocateDevicePath;
+	EFI_INSTALL_CONFIGURATION_TABLE InstallConfigurationTable;
+	EFI_IMAGE_LOAD LoadImage;
+	EFI_IMAGE_START StartImage;
+	EFI_EXIT Exit;
+	EFI_IMAGE_UNLOAD UnloadImage;
+	VOID *ExitBootServices;
+	VOID *GetNextMonotonicCount;
+	EFI_STALL Stall;
+	EFI_SET_WATCHDOG_TIMER SetWatchdogTimer;
+	VOID *ConnectController;
+	VOID *DisconnectController;
+	VOID *OpenProtocol;
+	VOID *CloseProtocol;
+	VOID *OpenProtocolInformation;
+	VOID *ProtocolsPerHandle;
+	EFI_LOCATE_HANDLE_BUFFER LocateHandleBuffer;
+	EFI_LOCATE_PROTOCOL LocateProtocol;
+	EFI_INSTALL_MULTIPLE_PROTOCOL_INTERFACES InstallMultipleProtocolInterfaces;
+	EFI_UNINSTALL_MULTIPLE_PROTOCOL_INTERFACES UninstallMultipleProtocolInterfaces;
+	EFI_CALCULATE_CRC32 CalculateCrc32;
+	EFI_COPY_MEM CopyMem;
+	EFI_SET_MEM SetMem;
+} EFI_BOOT_SERVICES;
+
+typedef struct {
+	EFI_GUID VendorGuid;
+	VOID *VendorTable;
+} EFI_CONFIGURATION_TABLE;
+
+typedef struct {
+	EFI_TABLE_HEADER Hdr;
+	CHAR16 *FirmwareVendor;
+	UINT32 FirmwareRevision;
+	EFI_HANDLE ConsoleInHandle;
+	SIMPLE_INPUT_INTERFACE *ConIn;
+	EFI_HANDLE ConsoleOutHandle;
+	SIMPLE_TEXT_OUTPUT_INTERFACE *ConOut;
+	EFI_HANDLE StandardErrorHandle;
+	SIMPLE_TEXT_OUTPUT_INTERFACE *StdErr;
+	EFI_RUNTIME_SERVICES *RuntimeServices;
+	EFI_BOOT_SERVICES *BootServices;
+	UINTN NumberOfTableEntries;
+	EFI_CONFIGURATION_TABLE *ConfigurationTable;
+} EFI_SYSTEM_TABLE;
+
+/* Loaded images. */
+typedef struct {
+	UINT32 Revision;
+	EFI_HANDLE ParentHandle;
+	EFI_SYSTEM_TABLE *SystemTable;
+	EFI_HANDLE DeviceHandle;
+	EFI_DEVICE_PATH *FilePath;
+	VOID *Reserved;
+	UINT32 LoadOptionsSize;
+	VOID *LoadOptions;
+	VOID *ImageBase;
+	UINT64 ImageSize;
+	EFI_MEMORY_TYPE ImageCodeType;
+	EFI_MEMORY_TYPE ImageDataType;
+	VOID *Unload;
+} EFI_LOADED_IMAGE;
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * The subset of the GNU-EFI support library used by Enterprise, implemented
+ * on the host by shim.c.
+ */
+
+#pragma once
+#ifndef _bench_efilib_h
+#define _bench_efilib_h
+
+#include "efi.h"
+
+extern EFI_SYSTEM_TABLE *ST;
+extern EFI_BOOT_SERVICES *BS;
+extern EFI_RUNTIME_SERVICES *RT;
+
+extern EFI_GUID LoadedImageProtocol;
+extern EFI_GUID DevicePathProtocol;
+extern EFI_GUID FileSystemProtocol;
+extern EFI_GUID BlockIoProtocol;
+extern EFI_GUID DiskIoProtocol;
+extern EFI_GUID GenericFileInfo;
+
+VOID InitializeLib(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable);
+
+VOID *AllocatePool(UINTN Size);
+VOID *AllocateZeroPool(UINTN Size);
+VOID *ReallocatePool(VOID *OldPool, UINTN OldSize, UINTN NewSize);
+VOID FreePool(VOID *p);
+
+VOID ZeroMem(VOID *Buffer, UINTN Size);
+VOID SetMem(VOID *Buffer, UINTN Size, UINT8 Value);
+VOID CopyMem(VOID *Dest, VOID *Src, UINTN len);
+INTN CompareMem(VOID *Dest, VOID *Src, UINTN len);
+INTN CompareGuid(EFI_GUID *Guid1, EFI_GUID *Guid2);
+
+UINTN StrLen(CHAR16 *s1);
+UINTN StrSize(CHAR16 *s1);
+INTN StrCmp(CHAR16 *s1, CHAR16 *s2);
+INTN StrnCmp(CHAR16 *s1, CHAR16 *s2, UINTN len);
+VOID StrCpy(CHAR16 *Dest, CHAR16 *Src);
+VOID StrnCpy(CHAR16 *Dest, CHAR16 *Src, UINTN Len);
+VOID StrCat(CHAR16 *Dest, CHAR16 *Src);
+CHAR16 *StrDuplicate(CHAR16 *Src);
+UINTN Atoi(CHAR16 *str);
+UINTN strlena(CHAR8 *s1);
+UINTN strcmpa(CHAR8 *s1, CHAR8 *s2);
+UINTN strncmpa(CHAR8 *s1, CHAR8 *s2, UINTN len);
+
+UINTN Print(CHAR16 *fmt, ...);
+UINTN SPrint(CHAR16 *Str, UINTN StrSize, CHAR16 *fmt, ...);
+UINTN VSPrint(CHAR16 *Str, UINTN StrSize, CHAR16 *fmt, va_list args);
+
+EFI_FILE_HANDLE LibOpenRoot(EFI_HANDLE DeviceHandle);
+EFI_FILE_INFO *LibFileInfo(EFI_FILE_HANDLE FHand);
+EFI_STATUS LibLocateProtocol(EFI_GUID *ProtocolGuid, VOID **Interface);
+EFI_STATUS LibLocateHandle(EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol, VOID *SearchKey,
+	UINTN *NoHandles, EFI_HANDLE **Buffer);
+EFI_DEVICE_PATH *FileDevicePath(EFI_HANDLE Device, CHAR16 *FileName);
+EFI_DEVICE_PATH *DevicePathFromHandle(EFI_HANDLE Handle);
+
+#endif
@@ -0,0 +1,679 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+
+/*
+ * Simulated boot media for the benchmarks: the file protocol over a host
+ * directory, standing in for the firmware's FAT driver, and block and disk
+ * I/O over a host image file, standing in for the USB stick underneath it.
+ * Each call is charged to shim_stats according to a latency model, so that
+ * read sizes, caching and prefetch policies can be compared without the
+ * hardware and without the noise of real timing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shim.h"
+
+#define SHIM_MEDIA_BLOCK_SIZE 512
+#define SHIM_MEDIA_MAX_NAME 255
+
+/*
+ * Rough figures for a Mac reading a USB 2.0 stick. Apple's FAT driver goes
+ * to the device a cluster at a time and does a good deal of work per call;
+ * below it, a disk read becomes mass-storage commands of up to 64 KiB that
+ * stream at about 30 MB/s once started.
+ */
+const ShimLatency shim_latency_apple_fat = {
+	.call_ns = 40000,
+	.seek_ns = 1000000,
+	.transfer_ns = 250000,
+	.transfer_size = 32 * 1024,
+	.byte_ns = 33.0,
+};
+
+const ShimLatency shim_latency_usb_disk = {
+	.call_ns = 5000,
+	.seek_ns = 200000,
+	.transfer_ns = 250000,
+	.transfer_size = 64 * 1024,
+	.byte_ns = 33.0,
+};
+
+/* What DevicePathFromHandle() gives for a device: one GPT partition. */
+typedef struct ShimDevicePath {
+	HARDDRIVE_DEVICE_PATH drive;
+	EFI_DEVICE_PATH end;
+} __attribute__((packed)) ShimDevicePath;
+
+typedef struct ShimMedia {
+	struct ShimMedia *next;
+	char *directory;
+	int image;
+	ShimLatency file_latency;
+	ShimLatency disk_latency;
+	VOID *last_file;
+	UINT64 file_position;
+	UINT64 disk_position;
+	EFI_BLOCK_IO_MEDIA block_media;
+	EFI_BLOCK_IO block_io;
+	EFI_DISK_IO disk_io;
+	ShimDevicePath device_path;
+} ShimMedia;
+
+/* An open file or directory; the EFI_FILE comes first so handles cast back. */
+typedef struct ShimFile {
+	EFI_FILE file;
+	ShimMedia *media;
+	char *path;
+	int fd;
+	DIR *dir;
+	UINT64 position;
+	UINT64 size;
+} ShimFile;
+
+static ShimMedia *shim_media;
+
+#ifdef __APPLE__
+	#pragma mark - Latency model
+#endif
+static VOID ShimMediaCall(const ShimLatency *latency) {
+	shim_stats.media_nanoseconds += latency->call_ns;
+}
+
+/* Charges a read of size bytes at offset; position is where the last ended. */
+static VOID ShimMediaRead(const ShimLatency *latency, UINT64 *position, UINT64 offset, UINTN size) {
+	UINT64 cost = latency->call_ns;
+
+	if (offset != *position) {
+		cost += latency->seek_ns;
+		shim_stats.media_seeks++;
+	}
+	if (size > 0) {
+		cost += (size + latency->transfer_size - 1) / latency->transfer_size * latency->transfer_ns;
+		cost += (UINT64)(size * latency->byte_ns);
+	}
+
+	*position = offset + size;
+	shim_stats.media_bytes += size;
+	shim_stats.media_nanoseconds += cost;
+}
+
+#ifdef __APPLE__
+	#pragma mark - File protocol
+#endif
+static EFI_STATUS EFIAPI ShimFileOpen(EFI_FILE *File, EFI_FILE **NewHandle, CHAR16 *FileName, UINT64 OpenMode,
+	UINT64 Attributes);
+static EFI_STATUS EFIAPI ShimFileClose(EFI_FILE *File);
+static EFI_STATUS EFIAPI ShimFileDelete(EFI_FILE *File);
+static EFI_STATUS EFIAPI ShimFileRead(EFI_FILE *File, UINTN *BufferSize, VOID *Buffer);
+static EFI_STATUS EFIAPI ShimFileWrite(EFI_FILE *File, UINTN *BufferSize, VOID *Buffer);
+static EFI_STATUS EFIAPI ShimFileGetPosition(EFI_FILE *File, UINT64 *Position);
+static EFI_STATUS EFIAPI ShimFileSetPosition(EFI_FILE *File, UINT64 Position);
+static EFI_STATUS EFIAPI ShimFileGetInfo(EFI_FILE *File, EFI_GUID *InformationType, UINTN *BufferSize,
+	VOID *Buffer);
+static EFI_STATUS EFIAPI ShimFileSetInfo(EFI_FILE *File, EFI_GUID *InformationType, UINTN BufferSize,
+	VOID *Buffer);
+static EFI_STATUS EFIAPI ShimFileFlush(EFI_FILE *File);
+
+static const EFI_FILE shim_file_protocol = {
+	.Revision = 0x00010000,
+	.Open = ShimFileOpen,
+	.Close = ShimFileClose,
+	.Delete = ShimFileDelete,
+	.Read = ShimFileRead,
+	.Write = ShimFileWrite,
+	.GetPosition = ShimFileGetPosition,
+	.SetPosition = ShimFileSetPosition,
+	.GetInfo = ShimFileGetInfo,
+	.SetInfo = ShimFileSetInfo,
+	.Flush = ShimFileFlush,
+};
+
+static ShimFile* ShimFileCreate(ShimMedia *media, char *path) {
+	ShimFile *file;
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		free(path);
+		return NULL;
+	}
+
+	file = calloc(1, sizeof(ShimFile));
+	file->file = shim_file_protocol;
+	file->media = media;
+	file->path = path;
+	file->fd = -1;
+	if (S_ISDIR(st.st_mode)) {
+		file->dir = opendir(path);
+	} else {
+		file->fd = open(path, O_RDONLY);
+		file->size = st.st_size;
+	}
+
+	if (!file->dir && file->fd < 0) {
+		free(file->path);
+		free(file);
+		return NULL;
+	}
+	return file;
+}
+
+/*
+ * Appends one component of a firmware path to a host path, matching names
+ * without regard to case as FAT does. Returns FALSE if there is no match.
+ */
+static BOOLEAN ShimFileAppend(char **path, const char *root, char *component) {
+	struct dirent *entry;
+	char *joined = NULL;
+	DIR *dir;
+
+	if (strcmp(component, ".") == 0) {
+		return TRUE;
+	} else if (strcmp(component, "..") == 0) {
+		char *slash = strrchr(*path, '/');
+
+		if (strlen(*path) > strlen(root) && slash) {
+			*slash = '\0';
+		}
+		return TRUE;
+	}
+
+	dir = opendir(*path);
+	if (!dir) {
+		return FALSE;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcasecmp(entry->d_name, component) == 0) {
+			joined = malloc(strlen(*path) + strlen(entry->d_name) + 2);
+			sprintf(joined, "%s/%s", *path, entry->d_name);
+			break;
+		}
+	}
+	closedir(dir);
+
+	if (!joined) {
+		return FALSE;
+	}
+	free(*path);
+	*path = joined;
+	return TRUE;
+}
+
+static EFI_STATUS EFIAPI ShimFileOpen(EFI_FILE *File, EFI_FILE **NewHandle, CHAR16 *FileName, UINT64 OpenMode,
+		UINT64 Attributes) {
+	ShimFile *from = (ShimFile *)File, *file;
+	ShimMedia *media = from->media;
+	char component[SHIM_MEDIA_MAX_NAME + 1], *path;
+	UINTN length = 0;
+
+	shim_stats.file_calls++;
+	ShimMediaCall(&media->file_latency);
+	if (OpenMode != EFI_FILE_MODE_READ) {
+		return EFI_WRITE_PROTECTED;
+	}
+
+	// Every open walks directories on the stick, which is as good as a seek.
+	shim_stats.media_nanoseconds += media->file_latency.seek_ns;
+	shim_stats.media_seeks++;
+
+	path = strdup(*FileName == '\\' ? media->directory : from->path);
+	for (;; FileName++) {
+		if (*FileName == '\\' || *FileName == '\0') {
+			component[length] = '\0';
+			if (length > 0 && !ShimFileAppend(&path, media->directory, component)) {
+				free(path);
+				return EFI_NOT_FOUND;
+			}
+			length = 0;
+			if (*FileName == '\0') {
+				break;
+			}
+		} else if (length < SHIM_MEDIA_MAX_NAME) {
+			component[length++] = *FileName < 0x80 ? *FileName : '?';
+		}
+	}
+
+	file = ShimFileCreate(media, path);
+	if (!file) {
+		return EFI_NOT_FOUND;
+	}
+	*NewHandle = &file->file;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimFileClose(EFI_FILE *File) {
+	ShimFile *file = (ShimFile *)File;
+
+	shim_stats.file_calls++;
+	ShimMediaCall(&file->media->file_latency);
+	if (file->media->last_file == file) {
+		file->media->last_file = NULL;
+	}
+
+	if (file->dir) {
+		closedir(file->dir);
+	}
+	if (file->fd >= 0) {
+		close(file->fd);
+	}
+	free(file->path);
+	free(file);
+	return EFI_SUCCESS;
+}
+
+/* The media is read-only; Delete closes the handle all the same. */
+static EFI_STATUS EFIAPI ShimFileDelete(EFI_FILE *File) {
+	ShimFileClose(File);
+	return EFI_WRITE_PROTECTED;
+}
+
+static EFI_STATUS EFIAPI ShimFileWrite(EFI_FILE *File, UINTN *BufferSize, VOID *Buffer) {
+	return EFI_WRITE_PROTECTED;
+}
+
+static EFI_STATUS EFIAPI ShimFileSetInfo(EFI_FILE *File, EFI_GUID *InformationType, UINTN BufferSize,
+		VOID *Buffer) {
+	return EFI_WRITE_PROTECTED;
+}
+
+static EFI_STATUS EFIAPI ShimFileFlush(EFI_FILE *File) {
+	return EFI_SUCCESS;
+}
+
+/* Fills in an EFI_FILE_INFO for a host file, or says how big it must be. */
+static EFI_STATUS ShimFileInfo(const char *path, const char *name, UINTN *BufferSize, VOID *Buffer) {
+	EFI_FILE_INFO *info = Buffer;
+	UINTN length = strlen(name), size, i;
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return EFI_DEVICE_ERROR;
+	}
+
+	size = SIZE_OF_EFI_FILE_INFO + (length + 1) * sizeof(CHAR16);
+	if (*BufferSize < size) {
+		*BufferSize = size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	ZeroMem(info, size);
+	info->Size = size;
+	info->Attribute = EFI_FILE_READ_ONLY;
+	if (S_ISDIR(st.st_mode)) {
+		info->Attribute |= EFI_FILE_DIRECTORY;
+	} else {
+		info->FileSize = st.st_size;
+		info->PhysicalSize = (st.st_size + 4095) & ~4095ULL;
+	}
+	for (i = 0; i < length; i++) {
+		info->FileName[i] = (UINT8)name[i];
+	}
+	info->FileName[length] = '\0';
+
+	*BufferSize = size;
+	return EFI_SUCCESS;
+}
+
+/* Directories read one entry per call, as EFI_FILE_INFO; zero bytes at the end. */
+static EFI_STATUS ShimFileReadDirectory(ShimFile *file, UINTN *BufferSize, VOID *Buffer) {
+	struct dirent *entry;
+	char *path;
+	long mark;
+	EFI_STATUS err;
+
+	mark = telldir(file->dir);
+	entry = readdir(file->dir);
+	if (!entry) {
+		*BufferSize = 0;
+		return EFI_SUCCESS;
+	}
+
+	path = malloc(strlen(file->path) + strlen(entry->d_name) + 2);
+	sprintf(path, "%s/%s", file->path, entry->d_name);
+	err = ShimFileInfo(path, entry->d_name, BufferSize, Buffer);
+	free(path);
+
+	// The caller grows its buffer and asks for the same entry again.
+	if (err == EFI_BUFFER_TOO_SMALL) {
+		seekdir(file->dir, mark);
+	}
+	return err;
+}
+
+static EFI_STATUS EFIAPI ShimFileRead(EFI_FILE *File, UINTN *BufferSize, VOID *Buffer) {
+	ShimFile *file = (ShimFile *)File;
+	ShimMedia *media = file->media;
+	ssize_t length;
+
+	shim_stats.file_calls++;
+	if (file->dir) {
+		ShimMediaCall(&media->file_latency);
+		return ShimFileReadDirectory(file, BufferSize, Buffer);
+	}
+
+	if (file->position >= file->size) {
+		*BufferSize = 0;
+	} else if (*BufferSize > file->size - file->position) {
+		*BufferSize = file->size - file->position;
+	}
+
+	length = pread(file->fd, Buffer, *BufferSize, file->position);
+	if (length < 0) {
+		*BufferSize = 0;
+		return EFI_DEVICE_ERROR;
+	}
+	*BufferSize = length;
+
+	// Moving on to another file means finding its clusters first.
+	if (media->last_file != file) {
+		media->last_file = file;
+		media->file_position = ~0ULL;
+	}
+	ShimMediaRead(&media->file_latency, &media->file_position, file->position, *BufferSize);
+	file->position += *BufferSize;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimFileGetPosition(EFI_FILE *File, UINT64 *Position) {
+	ShimFile *file = (ShimFile *)File;
+
+	shim_stats.file_calls++;
+	ShimMediaCall(&file->media->file_latency);
+	if (file->dir) {
+		return EFI_UNSUPPORTED;
+	}
+	*Position = file->position;
+	return EFI_SUCCESS;
+}
+
+/* Only the read that follows pays for a seek, and only if it needs one. */
+static EFI_STATUS EFIAPI ShimFileSetPosition(EFI_FILE *File, UINT64 Position) {
+	ShimFile *file = (ShimFile *)File;
+
+	shim_stats.file_calls++;
+	ShimMediaCall(&file->media->file_latency);
+	if (file->dir) {
+		if (Position != 0) {
+			return EFI_UNSUPPORTED;
+		}
+		rewinddir(file->dir);
+		return EFI_SUCCESS;
+	}
+
+	file->position = Position == ~0ULL ? file->size : Position;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimFileGetInfo(EFI_FILE *File, EFI_GUID *InformationType, UINTN *BufferSize,
+		VOID *Buffer) {
+	ShimFile *file = (ShimFile *)File;
+	const char *name = file->path + strlen(file->media->directory);
+
+	shim_stats.file_calls++;
+	ShimMediaCall(&file->media->file_latency);
+	if (CompareGuid(InformationType, &GenericFileInfo) != 0) {
+		return EFI_UNSUPPORTED;
+	}
+
+	// The root directory's name is empty.
+	if (*name == '/') {
+		name = strrchr(name, '/') + 1;
+	}
+	return ShimFileInfo(file->path, name, BufferSize, Buffer);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Block and disk I/O
+#endif
+static ShimMedia* ShimMediaFromBlockIo(EFI_BLOCK_IO *block_io) {
+	return (ShimMedia *)((UINT8 *)block_io - offsetof(ShimMedia, block_io));
+}
+
+static ShimMedia* ShimMediaFromDiskIo(EFI_DISK_IO *disk_io) {
+	return (ShimMedia *)((UINT8 *)disk_io - offsetof(ShimMedia, disk_io));
+}
+
+static EFI_STATUS ShimMediaReadImage(ShimMedia *media, UINT32 media_id, UINT64 offset, UINTN size, VOID *buffer) {
+	UINT64 media_size = (media->block_media.LastBlock + 1) * SHIM_MEDIA_BLOCK_SIZE;
+
+	shim_stats.disk_calls++;
+	if (media_id != media->block_media.MediaId) {
+		ShimMediaCall(&media->disk_latency);
+		return EFI_MEDIA_CHANGED;
+	} else if (offset > media_size || size > media_size - offset) {
+		ShimMediaCall(&media->disk_latency);
+		return EFI_INVALID_PARAMETER;
+	}
+
+	if (pread(media->image, buffer, size, offset) != (ssize_t)size) {
+		return EFI_DEVICE_ERROR;
+	}
+	ShimMediaRead(&media->disk_latency, &media->disk_position, offset, size);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimBlockReset(EFI_BLOCK_IO *This, BOOLEAN ExtendedVerification) {
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimBlockRead(EFI_BLOCK_IO *This, UINT32 MediaId, EFI_LBA LBA, UINTN BufferSize,
+		VOID *Buffer) {
+	if (BufferSize % SHIM_MEDIA_BLOCK_SIZE != 0) {
+		return EFI_BAD_BUFFER_SIZE;
+	}
+	return ShimMediaReadImage(ShimMediaFromBlockIo(This), MediaId, LBA * SHIM_MEDIA_BLOCK_SIZE, BufferSize, Buffer);
+}
+
+static EFI_STATUS EFIAPI ShimBlockWrite(EFI_BLOCK_IO *This, UINT32 MediaId, EFI_LBA LBA, UINTN BufferSize,
+		VOID *Buffer) {
+	return EFI_WRITE_PROTECTED;
+}
+
+static EFI_STATUS EFIAPI ShimBlockFlush(EFI_BLOCK_IO *This) {
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimDiskRead(EFI_DISK_IO *This, UINT32 MediaId, UINT64 Offset, UINTN BufferSize,
+		VOID *Buffer) {
+	return ShimMediaReadImage(ShimMediaFromDiskIo(This), MediaId, Offset, BufferSize, Buffer);
+}
+
+static EFI_STATUS EFIAPI ShimDiskWrite(EFI_DISK_IO *This, UINT32 MediaId, UINT64 Offset, UINTN BufferSize,
+		VOID *Buffer) {
+	return EFI_WRITE_PROTECTED;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Devices
+#endif
+/*
+ * Creates a device handle for the benchmarks. Either backing may be NULL:
+ * directory gives it a file system, image a disk. A NULL latency is free.
+ */
+EFI_HANDLE ShimMediaCreate(const char *directory, const char *image, const ShimLatency *file_latency,
+		const ShimLatency *disk_latency) {
+	static const ShimLatency free_latency = { .transfer_size = 1 };
+	static UINT32 partition_count;
+	ShimMedia *media = calloc(1, sizeof(ShimMedia));
+	struct stat st;
+
+	media->image = -1;
+	media->file_latency = file_latency ? *file_latency : free_latency;
+	media->disk_latency = disk_latency ? *disk_latency : free_latency;
+	media->file_position = ~0ULL;
+	media->disk_position = ~0ULL;
+
+	// Each device is a partition with a GUID of its own, made up.
+	media->device_path.drive.Header.Type = MEDIA_DEVICE_PATH;
+	media->device_path.drive.Header.SubType = MEDIA_HARDDRIVE_DP;
+	SetDevicePathNodeLength(&media->device_path.drive.Header, sizeof(HARDDRIVE_DEVICE_PATH));
+	media->device_path.drive.PartitionNumber = 1;
+	media->device_path.drive.MBRType = 2;
+	media->device_path.drive.SignatureType = SIGNATURE_TYPE_GUID;
+	partition_count++;
+	memcpy(media->device_path.drive.Signature, &partition_count, sizeof(partition_count));
+	SetDevicePathEndNode(&media->device_path.end);
+
+	if (directory) {
+		media->directory = strdup(directory);
+	}
+	if (image) {
+		media->image = open(image, O_RDONLY);
+		if (media->image < 0 || fstat(media->image, &st) != 0) {
+			ShimMediaDestroy(media);
+			return NULL;
+		}
+
+		media->block_media.MediaId = 1;
+		media->block_media.RemovableMedia = TRUE;
+		media->block_media.MediaPresent = TRUE;
+		media->block_media.LogicalPartition = TRUE;
+		media->block_media.ReadOnly = TRUE;
+		media->block_media.BlockSize = SHIM_MEDIA_BLOCK_SIZE;
+		media->block_media.LastBlock = st.st_size / SHIM_MEDIA_BLOCK_SIZE - 1;
+
+		media->block_io.Revision = 0x00010000;
+		media->block_io.Media = &media->block_media;
+		media->block_io.Reset = ShimBlockReset;
+		media->block_io.ReadBlocks = ShimBlockRead;
+		media->block_io.WriteBlocks = ShimBlockWrite;
+		media->block_io.FlushBlocks = ShimBlockFlush;
+
+		media->disk_io.Revision = 0x00010000;
+		media->disk_io.ReadDisk = ShimDiskRead;
+		media->disk_io.WriteDisk = ShimDiskWrite;
+	}
+
+	media->next = shim_media;
+	shim_media = media;
+	return media;
+}
+
+VOID ShimMediaDestroy(EFI_HANDLE device) {
+	ShimMedia *media = device, **link;
+
+	for (link = &shim_media; *link; link = &(*link)->next) {
+		if (*link == device) {
+			*link = (*link)->next;
+			break;
+		}
+	}
+
+	if (media->image >= 0) {
+		close(media->image);
+	}
+	free(media->directory);
+	free(media);
+}
+
+static ShimMedia* ShimMediaFind(EFI_HANDLE device) {
+	ShimMedia *media;
+
+	for (media = shim_media; media; media = media->next) {
+		if (media == device) {
+			return media;
+		}
+	}
+	return NULL;
+}
+
+/* Backs LibOpenRoot(). Opening the volume is one firmware call. */
+EFI_FILE_HANDLE ShimMediaOpenRoot(EFI_HANDLE device) {
+	ShimMedia *media = ShimMediaFind(device);
+	ShimFile *root;
+
+	if (!media || !media->directory) {
+		return NULL;
+	}
+
+	shim_stats.file_calls++;
+	ShimMediaCall(&media->file_latency);
+	root = ShimFileCreate(media, strdup(media->directory));
+	return root ? &root->file : NULL;
+}
+
+/* Backs BS->HandleProtocol for the devices made here. */
+EFI_STATUS ShimMediaProtocol(EFI_HANDLE device, EFI_GUID *protocol, VOID **interface) {
+	ShimMedia *media = ShimMediaFind(device);
+
+	if (!media || media->image < 0) {
+		return EFI_UNSUPPORTED;
+	} else if (CompareGuid(protocol, &BlockIoProtocol) == 0) {
+		*interface = &media->block_io;
+	} else if (CompareGuid(protocol, &DiskIoProtocol) == 0) {
+		*interface = &media->disk_io;
+	} else {
+		return EFI_UNSUPPORTED;
+	}
+	return EFI_SUCCESS;
+}
+
+/* Backs LibLocateHandle(): every device with a file system, oldest first. */
+EFI_STATUS ShimMediaLocate(EFI_GUID *protocol, UINTN *count, EFI_HANDLE **handles) {
+	ShimMedia *media;
+	UINTN i = 0;
+
+	*count = 0;
+	*handles = NULL;
+	if (CompareGuid(protocol, &FileSystemProtocol) != 0) {
+		return EFI_NOT_FOUND;
+	}
+
+	for (media = shim_media; media; media = media->next) {
+		if (media->directory) {
+			i++;
+		}
+	}
+	if (i == 0) {
+		return EFI_NOT_FOUND;
+	}
+
+	*handles = AllocatePool(i * sizeof(EFI_HANDLE));
+	if (!*handles) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	*count = i;
+	for (media = shim_media; media; media = media->next) {
+		if (media->directory) {
+			(*handles)[--i] = media;
+		}
+	}
+	return EFI_SUCCESS;
+}
+
+/* Backs DevicePathFromHandle(). */
+EFI_DEVICE_PATH* ShimMediaDevicePath(EFI_HANDLE device) {
+	ShimMedia *media = ShimMediaFind(device);
+
+	return media ? &media->device_path.drive.Header : NULL;
+}
@@ -0,0 +1,684 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "shim.h"
+
+ShimStats shim_stats;
+
+EFI_SYSTEM_TABLE *ST;
+EFI_BOOT_SERVICES *BS;
+EFI_RUNTIME_SERVICES *RT;
+
+EFI_GUID LoadedImageProtocol = {0x5b1b31a1, 0x9562, 0x11d2, {0x8e, 0x3f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b}};
+EFI_GUID DevicePathProtocol = {0x09576e91, 0x6d3f, 0x11d2, {0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b}};
+EFI_GUID FileSystemProtocol = {0x964e5b22, 0x6459, 0x11d2, {0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b}};
+EFI_GUID BlockIoProtocol = {0x964e5b21, 0x6459, 0x11d2, {0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b}};
+EFI_GUID DiskIoProtocol = {0xce345171, 0xba0b, 0x11d2, {0x8e, 0x4f, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b}};
+EFI_GUID GenericFileInfo = {0x09576e92, 0x6d3f, 0x11d2, {0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b}};
+
+static BOOLEAN shim_verbose;
+
+#ifdef __APPLE__
+	#pragma mark - Memory services
+#endif
+/*
+ * Every pool block carries a small header recording its size, so that the
+ * live and peak byte counts stay exact across FreePool calls.
+ */
+typedef struct PoolHeader {
+	UINT64 size;
+	UINT64 pad;
+} PoolHeader;
+
+static VOID ShimAccount(UINT64 bytes) {
+	shim_stats.live_bytes += bytes;
+	if (shim_stats.live_bytes > shim_stats.peak_bytes) {
+		shim_stats.peak_bytes = shim_stats.live_bytes;
+	}
+}
+
+VOID *AllocatePool(UINTN Size) {
+	PoolHeader *header = malloc(sizeof(PoolHeader) + Size);
+	if (!header) {
+		return NULL;
+	}
+
+	header->size = Size;
+	shim_stats.pool_allocations++;
+	ShimAccount(Size);
+	return header + 1;
+}
+
+VOID *AllocateZeroPool(UINTN Size) {
+	VOID *p = AllocatePool(Size);
+	if (p) {
+		memset(p, 0, Size);
+	}
+	return p;
+}
+
+VOID *ReallocatePool(VOID *OldPool, UINTN OldSize, UINTN NewSize) {
+	VOID *p = AllocatePool(NewSize);
+	if (p && OldPool) {
+		memcpy(p, OldPool, OldSize < NewSize ? OldSize : NewSize);
+		FreePool(OldPool);
+	}
+	return p;
+}
+
+VOID FreePool(VOID *p) {
+	PoolHeader *header;
+
+	if (!p) {
+		return;
+	}
+
+	header = (PoolHeader *)p - 1;
+	shim_stats.pool_frees++;
+	shim_stats.live_bytes -= header->size;
+	free(header);
+}
+
+static EFI_STATUS EFIAPI ShimAllocatePool(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID **Buffer) {
+	*Buffer = AllocatePool(Size);
+	return *Buffer ? EFI_SUCCESS : EFI_OUT_OF_RESOURCES;
+}
+
+static EFI_STATUS EFIAPI ShimFreePool(VOID *Buffer) {
+	FreePool(Buffer);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimAllocatePages(EFI_ALLOCATE_TYPE Type, EFI_MEMORY_TYPE MemoryType,
+		UINTN NoPages, EFI_PHYSICAL_ADDRESS *Memory) {
+	VOID *p;
+
+	if (Type != AllocateAnyPages || NoPages == 0) {
+		return EFI_UNSUPPORTED;
+	}
+
+	if (posix_memalign(&p, EFI_PAGE_SIZE, NoPages * EFI_PAGE_SIZE) != 0) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	shim_stats.page_allocations++;
+	ShimAccount(NoPages * EFI_PAGE_SIZE);
+	*Memory = (EFI_PHYSICAL_ADDRESS)(UINTN)p;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimFreePages(EFI_PHYSICAL_ADDRESS Memory, UINTN NoPages) {
+	shim_stats.page_frees++;
+	shim_stats.live_bytes -= NoPages * EFI_PAGE_SIZE;
+	free((VOID *)(UINTN)Memory);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimStall(UINTN Microseconds) {
+	shim_stats.stall_microseconds += Microseconds;
+	return EFI_SUCCESS;
+}
+
+VOID ZeroMem(VOID *Buffer, UINTN Size) {
+	memset(Buffer, 0, Size);
+}
+
+VOID SetMem(VOID *Buffer, UINTN Size, UINT8 Value) {
+	memset(Buffer, Value, Size);
+}
+
+VOID CopyMem(VOID *Dest, VOID *Src, UINTN len) {
+	memmove(Dest, Src, len);
+}
+
+INTN CompareMem(VOID *Dest, VOID *Src, UINTN len) {
+	return memcmp(Dest, Src, len);
+}
+
+INTN CompareGuid(EFI_GUID *Guid1, EFI_GUID *Guid2) {
+	return memcmp(Guid1, Guid2, sizeof(EFI_GUID)) == 0 ? 0 : 1;
+}
+
+#ifdef __APPLE__
+	#pragma mark - String functions
+#endif
+UINTN StrLen(CHAR16 *s1) {
+	UINTN len = 0;
+	while (s1[len]) {
+		len++;
+	}
+	return len;
+}
+
+UINTN StrSize(CHAR16 *s1) {
+	return (StrLen(s1) + 1) * sizeof(CHAR16);
+}
+
+INTN StrCmp(CHAR16 *s1, CHAR16 *s2) {
+	while (*s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+	}
+	return *s1 - *s2;
+}
+
+INTN StrnCmp(CHAR16 *s1, CHAR16 *s2, UINTN len) {
+	while (len && *s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+		len--;
+	}
+	return len ? *s1 - *s2 : 0;
+}
+
+VOID StrCpy(CHAR16 *Dest, CHAR16 *Src) {
+	while ((*Dest++ = *Src++)) {
+	}
+}
+
+VOID StrnCpy(CHAR16 *Dest, CHAR16 *Src, UINTN Len) {
+	while (*Src && Len) {
+		*Dest++ = *Src++;
+		Len--;
+	}
+	*Dest = '\0';
+}
+
+VOID StrCat(CHAR16 *Dest, CHAR16 *Src) {
+	StrCpy(Dest + StrLen(Dest), Src);
+}
+
+CHAR16 *StrDuplicate(CHAR16 *Src) {
+	UINTN size = StrSize(Src);
+	CHAR16 *p = AllocatePool(size);
+	if (p) {
+		memcpy(p, Src, size);
+	}
+	return p;
+}
+
+UINTN Atoi(CHAR16 *str) {
+	UINTN value = 0;
+	while (*str == ' ' || *str == '\t') {
+		str++;
+	}
+	while (*str >= '0' && *str <= '9') {
+		value = value * 10 + (*str++ - '0');
+	}
+	return value;
+}
+
+UINTN strlena(CHAR8 *s1) {
+	return strlen((char *)s1);
+}
+
+UINTN strcmpa(CHAR8 *s1, CHAR8 *s2) {
+	while (*s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+	}
+	return *s1 - *s2;
+}
+
+UINTN strncmpa(CHAR8 *s1, CHAR8 *s2, UINTN len) {
+	while (len && *s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+		len--;
+	}
+	return len ? *s1 - *s2 : 0;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Formatted output
+#endif
+static UINTN ShimPutChar(CHAR16 *out, UINTN size, UINTN pos, CHAR16 c) {
+	if (pos + 1 < size) {
+		out[pos] = c;
+	}
+	return pos + 1;
+}
+
+static UINTN ShimPutNumber(CHAR16 *out, UINTN size, UINTN pos, UINT64 value, UINTN base,
+		BOOLEAN negative, UINTN width, CHAR16 pad) {
+	CHAR8 digits[24];
+	UINTN n = 0;
+
+	do {
+		digits[n++] = "0123456789abcdef"[value % base];
+		value /= base;
+	} while (value);
+
+	if (negative) {
+		digits[n++] = '-';
+	}
+
+	while (width > n) {
+		pos = ShimPutChar(out, size, pos, pad);
+		width--;
+	}
+
+	while (n) {
+		pos = ShimPutChar(out, size, pos, digits[--n]);
+	}
+	return pos;
+}
+
+/*
+ * A reduced version of GNU-EFI's formatter: enough of %s, %a, %c, %d, %u,
+ * %x, %r and the 'l' and width modifiers for Enterprise's own messages.
+ */
+static UINTN ShimVSPrint(CHAR16 *out, UINTN size, CHAR16 *fmt, va_list args) {
+	UINTN pos = 0;
+
+	for (; *fmt; fmt++) {
+		BOOLEAN is_long = FALSE;
+		UINTN width = 0;
+		CHAR16 pad = ' ';
+
+		if (*fmt != '%') {
+			pos = ShimPutChar(out, size, pos, *fmt);
+			continue;
+		}
+
+		fmt++;
+		if (*fmt == '0') {
+			pad = '0';
+			fmt++;
+		}
+		while (*fmt >= '0' && *fmt <= '9') {
+			width = width * 10 + (*fmt++ - '0');
+		}
+		if (*fmt == 'l') {
+			is_long = TRUE;
+			fmt++;
+		}
+
+		switch (*fmt) {
+			case 's': {
+				CHAR16 *s = va_arg(args, CHAR16 *);
+				while (s && *s) {
+					pos = ShimPutChar(out, size, pos, *s++);
+				}
+				break;
+			}
+			case 'a': {
+				CHAR8 *s = va_arg(args, CHAR8 *);
+				while (s && *s) {
+					pos = ShimPutChar(out, size, pos, *s++);
+				}
+				break;
+			}
+			case 'c':
+				pos = ShimPutChar(out, size, pos, (CHAR16)va_arg(args, UINTN));
+				break;
+			case 'd': {
+				INT64 v = is_long ? va_arg(args, INT64) : va_arg(args, INT32);
+				pos = ShimPutNumber(out, size, pos, v < 0 ? -v : v, 10, v < 0, width, pad);
+				break;
+			}
+			case 'u': {
+				UINT64 v = is_long ? va_arg(args, UINT64) : va_arg(args, UINT32);
+				pos = ShimPutNumber(out, size, pos, v, 10, FALSE, width, pad);
+				break;
+			}
+			case 'x':
+			case 'X': {
+				UINT64 v = is_long ? va_arg(args, UINT64) : va_arg(args, UINT32);
+				pos = ShimPutNumber(out, size, pos, v, 16, FALSE, width, pad);
+				break;
+			}
+			case 'r': {
+				EFI_STATUS status = va_arg(args, EFI_STATUS);
+				pos = ShimPutNumber(out, size, pos, status & ~MAX_BIT, 10, FALSE, 0, ' ');
+				break;
+			}
+			case '\0':
+				fmt--;
+				break;
+			default:
+				pos = ShimPutChar(out, size, pos, *fmt);
+				break;
+		}
+	}
+
+	if (size) {
+		out[pos < size ? pos : size - 1] = '\0';
+	}
+	return pos;
+}
+
+UINTN SPrint(CHAR16 *Str, UINTN StrSize, CHAR16 *fmt, ...) {
+	va_list args;
+	UINTN len;
+
+	va_start(args, fmt);
+	len = ShimVSPrint(Str, StrSize / sizeof(CHAR16), fmt, args);
+	va_end(args);
+	return len;
+}
+
+UINTN VSPrint(CHAR16 *Str, UINTN StrSize, CHAR16 *fmt, va_list args) {
+	return ShimVSPrint(Str, StrSize / sizeof(CHAR16), fmt, args);
+}
+
+/* Output is discarded unless ENTERPRISE_SHIM_VERBOSE is set, so that console
+ * cost does not pollute the measurements. */
+UINTN Print(CHAR16 *fmt, ...) {
+	CHAR16 buffer[512];
+	va_list args;
+	UINTN len, i;
+
+	shim_stats.print_calls++;
+	if (!shim_verbose) {
+		return 0;
+	}
+
+	va_start(args, fmt);
+	len = ShimVSPrint(buffer, sizeof(buffer) / sizeof(buffer[0]), fmt, args);
+	va_end(args);
+
+	for (i = 0; buffer[i]; i++) {
+		fputc(buffer[i] < 0x80 ? buffer[i] : '?', stdout);
+	}
+	return len;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Console
+#endif
+static EFI_STATUS EFIAPI ShimOutputString(SIMPLE_TEXT_OUTPUT_INTERFACE *This, CHAR16 *String) {
+	shim_stats.console_calls++;
+	if (shim_verbose) {
+		for (; *String; String++) {
+			fputc(*String < 0x80 ? *String : '?', stdout);
+		}
+	}
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimSetAttribute(SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN Attribute) {
+	shim_stats.console_calls++;
+	This->Mode->Attribute = Attribute;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimClearScreen(SIMPLE_TEXT_OUTPUT_INTERFACE *This) {
+	shim_stats.console_calls++;
+	This->Mode->CursorColumn = 0;
+	This->Mode->CursorRow = 0;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimSetCursorPosition(SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN Column, UINTN Row) {
+	shim_stats.console_calls++;
+	This->Mode->CursorColumn = Column;
+	This->Mode->CursorRow = Row;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimEnableCursor(SIMPLE_TEXT_OUTPUT_INTERFACE *This, BOOLEAN Enable) {
+	This->Mode->CursorVisible = Enable;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimQueryMode(SIMPLE_TEXT_OUTPUT_INTERFACE *This, UINTN ModeNumber,
+		UINTN *Columns, UINTN *Rows) {
+	*Columns = 80;
+	*Rows = 25;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimReadKeyStroke(SIMPLE_INPUT_INTERFACE *This, EFI_INPUT_KEY *Key) {
+	return EFI_NOT_READY;
+}
+
+static EFI_STATUS EFIAPI ShimInputReset(SIMPLE_INPUT_INTERFACE *This, BOOLEAN ExtendedVerification) {
+	return EFI_SUCCESS;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Variable services
+#endif
+/*
+ * Variables live in a simple list; this is only meant to make the loader's
+ * variable traffic countable, not to emulate NVRAM faithfully.
+ */
+typedef struct ShimVariable {
+	CHAR16 name[128];
+	EFI_GUID guid;
+	UINT32 attributes;
+	UINTN size;
+	UINT8 *data;
+	struct ShimVariable *next;
+} ShimVariable;
+
+static ShimVariable *shim_variables;
+
+static ShimVariable *ShimFindVariable(CHAR16 *name, EFI_GUID *guid) {
+	ShimVariable *v;
+
+	for (v = shim_variables; v; v = v->next) {
+		if (StrCmp(v->name, name) == 0 && memcmp(&v->guid, guid, sizeof(EFI_GUID)) == 0) {
+			return v;
+		}
+	}
+	return NULL;
+}
+
+static EFI_STATUS EFIAPI ShimGetVariable(CHAR16 *VariableName, EFI_GUID *VendorGuid, UINT32 *Attributes,
+		UINTN *DataSize, VOID *Data) {
+	ShimVariable *v = ShimFindVariable(VariableName, VendorGuid);
+
+	shim_stats.variable_reads++;
+	if (!v) {
+		return EFI_NOT_FOUND;
+	}
+
+	if (Attributes) {
+		*Attributes = v->attributes;
+	}
+
+	if (*DataSize < v->size) {
+		*DataSize = v->size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	*DataSize = v->size;
+	memcpy(Data, v->data, v->size);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimSetVariable(CHAR16 *VariableName, EFI_GUID *VendorGuid, UINT32 Attributes,
+		UINTN DataSize, VOID *Data) {
+	ShimVariable *v = ShimFindVariable(VariableName, VendorGuid);
+
+	shim_stats.variable_writes++;
+	if (StrLen(VariableName) >= sizeof(v->name) / sizeof(CHAR16)) {
+		return EFI_INVALID_PARAMETER;
+	}
+
+	if (DataSize == 0) {
+		ShimVariable **link;
+
+		if (!v) {
+			return EFI_NOT_FOUND;
+		}
+
+		for (link = &shim_variables; *link != v; link = &(*link)->next) {
+		}
+		*link = v->next;
+		free(v->data);
+		free(v);
+		return EFI_SUCCESS;
+	}
+
+	if (!v) {
+		v = calloc(1, sizeof(ShimVariable));
+		StrCpy(v->name, VariableName);
+		v->guid = *VendorGuid;
+		v->next = shim_variables;
+		shim_variables = v;
+	}
+
+	free(v->data);
+	v->data = malloc(DataSize);
+	memcpy(v->data, Data, DataSize);
+	v->size = DataSize;
+	v->attributes = Attributes;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI ShimResetSystem(EFI_RESET_TYPE ResetType, EFI_STATUS ResetStatus, UINTN DataSize,
+		CHAR16 *ResetData) {
+	exit(ResetType == EfiResetShutdown ? 0 : 1);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Library helpers
+#endif
+EFI_FILE_INFO *LibFileInfo(EFI_FILE_HANDLE FHand) {
+	EFI_FILE_INFO *info;
+	UINTN size = SIZE_OF_EFI_FILE_INFO + 256 * sizeof(CHAR16);
+	EFI_STATUS err;
+
+	info = AllocatePool(size);
+	err = uefi_call_wrapper(FHand->GetInfo, 4, FHand, &GenericFileInfo, &size, info);
+	if (err == EFI_BUFFER_TOO_SMALL) {
+		FreePool(info);
+		info = AllocatePool(size);
+		err = uefi_call_wrapper(FHand->GetInfo, 4, FHand, &GenericFileInfo, &size, info);
+	}
+
+	if (EFI_ERROR(err)) {
+		FreePool(info);
+		return NULL;
+	}
+	return info;
+}
+
+/* Only the simulated media in media.c have protocols to hand out. */
+static EFI_STATUS EFIAPI ShimHandleProtocol(EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface) {
+	return ShimMediaProtocol(Handle, Protocol, Interface);
+}
+
+EFI_FILE_HANDLE LibOpenRoot(EFI_HANDLE DeviceHandle) {
+	return ShimMediaOpenRoot(DeviceHandle);
+}
+
+EFI_STATUS LibLocateProtocol(EFI_GUID *ProtocolGuid, VOID **Interface) {
+	return EFI_NOT_FOUND;
+}
+
+EFI_STATUS LibLocateHandle(EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol, VOID *SearchKey,
+		UINTN *NoHandles, EFI_HANDLE **Buffer) {
+	if (SearchType != ByProtocol) {
+		*NoHandles = 0;
+		*Buffer = NULL;
+		return EFI_NOT_FOUND;
+	}
+	return ShimMediaLocate(Protocol, NoHandles, Buffer);
+}
+
+EFI_DEVICE_PATH *FileDevicePath(EFI_HANDLE Device, CHAR16 *FileName) {
+	return NULL;
+}
+
+EFI_DEVICE_PATH *DevicePathFromHandle(EFI_HANDLE Handle) {
+	return ShimMediaDevicePath(Handle);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Setup
+#endif
+static SIMPLE_TEXT_OUTPUT_MODE shim_console_mode = { 1, 0, EFI_LIGHTGRAY, 0, 0, FALSE };
+
+static SIMPLE_TEXT_OUTPUT_INTERFACE shim_console_out = {
+	.OutputString = ShimOutputString,
+	.QueryMode = ShimQueryMode,
+	.SetAttribute = ShimSetAttribute,
+	.ClearScreen = ShimClearScreen,
+	.SetCursorPosition = ShimSetCursorPosition,
+	.EnableCursor = ShimEnableCursor,
+	.Mode = &shim_console_mode,
+};
+
+static SIMPLE_INPUT_INTERFACE shim_console_in = {
+	.Reset = ShimInputReset,
+	.ReadKeyStroke = ShimReadKeyStroke,
+};
+
+static EFI_BOOT_SERVICES shim_boot_services = {
+	.AllocatePages = ShimAllocatePages,
+	.FreePages = ShimFreePages,
+	.AllocatePool = ShimAllocatePool,
+	.FreePool = ShimFreePool,
+	.Stall = ShimStall,
+	.HandleProtocol = ShimHandleProtocol,
+};
+
+static EFI_RUNTIME_SERVICES shim_runtime_services = {
+	.GetVariable = ShimGetVariable,
+	.SetVariable = ShimSetVariable,
+	.ResetSystem = ShimResetSystem,
+};
+
+static EFI_SYSTEM_TABLE shim_system_table = {
+	.ConIn = &shim_console_in,
+	.ConOut = &shim_console_out,
+	.StdErr = &shim_console_out,
+	.RuntimeServices = &shim_runtime_services,
+	.BootServices = &shim_boot_services,
+};
+
+VOID InitializeLib(EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable) {
+	ST = SystemTable;
+	BS = SystemTable->BootServices;
+	RT = SystemTable->RuntimeServices;
+}
+
+VOID ShimInitialize(VOID) {
+	shim_verbose = getenv("ENTERPRISE_SHIM_VERBOSE") != NULL;
+	InitializeLib(NULL, &shim_system_table);
+	ShimResetStats();
+}
+
+VOID ShimResetStats(VOID) {
+	UINT64 live = shim_stats.live_bytes;
+
+	memset(&shim_stats, 0, sizeof(shim_stats));
+	shim_stats.live_bytes = live;
+	shim_stats.peak_bytes = live;
+}
+
+UINT64 ShimNanoseconds(VOID) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UINT64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,77 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _shim_h
+#define _shim_h
+
+/*
+ * Counters kept by the host implementation of the firmware services. The
+ * benchmark resets them before each run and reads them afterwards.
+ */
+typedef struct ShimStats {
+	UINT64 pool_allocations;
+	UINT64 pool_frees;
+	UINT64 page_allocations;
+	UINT64 page_frees;
+	UINT64 live_bytes;
+	UINT64 peak_bytes;
+	UINT64 print_calls;
+	UINT64 console_calls;
+	UINT64 variable_reads;
+	UINT64 variable_writes;
+	UINT64 stall_microseconds;
+	UINT64 file_calls;
+	UINT64 disk_calls;
+	UINT64 media_bytes;
+	UINT64 media_seeks;
+	UINT64 media_nanoseconds;
+} ShimStats;
+
+/*
+ * What a simulated storage access costs. Every call costs call_ns. Data
+ * moves in transfers of at most transfer_size bytes, each costing
+ * transfer_ns, plus byte_ns per byte. A read that does not start where the
+ * previous one on the device ended costs seek_ns more. Nothing sleeps: the
+ * cost is added to shim_stats.media_nanoseconds, so runs are repeatable.
+ */
+typedef struct ShimLatency {
+	UINT64 call_ns;
+	UINT64 seek_ns;
+	UINT64 transfer_ns;
+	UINTN transfer_size;
+	double byte_ns;
+} ShimLatency;
+
+extern ShimStats shim_stats;
+extern const ShimLatency shim_latency_apple_fat;
+extern const ShimLatency shim_latency_usb_disk;
+
+VOID ShimInitialize(VOID);
+VOID ShimResetStats(VOID);
+UINT64 ShimNanoseconds(VOID);
+
+EFI_HANDLE ShimMediaCreate(const char *directory, const char *image, const ShimLatency *file_latency,
+	const ShimLatency *disk_latency);
+VOID ShimMediaDestroy(EFI_HANDLE device);
+EFI_FILE_HANDLE ShimMediaOpenRoot(EFI_HANDLE device);
+EFI_STATUS ShimMediaProtocol(EFI_HANDLE device, EFI_GUID *protocol, VOID **interface);
+EFI_STATUS ShimMediaLocate(EFI_GUID *protocol, UINTN *count, EFI_HANDLE **handles);
+EFI_DEVICE_PATH* ShimMediaDevicePath(EFI_HANDLE device);
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "arena.h"
+#include "config.h"
+#include "utils.h"
+#include "distribution.h"
+#include "log.h"
+
+static CHAR8 *configuration_key_names[] = {
+	[ConfigurationKeyEntry] = (CHAR8 *)"entry",
+	[ConfigurationKeyFamily] = (CHAR8 *)"family",
+	[ConfigurationKeyKernel] = (CHAR8 *)"kernel",
+	[ConfigurationKeyInitRD] = (CHAR8 *)"initrd",
+	[ConfigurationKeyRoot] = (CHAR8 *)"root",
+	[ConfigurationKeyTimeout] = (CHAR8 *)"timeout",
+	[ConfigurationKeyHeadless] = (CHAR8 *)"headless",
+	[ConfigurationKeyDiscover] = (CHAR8 *)"discover",
+};
+
+ConfigurationKey ConfigurationKeyForName(CHAR8 *key) {
+	ConfigurationKey candidate;
+
+	/*
+	 * Every supported key starts with a different letter, so the first
+	 * character is a perfect hash: it picks the only possible match and a
+	 * single comparison confirms it.
+	 */
+	switch (key[0]) {
+		case 'e':
+			candidate = ConfigurationKeyEntry;
+			break;
+		case 'f':
+			candidate = ConfigurationKeyFamily;
+			break;
+		case 'k':
+			candidate = ConfigurationKeyKernel;
+			break;
+		case 'i':
+			candidate = ConfigurationKeyInitRD;
+			break;
+		case 'r':
+			candidate = ConfigurationKeyRoot;
+			break;
+		case 't':
+			candidate = ConfigurationKeyTimeout;
+			break;
+		case 'h':
+			candidate = ConfigurationKeyHeadless;
+			break;
+		case 'd':
+			candidate = ConfigurationKeyDiscover;
+			break;
+		default:
+			return ConfigurationKeyUnknown;
+	}
+
+	if (strcmpa(configuration_key_names[candidate], key) != 0) {
+		return ConfigurationKeyUnknown;
+	}
+	return candidate;
+}
+
+/*
+ * Reads a non-negative decimal number. Returns FALSE if the string holds
+ * anything else.
+ */
+static BOOLEAN ParseNumber(CHAR8 *value, UINTN *number) {
+	UINTN result = 0;
+
+	if (!value[0]) {
+		return FALSE;
+	}
+	for (; *value; value++) {
+		if (*value < '0' || *value > '9') {
+			return FALSE;
+		}
+		result = result * 10 + (*value - '0');
+	}
+
+	*number = result;
+	return TRUE;
+}
+
+/*
+ * Reads "true", "yes" or "1", or "false", "no" or "0".
+ */
+static BOOLEAN ParseBoolean(CHAR8 *value, BOOLEAN *result) {
+	if (strcmpa(value, (CHAR8 *)"true") == 0 || strcmpa(value, (CHAR8 *)"yes") == 0 ||
+			strcmpa(value, (CHAR8 *)"1") == 0) {
+		*result = TRUE;
+	} else if (strcmpa(value, (CHAR8 *)"false") == 0 || strcmpa(value, (CHAR8 *)"no") == 0 ||
+			strcmpa(value, (CHAR8 *)"0") == 0) {
+		*result = FALSE;
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Makes room for one more entry. The table doubles in size each time it
+ * fills up; the old copy stays behind in the arena, which costs at most as
+ * much memory again as the final table.
+ */
+LinuxBootOption* AddBootEntry(BootEntryTable *table, MemoryArena *arena) {
+	if (table->count == table->capacity) {
+		UINTN capacity = table->capacity ? table->capacity * 2 : 16;
+		LinuxBootOption *entries = ArenaAllocate(arena, capacity * sizeof(LinuxBootOption));
+		if (!entries) {
+			return NULL;
+		}
+		if (table->count) {
+			CopyMem(entries, table->entries, table->count * sizeof(LinuxBootOption));
+		}
+		table->entries = entries;
+		table->capacity = capacity;
+	}
+
+	ZeroMem(&table->entries[table->count], sizeof(LinuxBootOption));
+	return &table->entries[table->count++];
+}
+
+/*
+ * Fills the table with the boot entries described by the configuration file.
+ * The table is carved out of the given arena, and the strings point into the
+ * contents buffer, so both must outlive it. Global settings are stored in
+ * settings, if it is given.
+ */
+EFI_STATUS ParseConfiguration(CHAR8 *contents, MemoryArena *arena, ConfigurationSettings *settings,
+		BootEntryTable *table) {
+	LinuxBootOption *option = NULL; // The entry that the following keys describe.
+
+	UINTN position = 0;
+	CHAR8 *key, *value, *distribution, *boot_folder;
+	ZeroMem(table, sizeof(BootEntryTable));
+	while ((GetConfigurationKeyAndValue(contents, &position, &key, &value))) {
+		ConfigurationKey config_key = ConfigurationKeyForName(key);
+
+		/*
+		 * We require the user to specify an entry, followed by the file name and
+		 * any information required to boot the Linux distribution.
+		 */
+		if (config_key == ConfigurationKeyEntry) {
+			option = AddBootEntry(table, arena);
+			if (!option) {
+				return EFI_OUT_OF_RESOURCES;
+			}
+			option->name = value;
+			continue;
+		}
+
+		if (config_key == ConfigurationKeyTimeout) {
+			UINTN timeout;
+			if (!ParseNumber(value, &timeout)) {
+				LogWarning(LogTagConfig, L"Invalid timeout: %a.\n", value);
+			} else if (settings) {
+				settings->timeout = timeout;
+			}
+			continue;
+		} else if (config_key == ConfigurationKeyHeadless) {
+			BOOLEAN headless;
+			if (!ParseBoolean(value, &headless)) {
+				LogWarning(LogTagConfig, L"Invalid value for headless: %a.\n", value);
+			} else if (settings) {
+				settings->headless = headless;
+			}
+			continue;
+		} else if (config_key == ConfigurationKeyDiscover) {
+			if (settings) {
+				settings->discover = value;
+			}
+			continue;
+		}
+
+		if (config_key == ConfigurationKeyUnknown) {
+			LogWarning(LogTagConfig, L"Unrecognized configuration option: %a.\n", key);
+			continue;
+		} else if (!option) {
+			LogWarning(LogTagConfig, L"Configuration option %a appears before any entry.\n", key);
+			continue;
+		}
+
+		switch (config_key) {
+			// The user has given us a distribution family.
+			case ConfigurationKeyFamily:
+				distribution = value;
+				option->distro_family = value;
+				option->kernel_path = KernelLocationForDistributionName(distribution, &boot_folder);
+				option->initrd_path = InitRDLocationForDistributionName(distribution);
+				option->boot_folder = boot_folder;
+				// If either of the paths are a blank string, then you've got an
+				// unsupported distribution or a typo of the distribution name.
+				if (option->kernel_path[0] == '\0' || option->initrd_path[0] == '\0') {
+					LogError(LogTagConfig, L"Distribution family %a is not supported.\n", value);
+					return EFI_UNSUPPORTED;
+				}
+				break;
+			// The user is manually specifying information; override any previous values.
+			case ConfigurationKeyKernel:
+				option->kernel_path = value;
+				break;
+			case ConfigurationKeyInitRD:
+				option->initrd_path = value;
+				break;
+			case ConfigurationKeyRoot:
+				option->boot_folder = value;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return table->count ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
@@ -0,0 +1,50 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _config_h
+#define _config_h
+
+typedef enum ConfigurationKey {
+	ConfigurationKeyUnknown,
+	ConfigurationKeyEntry,
+	ConfigurationKeyFamily,
+	ConfigurationKeyKernel,
+	ConfigurationKeyInitRD,
+	ConfigurationKeyRoot,
+	ConfigurationKeyTimeout,
+	ConfigurationKeyHeadless,
+	ConfigurationKeyDiscover,
+} ConfigurationKey;
+
+/*
+ * Settings that apply to the whole stick rather than to one entry. They may
+ * appear anywhere in the file, including before the first entry.
+ */
+typedef struct ConfigurationSettings {
+	UINTN timeout; // Seconds before the last selection boots by itself; 0 waits forever.
+	BOOLEAN headless; // Boot the last selection without showing anything or waiting.
+	CHAR8 *discover; // Directory to look for ISO files in on every volume, or NULL.
+} ConfigurationSettings;
+
+ConfigurationKey ConfigurationKeyForName(CHAR8 *key);
+LinuxBootOption* AddBootEntry(BootEntryTable *table, MemoryArena *arena);
+EFI_STATUS ParseConfiguration(CHAR8 *contents, MemoryArena *arena, ConfigurationSettings *settings,
+	BootEntryTable *table);
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Conversion between the UTF-8 in our configuration files and variables and
+ * the UTF-16 the firmware speaks. Nearly everything we convert is plain
+ * ASCII, so that case is done sixteen characters at a time with SSE2, which
+ * every x86_64 processor has. Malformed input becomes U+FFFD.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "convert.h"
+
+#if defined(__x86_64__)
+	#include <emmintrin.h>
+	#define CONVERT_HAVE_SSE2
+#endif
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+/*
+ * Decodes one multi-byte sequence of at most available bytes. Returns the
+ * number of bytes consumed, which is at least one; a sequence cut short by
+ * a byte that is not a continuation (including the terminator) stops there.
+ */
+static UINTN Utf8Decode(UINT8 *in, UINTN available, UINT32 *code_point) {
+	UINT32 c, minimum;
+	UINTN length, i;
+
+	if ((in[0] & 0xe0) == 0xc0) {
+		length = 2;
+		c = in[0] & 0x1f;
+		minimum = 0x80;
+	} else if ((in[0] & 0xf0) == 0xe0) {
+		length = 3;
+		c = in[0] & 0x0f;
+		minimum = 0x800;
+	} else if ((in[0] & 0xf8) == 0xf0) {
+		length = 4;
+		c = in[0] & 0x07;
+		minimum = 0x10000;
+	} else {
+		*code_point = REPLACEMENT_CHARACTER;
+		return 1;
+	}
+
+	for (i = 1; i < length; i++) {
+		if (i >= available || (in[i] & 0xc0) != 0x80) {
+			*code_point = REPLACEMENT_CHARACTER;
+			return i;
+		}
+		c = (c << 6) | (in[i] & 0x3f);
+	}
+
+	// Overlong forms, UTF-16 surrogates and values past U+10FFFF are invalid.
+	if (c < minimum || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+		c = REPLACEMENT_CHARACTER;
+	}
+	*code_point = c;
+	return length;
+}
+
+/* The length of the string, up to the terminator or limit, whichever is first. */
+static UINTN Utf8Length(UINT8 *in, UINTN limit) {
+	UINTN length = 0;
+
+	while (length < limit && in[length] != '\0') {
+		length++;
+	}
+	return length;
+}
+
+static UINTN Utf16Length(CHAR16 *in, UINTN limit) {
+	UINTN length = 0;
+
+	while (length < limit && in[length] != '\0') {
+		length++;
+	}
+	return length;
+}
+
+/*
+ * Converts at most in_length bytes of UTF-8, stopping early at a NUL, into
+ * out, which holds out_capacity characters including the terminator that is
+ * always written. Returns the number of UTF-16 units stored.
+ */
+UINTN Utf8ToUtf16(CHAR8 *in, UINTN in_length, CHAR16 *out, UINTN out_capacity) {
+	UINT8 *bytes = (UINT8 *)in;
+	UINTN i = 0, o = 0, scalar_until = 0;
+
+	if (out_capacity == 0) {
+		return 0;
+	}
+	out_capacity--;
+
+	// Callers may pass the size of a buffer rather than of the string in it,
+	// and the loads below must not run on past the terminator.
+	in_length = Utf8Length(bytes, in_length);
+
+	while (i < in_length) {
+		UINT32 c;
+
+#ifdef CONVERT_HAVE_SSE2
+		// Sixteen ASCII bytes at once; non-ASCII bytes have their top bit set.
+		if (i >= scalar_until && in_length - i >= 16 && out_capacity - o >= 16) {
+			__m128i chunk = _mm_loadu_si128((__m128i *)(bytes + i));
+			__m128i zero = _mm_setzero_si128();
+			UINT32 mask = _mm_movemask_epi8(chunk);
+
+			if (mask == 0) {
+				_mm_storeu_si128((__m128i *)(out + o), _mm_unpacklo_epi8(chunk, zero));
+				_mm_storeu_si128((__m128i *)(out + o + 8), _mm_unpackhi_epi8(chunk, zero));
+				i += 16;
+				o += 16;
+				continue;
+			}
+			scalar_until = i + __builtin_ctz(mask) + 1;
+		}
+#endif
+
+		if (bytes[i] < 0x80) {
+			if (o >= out_capacity) {
+				break;
+			}
+			out[o++] = bytes[i++];
+			continue;
+		}
+
+		i += Utf8Decode(bytes + i, in_length - i, &c);
+		if (c >= 0x10000) {
+			if (out_capacity - o < 2) {
+				break;
+			}
+			c -= 0x10000;
+			out[o++] = 0xD800 + (c >> 10);
+			out[o++] = 0xDC00 + (c & 0x3FF);
+		} else {
+			if (o >= out_capacity) {
+				break;
+			}
+			out[o++] = c;
+		}
+	}
+
+	out[o] = '\0';
+	return o;
+}
+
+/*
+ * Converts at most in_length units of UTF-16, stopping early at a NUL, into
+ * out, which holds out_capacity bytes including the terminator that is
+ * always written. Returns the number of bytes stored. Characters that do
+ * not fit whole are left out.
+ */
+UINTN Utf16ToUtf8(CHAR16 *in, UINTN in_length, CHAR8 *out, UINTN out_capacity) {
+	UINT8 *bytes = (UINT8 *)out;
+	UINTN i = 0, o = 0;
+
+	if (out_capacity == 0) {
+		return 0;
+	}
+	out_capacity--;
+
+	in_length = Utf16Length(in, in_length);
+
+	while (i < in_length) {
+		UINT32 c;
+		UINTN length;
+
+#ifdef CONVERT_HAVE_SSE2
+		// Packing with unsigned saturation turns anything above 0xFF into
+		// 0xFF and anything from 0x8000 up into zero, so one mask test
+		// catches every unit that is not ASCII.
+		if (in_length - i >= 16 && out_capacity - o >= 16) {
+			__m128i low = _mm_loadu_si128((__m128i *)(in + i));
+			__m128i high = _mm_loadu_si128((__m128i *)(in + i + 8));
+			__m128i packed = _mm_packus_epi16(low, high);
+			__m128i zero = _mm_setzero_si128();
+
+			if (_mm_movemask_epi8(_mm_or_si128(packed, _mm_cmpeq_epi8(packed, zero))) == 0) {
+				_mm_storeu_si128((__m128i *)(bytes + o), packed);
+				i += 16;
+				o += 16;
+				continue;
+			}
+		}
+#endif
+
+		c = in[i++];
+		if (c < 0x80) {
+			if (o >= out_capacity) {
+				break;
+			}
+			bytes[o++] = c;
+			continue;
+		}
+
+		if (c >= 0xD800 && c <= 0xDBFF && i < in_length && in[i] >= 0xDC00 && in[i] <= 0xDFFF) {
+			c = 0x10000 + ((c - 0xD800) << 10) + (in[i++] - 0xDC00);
+		} else if (c >= 0xD800 && c <= 0xDFFF) {
+			c = REPLACEMENT_CHARACTER;
+		}
+
+		length = c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+		if (out_capacity - o < length) {
+			break;
+		}
+
+		switch (length) {
+			case 2:
+				bytes[o++] = 0xC0 | (c >> 6);
+				bytes[o++] = 0x80 | (c & 0x3F);
+				break;
+			case 3:
+				bytes[o++] = 0xE0 | (c >> 12);
+				bytes[o++] = 0x80 | ((c >> 6) & 0x3F);
+				bytes[o++] = 0x80 | (c & 0x3F);
+				break;
+			default:
+				bytes[o++] = 0xF0 | (c >> 18);
+				bytes[o++] = 0x80 | ((c >> 12) & 0x3F);
+				bytes[o++] = 0x80 | ((c >> 6) & 0x3F);
+				bytes[o++] = 0x80 | (c & 0x3F);
+				break;
+		}
+	}
+
+	bytes[o] = '\0';
+	return o;
+}
+
+/*
+ * Allocating forms of the above, sized for the worst case so that a single
+ * allocation always suffices. With no arena the caller frees the result.
+ */
+CHAR16* ASCIItoUTF16(CHAR8 *InString, UINTN InLength, MemoryArena *arena) {
+	CHAR16 *str;
+
+	str = ArenaAllocate(arena, UTF16_CAPACITY_FOR_UTF8(InLength) * sizeof(CHAR16));
+	if (str) {
+		Utf8ToUtf16(InString, InLength, str, UTF16_CAPACITY_FOR_UTF8(InLength));
+	}
+	return str;
+}
+
+CHAR8* UTF16toASCII(CHAR16 *InString, UINTN InLength, MemoryArena *arena) {
+	CHAR8 *str;
+
+	str = ArenaAllocate(arena, UTF8_CAPACITY_FOR_UTF16(InLength));
+	if (str) {
+		Utf16ToUtf8(InString, InLength, str, UTF8_CAPACITY_FOR_UTF16(InLength));
+	}
+	return str;
+}
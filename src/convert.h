@@ -0,0 +1,37 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _convert_h
+#define _convert_h
+
+/*
+ * Worst-case output sizes, in characters and including the terminator, for
+ * an input of the given length. A UTF-8 byte never becomes more than one
+ * UTF-16 unit, and a UTF-16 unit never becomes more than three UTF-8 bytes.
+ */
+#define UTF16_CAPACITY_FOR_UTF8(length) ((length) + 1)
+#define UTF8_CAPACITY_FOR_UTF16(length) ((length) * 3 + 1)
+
+UINTN Utf8ToUtf16(CHAR8 *in, UINTN in_length, CHAR16 *out, UINTN out_capacity);
+UINTN Utf16ToUtf8(CHAR16 *in, UINTN in_length, CHAR8 *out, UINTN out_capacity);
+
+CHAR16* ASCIItoUTF16(CHAR8 *InString, UINTN InLength, MemoryArena *arena);
+CHAR8* UTF16toASCII(CHAR16 *InString, UINTN InLength, MemoryArena *arena);
+
+#endif
@@ -0,0 +1,521 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Finds ISO files in one directory on every volume the firmware can read,
+ * and offers each that holds a distribution we know how to boot as a menu
+ * entry. Listing the directories is cheap; opening each image to see what
+ * is inside is not, so what was found is remembered in a variable, and a
+ * file whose name, size and modification time are the same at the next
+ * boot is taken to be what it was then.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "arena.h"
+#include "config.h"
+#include "utils.h"
+#include "convert.h"
+#include "distribution.h"
+#include "sha256.h"
+#include "iso9660.h"
+#include "discovery.h"
+#include "log.h"
+
+// The families an ISO file is tried as, in order; the index stores each as
+// its position here plus one. Mint is found, and booted, as Ubuntu.
+static CHAR8 *discovery_families[] = { (CHAR8 *)"Ubuntu", (CHAR8 *)"Debian" };
+#define DISCOVERY_FAMILY_COUNT (sizeof(discovery_families) / sizeof(discovery_families[0]))
+
+typedef struct DiscoveryScan {
+	CHAR16 *directory; // With a leading separator and none at the end; empty for the root.
+	UINT8 *previous; // The index written at the last boot, or NULL.
+	UINT8 *index; // The index being built, DISCOVERY_INDEX_SIZE bytes.
+	UINTN index_size;
+	DiscoveryVolume *volume; // Where the volume being scanned is kept in index, or NULL.
+	DiscoveryFile *remembered; // Its files in previous, and how many there are.
+	UINTN remembered_count;
+	EFI_HANDLE own_device;
+	MemoryArena *arena;
+	BootEntryTable *table;
+	UINTN found;
+	UINTN opened;
+} DiscoveryScan;
+
+#ifdef __APPLE__
+	#pragma mark - Names
+#endif
+static CHAR16 DiscoveryLower(CHAR16 c) {
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/* Compares length characters of a and b, ignoring ASCII case. */
+static BOOLEAN DiscoveryNamesMatch(CHAR16 *a, CHAR16 *b, UINTN length) {
+	UINTN i;
+
+	for (i = 0; i < length; i++) {
+		if (DiscoveryLower(a[i]) != DiscoveryLower(b[i])) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Turns the directory from the configuration file into a firmware path:
+ * either separator may be used there, and a leading one is optional.
+ */
+static CHAR16* DiscoveryDirectory(CHAR8 *directory, MemoryArena *arena) {
+	CHAR16 *converted, *path, *in, *out;
+
+	converted = ASCIItoUTF16(directory, strlena(directory), arena);
+	if (!converted) {
+		return NULL;
+	}
+	path = ArenaAllocate(arena, (StrLen(converted) + 2) * sizeof(CHAR16));
+	if (!path) {
+		return NULL;
+	}
+
+	out = path;
+	for (in = converted; *in; ) {
+		if (*in == '/' || *in == '\\') {
+			in++;
+			continue;
+		}
+		*out++ = '\\';
+		while (*in && *in != '/' && *in != '\\') {
+			*out++ = *in++;
+		}
+	}
+	*out = '\0';
+	return path;
+}
+
+/* FNV-1a of the directory, folded to lower case like the file system does. */
+static UINT32 DiscoveryDirectoryHash(CHAR16 *directory) {
+	UINT32 hash = 2166136261u;
+
+	for (; *directory; directory++) {
+		hash = (hash ^ DiscoveryLower(*directory)) * 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * Whether a directory entry could be an image to boot. The live system is
+ * given the file's path on its command line, which has no way to quote a
+ * space, so a name with one could not be found again after the kernel starts.
+ */
+static BOOLEAN DiscoveryIsCandidate(DiscoveryScan *scan, EFI_HANDLE device, EFI_FILE_INFO *info,
+		UINTN name_length) {
+	UINTN i;
+
+	if ((info->Attribute & EFI_FILE_DIRECTORY) || name_length <= 4 || name_length > 0xFF ||
+			!DiscoveryNamesMatch(info->FileName + name_length - 4, L".iso", 4)) {
+		return FALSE;
+	}
+	for (i = 0; i < name_length; i++) {
+		if (info->FileName[i] == ' ') {
+			return FALSE;
+		}
+	}
+
+	// Our own boot.iso is already in the menu, as every configured entry.
+	if (device == scan->own_device && StrLen(scan->directory) == 9 &&
+			DiscoveryNamesMatch(scan->directory, L"\\efi\\boot", 9) && name_length == 8 &&
+			DiscoveryNamesMatch(info->FileName, L"boot.iso", 8)) {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Index
+#endif
+/* Checks that every volume and file in the index lies within it. */
+static BOOLEAN DiscoveryIndexValid(UINT8 *index, UINTN size, UINT32 directory) {
+	DiscoveryHeader *header = (DiscoveryHeader *)index;
+	UINTN offset = sizeof(DiscoveryHeader), volume, file;
+
+	if (size < sizeof(DiscoveryHeader) || header->signature != DISCOVERY_SIGNATURE ||
+			header->version != DISCOVERY_VERSION || header->size != size || header->directory != directory) {
+		return FALSE;
+	}
+
+	for (volume = 0; volume < header->volume_count; volume++) {
+		DiscoveryVolume *entry = (DiscoveryVolume *)(index + offset);
+
+		if (size - offset < sizeof(DiscoveryVolume)) {
+			return FALSE;
+		}
+		offset += sizeof(DiscoveryVolume);
+
+		for (file = 0; file < entry->file_count; file++) {
+			DiscoveryFile *record = (DiscoveryFile *)(index + offset);
+
+			if (size - offset < sizeof(DiscoveryFile) ||
+					size - offset - sizeof(DiscoveryFile) < record->name_length * sizeof(CHAR16)) {
+				return FALSE;
+			}
+			offset += sizeof(DiscoveryFile) + record->name_length * sizeof(CHAR16);
+		}
+	}
+	return offset == size;
+}
+
+/* Points scan at what the previous index knew about the volume, if anything. */
+static VOID DiscoveryFindVolume(DiscoveryScan *scan, EFI_GUID *id) {
+	DiscoveryHeader *header = (DiscoveryHeader *)scan->previous;
+	UINTN offset = sizeof(DiscoveryHeader), volume, file;
+
+	if (!header) {
+		return;
+	}
+
+	for (volume = 0; volume < header->volume_count; volume++) {
+		DiscoveryVolume *entry = (DiscoveryVolume *)(scan->previous + offset);
+
+		offset += sizeof(DiscoveryVolume);
+		if (CompareMem(&entry->id, id, sizeof(EFI_GUID)) == 0) {
+			scan->remembered = (DiscoveryFile *)(scan->previous + offset);
+			scan->remembered_count = entry->file_count;
+			return;
+		}
+		for (file = 0; file < entry->file_count; file++) {
+			DiscoveryFile *record = (DiscoveryFile *)(scan->previous + offset);
+			offset += sizeof(DiscoveryFile) + record->name_length * sizeof(CHAR16);
+		}
+	}
+}
+
+/*
+ * Compares the parts of two times that say when a file was written. The
+ * padding bytes and the time zone are left out: firmware does not always
+ * fill them in the same way twice.
+ */
+static BOOLEAN DiscoverySameTime(EFI_TIME *a, EFI_TIME *b) {
+	return a->Year == b->Year && a->Month == b->Month && a->Day == b->Day && a->Hour == b->Hour &&
+		a->Minute == b->Minute && a->Second == b->Second && a->Nanosecond == b->Nanosecond;
+}
+
+/* Returns the family the file was found to be last time, or -1 if it is new or has changed. */
+static INTN DiscoveryRemembered(DiscoveryScan *scan, EFI_FILE_INFO *info, UINTN name_length) {
+	UINT8 *position = (UINT8 *)scan->remembered;
+	EFI_TIME time;
+	UINTN i;
+
+	for (i = 0; i < scan->remembered_count; i++) {
+		DiscoveryFile *record = (DiscoveryFile *)position;
+
+		// The record is packed, so its time is copied out before it is read.
+		CopyMem(&time, &record->modification_time, sizeof(EFI_TIME));
+		if (record->name_length == name_length && record->size == info->FileSize &&
+				DiscoverySameTime(&time, &info->ModificationTime) &&
+				CompareMem(record + 1, info->FileName, name_length * sizeof(CHAR16)) == 0) {
+			return record->family;
+		}
+		position += sizeof(DiscoveryFile) + record->name_length * sizeof(CHAR16);
+	}
+	return -1;
+}
+
+/* Adds the file to the new index, if the volume is kept there and it still has room. */
+static VOID DiscoveryRemember(DiscoveryScan *scan, EFI_FILE_INFO *info, UINTN name_length, UINT8 family) {
+	UINTN size = sizeof(DiscoveryFile) + name_length * sizeof(CHAR16);
+	DiscoveryFile *record;
+
+	if (!scan->volume || scan->index_size + size > DISCOVERY_INDEX_SIZE) {
+		return;
+	}
+
+	record = (DiscoveryFile *)(scan->index + scan->index_size);
+	record->size = info->FileSize;
+	CopyMem(&record->modification_time, &info->ModificationTime, sizeof(EFI_TIME));
+	record->family = family;
+	record->name_length = name_length;
+	CopyMem(record + 1, info->FileName, name_length * sizeof(CHAR16));
+	scan->index_size += size;
+	scan->volume->file_count++;
+}
+
+/*
+ * Names the volume for the index. A GPT partition has a GUID of its own;
+ * anything else is known by a digest of its device path, which stays the
+ * same for as long as the stick stays in the same port.
+ */
+static BOOLEAN DiscoveryVolumeId(EFI_HANDLE device, EFI_GUID *id) {
+	EFI_DEVICE_PATH *path = DevicePathFromHandle(device), *node;
+	UINT8 digest[SHA256_DIGEST_SIZE];
+
+	if (!path) {
+		return FALSE;
+	}
+
+	for (node = path; !IsDevicePathEnd(node); node = NextDevicePathNode(node)) {
+		HARDDRIVE_DEVICE_PATH *hard_drive = (HARDDRIVE_DEVICE_PATH *)node;
+
+		if (DevicePathType(node) == MEDIA_DEVICE_PATH && DevicePathSubType(node) == MEDIA_HARDDRIVE_DP &&
+				hard_drive->SignatureType == SIGNATURE_TYPE_GUID) {
+			CopyMem(id, hard_drive->Signature, sizeof(EFI_GUID));
+			return TRUE;
+		}
+	}
+
+	Sha256Digest(path, (UINT8 *)node - (UINT8 *)path, digest);
+	CopyMem(id, digest, sizeof(EFI_GUID));
+	return TRUE;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Scanning
+#endif
+/*
+ * Opens the image and looks for the kernel of each family we know. Returns
+ * its family, 0 for an image that is not one we can boot, or -1 if it could
+ * not be read, in which case it is tried again next time.
+ */
+static INTN DiscoveryProbe(DiscoveryScan *scan, EFI_FILE_HANDLE dir, CHAR16 *name) {
+	EFI_FILE_HANDLE file;
+	IsoImage iso;
+	IsoExtent extent;
+	CHAR8 *boot_folder;
+	INTN family = -1;
+	UINTN i;
+	EFI_STATUS err;
+
+	err = uefi_call_wrapper(dir->Open, 5, dir, &file, name, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		return -1;
+	}
+	scan->opened++;
+
+	err = IsoOpen(&iso, IsoFileReader, file);
+	for (i = 0; !EFI_ERROR(err) && i < DISCOVERY_FAMILY_COUNT; i++) {
+		err = IsoLookup(&iso, KernelLocationForDistributionName(discovery_families[i], &boot_folder), &extent);
+		if (!EFI_ERROR(err) && !extent.directory) {
+			family = i + 1;
+			break;
+		} else if (err == EFI_NOT_FOUND) {
+			err = EFI_SUCCESS;
+		}
+	}
+
+	// Something that is not an ISO image, or is cut short, will not become
+	// one by being looked at again; a read error might go away.
+	if (family < 0 && (!EFI_ERROR(err) || err == EFI_VOLUME_CORRUPTED || err == EFI_END_OF_FILE)) {
+		family = 0;
+	}
+
+	IsoClose(&iso);
+	uefi_call_wrapper(file->Close, 1, file);
+	return family;
+}
+
+/* Adds a menu entry that boots the image straight from where it was found. */
+static EFI_STATUS DiscoveryAddEntry(DiscoveryScan *scan, EFI_HANDLE device, CHAR16 *name, UINTN name_length,
+		UINTN family) {
+	UINTN directory_length = StrLen(scan->directory);
+	LinuxBootOption *option;
+
+	option = AddBootEntry(scan->table, scan->arena);
+	if (!option) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	// The entry is named after the file, without its extension.
+	option->name = UTF16toASCII(name, name_length - 4, scan->arena);
+	option->iso_path = ArenaAllocate(scan->arena, (directory_length + 1 + name_length + 1) * sizeof(CHAR16));
+	if (!option->name || !option->iso_path) {
+		scan->table->count--;
+		return EFI_OUT_OF_RESOURCES;
+	}
+	CopyMem(option->iso_path, scan->directory, directory_length * sizeof(CHAR16));
+	option->iso_path[directory_length] = '\\';
+	CopyMem(option->iso_path + directory_length + 1, name, name_length * sizeof(CHAR16));
+	option->iso_path[directory_length + 1 + name_length] = '\0';
+
+	option->iso_device = device;
+	option->distro_family = discovery_families[family - 1];
+	option->kernel_path = KernelLocationForDistributionName(option->distro_family, &option->boot_folder);
+	option->initrd_path = InitRDLocationForDistributionName(option->distro_family);
+	scan->found++;
+	return EFI_SUCCESS;
+}
+
+/* Looks through the discover directory on one volume. */
+static EFI_STATUS DiscoveryScanVolume(DiscoveryScan *scan, EFI_HANDLE device) {
+	EFI_FILE_HANDLE root, dir;
+	EFI_FILE_INFO *info;
+	UINTN capacity = SIZE_OF_EFI_FILE_INFO + 256 * sizeof(CHAR16);
+	DiscoveryHeader *header = (DiscoveryHeader *)scan->index;
+	EFI_GUID id;
+	EFI_STATUS err;
+
+	root = LibOpenRoot(device);
+	if (!root) {
+		return EFI_NOT_FOUND;
+	}
+	err = uefi_call_wrapper(root->Open, 5, root, &dir, scan->directory[0] ? scan->directory : L"\\",
+		EFI_FILE_MODE_READ, 0);
+	uefi_call_wrapper(root->Close, 1, root);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	info = AllocatePool(capacity);
+	if (!info) {
+		uefi_call_wrapper(dir->Close, 1, dir);
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	// A volume we cannot name is still looked through, just not remembered.
+	scan->volume = NULL;
+	scan->remembered = NULL;
+	scan->remembered_count = 0;
+	if (DiscoveryVolumeId(device, &id)) {
+		DiscoveryFindVolume(scan, &id);
+		if (scan->index_size + sizeof(DiscoveryVolume) <= DISCOVERY_INDEX_SIZE) {
+			scan->volume = (DiscoveryVolume *)(scan->index + scan->index_size);
+			CopyMem(&scan->volume->id, &id, sizeof(EFI_GUID));
+			scan->volume->file_count = 0;
+			scan->index_size += sizeof(DiscoveryVolume);
+			header->volume_count++;
+		}
+	}
+
+	while (scan->found < DISCOVERY_MAX_FILES) {
+		UINTN size = capacity, name_length;
+		INTN family;
+
+		err = uefi_call_wrapper(dir->Read, 3, dir, &size, info);
+		if (err == EFI_BUFFER_TOO_SMALL) {
+			FreePool(info);
+			capacity = size;
+			info = AllocatePool(capacity);
+			if (!info) {
+				err = EFI_OUT_OF_RESOURCES;
+				break;
+			}
+			continue;
+		} else if (EFI_ERROR(err) || size == 0) {
+			break;
+		}
+
+		name_length = StrLen(info->FileName);
+		if (!DiscoveryIsCandidate(scan, device, info, name_length)) {
+			continue;
+		}
+
+		family = DiscoveryRemembered(scan, info, name_length);
+		if (family < 0) {
+			family = DiscoveryProbe(scan, dir, info->FileName);
+			if (family < 0) {
+				LogWarning(LogTagDiscovery, L"Could not look inside %s.\n", info->FileName);
+				continue;
+			}
+		}
+		DiscoveryRemember(scan, info, name_length, family);
+
+		if (family > 0 && family <= (INTN)DISCOVERY_FAMILY_COUNT) {
+			err = DiscoveryAddEntry(scan, device, info->FileName, name_length, family);
+			if (EFI_ERROR(err)) {
+				break;
+			}
+			LogDebug(LogTagDiscovery, L"Found %a in %s.\n", discovery_families[family - 1], info->FileName);
+		}
+	}
+
+	// A volume with nothing to remember takes no room in the index.
+	if (scan->volume && scan->volume->file_count == 0) {
+		scan->index_size -= sizeof(DiscoveryVolume);
+		header->volume_count--;
+	}
+
+	if (info) {
+		FreePool(info);
+	}
+	uefi_call_wrapper(dir->Close, 1, dir);
+	return err == EFI_OUT_OF_RESOURCES ? err : EFI_SUCCESS;
+}
+
+/*
+ * Adds an entry to the table for every bootable ISO file in the directory,
+ * on every volume, up to DISCOVERY_MAX_FILES of them. Strings are carved out
+ * of the arena, which must outlive the table. Returns EFI_NOT_FOUND if there
+ * were none.
+ */
+EFI_STATUS DiscoverISOFiles(const EFI_GUID *vendor, CHAR8 *directory, EFI_HANDLE own_device,
+		MemoryArena *arena, BootEntryTable *table) {
+	DiscoveryScan scan;
+	DiscoveryHeader *header;
+	EFI_HANDLE *handles;
+	UINTN handle_count, previous_size, i;
+	EFI_STATUS err;
+
+	ZeroMem(&scan, sizeof(scan));
+	scan.own_device = own_device;
+	scan.arena = arena;
+	scan.table = table;
+	scan.directory = DiscoveryDirectory(directory, arena);
+	scan.index = ArenaAllocateZero(arena, DISCOVERY_INDEX_SIZE);
+	if (!scan.directory || !scan.index) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	header = (DiscoveryHeader *)scan.index;
+	header->signature = DISCOVERY_SIGNATURE;
+	header->version = DISCOVERY_VERSION;
+	header->directory = DiscoveryDirectoryHash(scan.directory);
+	scan.index_size = sizeof(DiscoveryHeader);
+
+	err = LibLocateHandle(ByProtocol, &FileSystemProtocol, NULL, &handle_count, &handles);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	// An index for another directory, or one we cannot make sense of, is
+	// no help; every image is opened again and the index rewritten.
+	err = efi_get_variable(vendor, DISCOVERY_VARIABLE_NAME, (CHAR8 **)&scan.previous, &previous_size);
+	if (!EFI_ERROR(err) && !DiscoveryIndexValid(scan.previous, previous_size, header->directory)) {
+		FreePool(scan.previous);
+		scan.previous = NULL;
+	} else if (EFI_ERROR(err)) {
+		scan.previous = NULL;
+	}
+
+	for (i = 0; i < handle_count && scan.found < DISCOVERY_MAX_FILES; i++) {
+		err = DiscoveryScanVolume(&scan, handles[i]);
+		if (err == EFI_OUT_OF_RESOURCES) {
+			break;
+		}
+	}
+	FreePool(handles);
+	if (scan.previous) {
+		FreePool(scan.previous);
+	}
+
+	header->size = scan.index_size;
+	efi_set_variable_if_changed(vendor, DISCOVERY_VARIABLE_NAME, (CHAR8 *)scan.index, scan.index_size, TRUE);
+	LogDebug(LogTagDiscovery, L"%d ISO files to boot on %d volumes; %d had to be opened.\n", scan.found,
+		handle_count, scan.opened);
+
+	return scan.found ? EFI_SUCCESS : EFI_NOT_FOUND;
+}
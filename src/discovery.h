@@ -0,0 +1,64 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+
+#pragma once
+#ifndef _discovery_h
+#define _discovery_h
+
+#define DISCOVERY_VARIABLE_NAME L"Enterprise_DiscoveryIndex"
+#define DISCOVERY_SIGNATURE 0x49444E45 // "ENDI"
+#define DISCOVERY_VERSION 1
+/* At most this many ISO files are offered in the menu. */
+#define DISCOVERY_MAX_FILES 64
+/* The index goes in NVRAM, which is small; files that do not fit in it are
+ * simply looked into again at the next boot. */
+#define DISCOVERY_INDEX_SIZE 4096
+
+/*
+ * What was found in the discover directory on each volume, kept in a
+ * non-volatile variable so that the next boot need not open the ISO files
+ * again to see what they are. The header is followed by volume_count
+ * volumes, each a DiscoveryVolume and then file_count files, each a
+ * DiscoveryFile and then its name in UTF-16, without a terminator. Files
+ * that turned out not to be bootable are remembered too, as family 0.
+ */
+typedef struct DiscoveryHeader {
+	UINT32 signature;
+	UINT16 version;
+	UINT16 volume_count;
+	UINT32 size;
+	UINT32 directory; // Hash of the directory name; the index is only good for that one.
+} __attribute__((packed)) DiscoveryHeader;
+
+typedef struct DiscoveryVolume {
+	EFI_GUID id; // The GPT partition GUID, or a digest of the device path.
+	UINT16 file_count;
+} __attribute__((packed)) DiscoveryVolume;
+
+typedef struct DiscoveryFile {
+	UINT64 size;
+	EFI_TIME modification_time;
+	UINT8 family;
+	UINT8 name_length;
+} __attribute__((packed)) DiscoveryFile;
+
+EFI_STATUS DiscoverISOFiles(const EFI_GUID *vendor, CHAR8 *directory, EFI_HANDLE own_device,
+	MemoryArena *arena, BootEntryTable *table);
+
+#endif
@@ -0,0 +1,659 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Reads boot.iso straight off the partition. Older Apple firmware is slow at
+ * both the large sequential reads of the kernel and initrd and the small
+ * scattered ones an ISO directory walk needs when they go through its FAT
+ * driver, so the FAT driver is only used to open the file; we find where its
+ * clusters are ourselves and read them with the disk I/O protocol.
+ *
+ * Only FAT16 and FAT32 are understood, and the path has to be made of 8.3
+ * names. Anything else is left to the firmware, as is a file whose contents
+ * do not match what the file protocol says they are.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "iso9660.h"
+#include "disk.h"
+#include "log.h"
+
+/* Layout of the structures we use, as byte offsets (Microsoft FAT spec). */
+#define FAT_BPB_BYTES_PER_SECTOR	11
+#define FAT_BPB_SECTORS_PER_CLUSTER	13
+#define FAT_BPB_RESERVED_SECTORS	14
+#define FAT_BPB_FAT_COUNT			16
+#define FAT_BPB_ROOT_ENTRIES		17
+#define FAT_BPB_TOTAL_SECTORS_16	19
+#define FAT_BPB_FAT_SIZE_16			22
+#define FAT_BPB_TOTAL_SECTORS_32	32
+#define FAT_BPB_FAT_SIZE_32			36
+#define FAT_BPB_ROOT_CLUSTER		44
+#define FAT_BOOT_SIGNATURE			510
+
+#define FAT_ENTRY_NAME				0
+#define FAT_ENTRY_ATTRIBUTES		11
+#define FAT_ENTRY_CLUSTER_HIGH		20
+#define FAT_ENTRY_CLUSTER_LOW		26
+#define FAT_ENTRY_SIZE				28
+#define FAT_ENTRY_LENGTH			32
+
+#define FAT_ATTRIBUTE_VOLUME		0x08
+#define FAT_ATTRIBUTE_DIRECTORY		0x10
+#define FAT_ATTRIBUTE_LONG_NAME		0x0F
+#define FAT_ENTRY_FREE				0xE5
+
+#define FAT_CLUSTER_END				0xFFFFFFFF
+#define FAT12_MAX_CLUSTERS			4085
+#define FAT16_MAX_CLUSTERS			65525
+
+#define DISK_NO_BLOCK				((UINT64)-1)
+/* How much of each end of the file is compared with what the file protocol
+ * reads, to be sure the cluster chain we followed is the right one. */
+#define DISK_VERIFY_SIZE			(4 * 1024)
+
+typedef struct FatVolume {
+	UINT32 cluster_size;
+	UINT32 cluster_count;
+	UINT64 fat_offset;
+	UINT64 data_offset;
+	UINT64 root_offset;
+	UINT32 root_size;
+	UINT32 root_cluster;
+	BOOLEAN fat32;
+} FatVolume;
+
+static UINT32 ReadLittleEndian32(UINT8 *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32)p[3] << 24);
+}
+
+static UINT16 ReadLittleEndian16(UINT8 *p) {
+	return p[0] | (p[1] << 8);
+}
+
+#ifdef __APPLE__
+	#pragma mark - Block cache
+#endif
+static EFI_STATUS DiskReadDirect(DiskImage *image, UINT64 offset, UINTN size, VOID *buffer) {
+	if (offset > image->media_size || size > image->media_size - offset) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+	return uefi_call_wrapper(image->disk_io->ReadDisk, 5, image->disk_io, image->media_id, offset, size, buffer);
+}
+
+static UINT8* DiskCacheLookup(DiskImage *image, UINT64 block) {
+	UINTN i;
+
+	// Runs of small reads mostly stay within one block.
+	if (image->slots[image->slot_hint].block == block) {
+		image->slots[image->slot_hint].last_used = ++image->clock;
+		return image->cache + image->slot_hint * DISK_CACHE_BLOCK_SIZE;
+	}
+
+	for (i = 0; i < DISK_CACHE_BLOCKS; i++) {
+		if (image->slots[i].block == block) {
+			image->slots[i].last_used = ++image->clock;
+			image->slot_hint = i;
+			return image->cache + i * DISK_CACHE_BLOCK_SIZE;
+		}
+	}
+	return NULL;
+}
+
+/* Takes over the least recently used slot, or an empty one, for a block. */
+static UINT8* DiskCacheInsert(DiskImage *image, UINT64 block) {
+	UINTN i, victim = 0;
+
+	for (i = 1; i < DISK_CACHE_BLOCKS; i++) {
+		if (image->slots[i].last_used < image->slots[victim].last_used) {
+			victim = i;
+		}
+	}
+
+	image->slots[victim].block = block;
+	image->slots[victim].last_used = ++image->clock;
+	image->slot_hint = victim;
+	return image->cache + victim * DISK_CACHE_BLOCK_SIZE;
+}
+
+/*
+ * Returns the cached copy of a block, reading it in on a miss. A miss that
+ * continues where the last one left off reads the blocks after it as well,
+ * in one transfer, so a sequential scan pays for one request per window.
+ */
+static EFI_STATUS DiskCacheBlock(DiskImage *image, UINT64 block, UINT8 **data) {
+	UINT64 offset = block * DISK_CACHE_BLOCK_SIZE;
+	UINTN count, length, i;
+	UINT8 *target;
+	EFI_STATUS err;
+
+	*data = DiskCacheLookup(image, block);
+	if (*data) {
+		return EFI_SUCCESS;
+	} else if (offset >= image->media_size) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	count = block == image->next_block ? DISK_READ_AHEAD_BLOCKS : 1;
+	length = count * DISK_CACHE_BLOCK_SIZE;
+	if (length > image->media_size - offset) {
+		length = image->media_size - offset;
+		count = (length + DISK_CACHE_BLOCK_SIZE - 1) / DISK_CACHE_BLOCK_SIZE;
+	}
+
+	target = count == 1 ? DiskCacheInsert(image, block) : image->window;
+	err = DiskReadDirect(image, offset, length, target);
+	if (EFI_ERROR(err)) {
+		if (count == 1) {
+			image->slots[image->slot_hint].block = DISK_NO_BLOCK;
+			image->slots[image->slot_hint].last_used = 0;
+		}
+		return err;
+	}
+
+	// Blocks already in the cache are left where they are. The block asked
+	// for goes in first, and so is never the one the others push out.
+	for (i = 0; i < count && count > 1; i++) {
+		UINTN part = length - i * DISK_CACHE_BLOCK_SIZE;
+
+		if (!DiskCacheLookup(image, block + i)) {
+			CopyMem(DiskCacheInsert(image, block + i), image->window + i * DISK_CACHE_BLOCK_SIZE,
+				part < DISK_CACHE_BLOCK_SIZE ? part : DISK_CACHE_BLOCK_SIZE);
+		}
+	}
+
+	image->next_block = block + count;
+	*data = DiskCacheLookup(image, block);
+	return EFI_SUCCESS;
+}
+
+/* Reads a range of the partition through the cache. */
+static EFI_STATUS DiskReadCached(DiskImage *image, UINT64 offset, UINTN size, VOID *buffer) {
+	EFI_STATUS err;
+	UINT8 *data;
+
+	while (size > 0) {
+		UINTN within = offset % DISK_CACHE_BLOCK_SIZE;
+		UINTN chunk = DISK_CACHE_BLOCK_SIZE - within;
+
+		if (chunk > size) {
+			chunk = size;
+		}
+		if (offset + chunk > image->media_size) {
+			return EFI_VOLUME_CORRUPTED;
+		}
+
+		err = DiskCacheBlock(image, offset / DISK_CACHE_BLOCK_SIZE, &data);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+		CopyMem(buffer, data + within, chunk);
+
+		buffer = (UINT8 *)buffer + chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+	return EFI_SUCCESS;
+}
+
+#ifdef __APPLE__
+	#pragma mark - FAT
+#endif
+static EFI_STATUS FatReadVolume(DiskImage *image, FatVolume *volume) {
+	UINT8 sector[512];
+	UINT32 bytes_per_sector, sectors_per_cluster, reserved, fat_count, fat_size, total, root_sectors, data_sector;
+	EFI_STATUS err;
+
+	err = DiskReadCached(image, 0, sizeof(sector), sector);
+	if (EFI_ERROR(err)) {
+		return err;
+	} else if (ReadLittleEndian16(sector + FAT_BOOT_SIGNATURE) != 0xAA55) {
+		return EFI_UNSUPPORTED;
+	}
+
+	bytes_per_sector = ReadLittleEndian16(sector + FAT_BPB_BYTES_PER_SECTOR);
+	sectors_per_cluster = sector[FAT_BPB_SECTORS_PER_CLUSTER];
+	reserved = ReadLittleEndian16(sector + FAT_BPB_RESERVED_SECTORS);
+	fat_count = sector[FAT_BPB_FAT_COUNT];
+	fat_size = ReadLittleEndian16(sector + FAT_BPB_FAT_SIZE_16);
+	if (fat_size == 0) {
+		fat_size = ReadLittleEndian32(sector + FAT_BPB_FAT_SIZE_32);
+	}
+	total = ReadLittleEndian16(sector + FAT_BPB_TOTAL_SECTORS_16);
+	if (total == 0) {
+		total = ReadLittleEndian32(sector + FAT_BPB_TOTAL_SECTORS_32);
+	}
+
+	// exFAT and NTFS leave these zero, which rules them out as well.
+	if (bytes_per_sector < 512 || bytes_per_sector > 4096 || (bytes_per_sector & (bytes_per_sector - 1)) ||
+			sectors_per_cluster == 0 || (sectors_per_cluster & (sectors_per_cluster - 1)) ||
+			reserved == 0 || fat_count == 0 || fat_size == 0) {
+		return EFI_UNSUPPORTED;
+	}
+
+	volume->root_size = ReadLittleEndian16(sector + FAT_BPB_ROOT_ENTRIES) * FAT_ENTRY_LENGTH;
+	root_sectors = (volume->root_size + bytes_per_sector - 1) / bytes_per_sector;
+	data_sector = reserved + fat_count * fat_size + root_sectors;
+	if (data_sector >= total) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	volume->cluster_size = bytes_per_sector * sectors_per_cluster;
+	volume->cluster_count = (total - data_sector) / sectors_per_cluster;
+	if (volume->cluster_count < FAT12_MAX_CLUSTERS) {
+		return EFI_UNSUPPORTED;
+	}
+	volume->fat32 = volume->cluster_count >= FAT16_MAX_CLUSTERS;
+	volume->fat_offset = (UINT64)reserved * bytes_per_sector;
+	volume->root_offset = (UINT64)(reserved + fat_count * fat_size) * bytes_per_sector;
+	volume->data_offset = (UINT64)data_sector * bytes_per_sector;
+	volume->root_cluster = volume->fat32 ? ReadLittleEndian32(sector + FAT_BPB_ROOT_CLUSTER) : 0;
+	return EFI_SUCCESS;
+}
+
+static BOOLEAN FatValidCluster(FatVolume *volume, UINT32 cluster) {
+	return cluster >= 2 && cluster - 2 < volume->cluster_count;
+}
+
+static UINT64 FatClusterOffset(FatVolume *volume, UINT32 cluster) {
+	return volume->data_offset + (UINT64)(cluster - 2) * volume->cluster_size;
+}
+
+/* Follows the FAT from one cluster to the next, or to FAT_CLUSTER_END. */
+static EFI_STATUS FatNextCluster(DiskImage *image, FatVolume *volume, UINT32 cluster, UINT32 *next) {
+	UINT8 entry[4];
+	EFI_STATUS err;
+
+	if (volume->fat32) {
+		err = DiskReadCached(image, volume->fat_offset + (UINT64)cluster * 4, 4, entry);
+		*next = ReadLittleEndian32(entry) & 0x0FFFFFFF;
+		if (*next >= 0x0FFFFFF8) {
+			*next = FAT_CLUSTER_END;
+		}
+	} else {
+		err = DiskReadCached(image, volume->fat_offset + (UINT64)cluster * 2, 2, entry);
+		*next = ReadLittleEndian16(entry);
+		if (*next >= 0xFFF8) {
+			*next = FAT_CLUSTER_END;
+		}
+	}
+
+	if (EFI_ERROR(err)) {
+		return err;
+	} else if (*next != FAT_CLUSTER_END && !FatValidCluster(volume, *next)) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+	return EFI_SUCCESS;
+}
+
+/* Turns one path component into the space-padded form of an 8.3 entry. */
+static BOOLEAN FatShortName(CHAR16 *component, UINTN length, CHAR8 *name) {
+	UINTN i, dot = length, limit = 8, out = 0;
+
+	for (i = 0; i < length; i++) {
+		if (component[i] == '.') {
+			dot = i;
+		}
+	}
+
+	SetMem(name, 11, ' ');
+	for (i = 0; i < length; i++) {
+		CHAR16 c = component[i];
+
+		if (i == dot) {
+			out = 8;
+			limit = 11;
+			continue;
+		} else if (c <= ' ' || c >= 0x7F || c == '.' || out >= limit) {
+			return FALSE;
+		}
+		name[out++] = (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+	}
+	return dot > 0;
+}
+
+/*
+ * Looks a short name up in a directory, which is either a cluster chain or,
+ * for cluster 0 on FAT16, the fixed root directory region.
+ */
+static EFI_STATUS FatFindEntry(DiskImage *image, FatVolume *volume, UINT32 cluster, CHAR8 *name,
+		UINT8 *entry) {
+	UINT64 offset, remaining;
+	UINTN clusters = 0;
+	EFI_STATUS err;
+
+	if (cluster == 0) {
+		offset = volume->root_offset;
+		remaining = volume->root_size;
+	} else {
+		offset = FatClusterOffset(volume, cluster);
+		remaining = volume->cluster_size;
+	}
+
+	for (;;) {
+		for (; remaining >= FAT_ENTRY_LENGTH; offset += FAT_ENTRY_LENGTH, remaining -= FAT_ENTRY_LENGTH) {
+			err = DiskReadCached(image, offset, FAT_ENTRY_LENGTH, entry);
+			if (EFI_ERROR(err)) {
+				return err;
+			} else if (entry[FAT_ENTRY_NAME] == 0) {
+				return EFI_NOT_FOUND;
+			} else if (entry[FAT_ENTRY_NAME] == FAT_ENTRY_FREE ||
+					(entry[FAT_ENTRY_ATTRIBUTES] & FAT_ATTRIBUTE_VOLUME)) {
+				// Long name entries are marked as volume labels too.
+				continue;
+			} else if (CompareMem(entry + FAT_ENTRY_NAME, name, 11) == 0) {
+				return EFI_SUCCESS;
+			}
+		}
+
+		// A chain that goes on for longer than the volume has clusters loops.
+		if (cluster == 0 || ++clusters > volume->cluster_count) {
+			return cluster == 0 ? EFI_NOT_FOUND : EFI_VOLUME_CORRUPTED;
+		}
+		err = FatNextCluster(image, volume, cluster, &cluster);
+		if (EFI_ERROR(err)) {
+			return err;
+		} else if (cluster == FAT_CLUSTER_END) {
+			return EFI_NOT_FOUND;
+		}
+		offset = FatClusterOffset(volume, cluster);
+		remaining = volume->cluster_size;
+	}
+}
+
+/* Finds the directory entry of a file, given a path such as \efi\boot\boot.iso. */
+static EFI_STATUS FatLookup(DiskImage *image, FatVolume *volume, CHAR16 *path, UINT32 *cluster,
+		UINT64 *size) {
+	UINT8 entry[FAT_ENTRY_LENGTH];
+	UINT32 directory = volume->root_cluster;
+	BOOLEAN is_directory = TRUE;
+	CHAR8 name[11];
+	EFI_STATUS err;
+
+	while (*path) {
+		UINTN length = 0;
+
+		if (*path == '\\') {
+			path++;
+			continue;
+		} else if (!is_directory) {
+			return EFI_NOT_FOUND;
+		}
+
+		while (path[length] && path[length] != '\\') {
+			length++;
+		}
+		if (!FatShortName(path, length, name)) {
+			return EFI_UNSUPPORTED;
+		}
+		path += length;
+
+		err = FatFindEntry(image, volume, directory, name, entry);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+		directory = ((UINT32)ReadLittleEndian16(entry + FAT_ENTRY_CLUSTER_HIGH) << 16) |
+			ReadLittleEndian16(entry + FAT_ENTRY_CLUSTER_LOW);
+		is_directory = (entry[FAT_ENTRY_ATTRIBUTES] & FAT_ATTRIBUTE_DIRECTORY) != 0;
+		if (directory == 0 && is_directory) {
+			directory = volume->root_cluster;
+		}
+	}
+
+	if (is_directory) {
+		return EFI_NOT_FOUND;
+	}
+	*cluster = directory;
+	*size = ReadLittleEndian32(entry + FAT_ENTRY_SIZE);
+	return EFI_SUCCESS;
+}
+
+/* Walks a file's cluster chain, merging clusters that follow on into runs. */
+static EFI_STATUS FatMapFile(DiskImage *image, FatVolume *volume, UINT32 cluster) {
+	UINTN capacity = 0;
+	UINT64 mapped = 0;
+	EFI_STATUS err;
+
+	while (mapped < image->size) {
+		UINT64 offset;
+		DiskRun *run;
+
+		if (!FatValidCluster(volume, cluster)) {
+			return EFI_VOLUME_CORRUPTED;
+		}
+
+		offset = FatClusterOffset(volume, cluster);
+		run = image->run_count ? &image->runs[image->run_count - 1] : NULL;
+		if (run && run->disk_offset + run->length == offset) {
+			run->length += volume->cluster_size;
+		} else {
+			if (image->run_count == capacity) {
+				UINTN grown = capacity ? capacity * 2 : 16;
+
+				run = ReallocatePool(image->runs, capacity * sizeof(DiskRun), grown * sizeof(DiskRun));
+				if (!run) {
+					return EFI_OUT_OF_RESOURCES;
+				}
+				image->runs = run;
+				capacity = grown;
+			}
+			run = &image->runs[image->run_count++];
+			run->file_offset = mapped;
+			run->disk_offset = offset;
+			run->length = volume->cluster_size;
+		}
+
+		mapped += volume->cluster_size;
+		if (mapped < image->size) {
+			err = FatNextCluster(image, volume, cluster, &cluster);
+			if (EFI_ERROR(err)) {
+				return err;
+			}
+		}
+	}
+
+	// The last cluster is usually only partly used.
+	if (image->run_count) {
+		image->runs[image->run_count - 1].length -= mapped - image->size;
+	}
+	return EFI_SUCCESS;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Images
+#endif
+/* The read-ahead window directly follows the cache, in the same allocation. */
+static EFI_STATUS DiskImageAttach(DiskImage *image, EFI_HANDLE device) {
+	EFI_BLOCK_IO *block_io;
+	UINTN i;
+	EFI_STATUS err;
+
+	err = uefi_call_wrapper(BS->HandleProtocol, 3, device, &BlockIoProtocol, (VOID **)&block_io);
+	if (!EFI_ERROR(err)) {
+		err = uefi_call_wrapper(BS->HandleProtocol, 3, device, &DiskIoProtocol, (VOID **)&image->disk_io);
+	}
+	if (EFI_ERROR(err)) {
+		return err;
+	} else if (!block_io->Media->MediaPresent) {
+		return EFI_NO_MEDIA;
+	}
+
+	image->media_id = block_io->Media->MediaId;
+	image->media_size = (block_io->Media->LastBlock + 1) * block_io->Media->BlockSize;
+	image->cache = AllocatePool((DISK_CACHE_BLOCKS + DISK_READ_AHEAD_BLOCKS) * DISK_CACHE_BLOCK_SIZE);
+	if (!image->cache) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	image->window = image->cache + DISK_CACHE_BLOCKS * DISK_CACHE_BLOCK_SIZE;
+
+	for (i = 0; i < DISK_CACHE_BLOCKS; i++) {
+		image->slots[i].block = DISK_NO_BLOCK;
+	}
+	image->next_block = DISK_NO_BLOCK;
+	return EFI_SUCCESS;
+}
+
+/* Compares both ends of the image with what the file protocol reads there. */
+static EFI_STATUS DiskImageVerify(DiskImage *image, EFI_FILE_HANDLE file) {
+	UINT8 *expected, *actual;
+	UINT64 offsets[2];
+	UINTN length, i;
+	EFI_FILE_INFO *info;
+	EFI_STATUS err = EFI_SUCCESS;
+
+	info = LibFileInfo(file);
+	if (!info) {
+		return EFI_DEVICE_ERROR;
+	} else if (info->FileSize != image->size) {
+		FreePool(info);
+		return EFI_VOLUME_CORRUPTED;
+	}
+	FreePool(info);
+
+	// Not the read-ahead window, which the reads through the cache can use.
+	expected = AllocatePool(2 * DISK_VERIFY_SIZE);
+	if (!expected) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	actual = expected + DISK_VERIFY_SIZE;
+
+	length = image->size < DISK_VERIFY_SIZE ? image->size : DISK_VERIFY_SIZE;
+	offsets[0] = 0;
+	offsets[1] = image->size - length;
+	for (i = 0; i < 2 && !EFI_ERROR(err); i++) {
+		err = IsoFileReader(file, offsets[i], length, expected);
+		if (!EFI_ERROR(err)) {
+			err = DiskImageReader(image, offsets[i], length, actual);
+		}
+		if (!EFI_ERROR(err) && CompareMem(expected, actual, length) != 0) {
+			err = EFI_VOLUME_CORRUPTED;
+		}
+	}
+
+	FreePool(expected);
+	return err;
+}
+
+/*
+ * Prepares to read the file at path, which file is already open, straight
+ * from device, the partition it lives on. Callers fall back to reading
+ * through file when this fails; image is left zeroed in that case.
+ */
+EFI_STATUS DiskImageOpen(DiskImage *image, EFI_HANDLE device, CHAR16 *path, EFI_FILE_HANDLE file) {
+	FatVolume volume;
+	UINT32 cluster;
+	EFI_STATUS err;
+
+	ZeroMem(image, sizeof(DiskImage));
+	err = DiskImageAttach(image, device);
+	if (!EFI_ERROR(err)) {
+		err = FatReadVolume(image, &volume);
+	}
+	if (!EFI_ERROR(err)) {
+		err = FatLookup(image, &volume, path, &cluster, &image->size);
+	}
+	if (!EFI_ERROR(err)) {
+		err = FatMapFile(image, &volume, cluster);
+	}
+	if (!EFI_ERROR(err)) {
+		err = DiskImageVerify(image, file);
+	}
+
+	if (EFI_ERROR(err)) {
+		LogInfo(LogTagDisk, L"Reading %s through the file system: %r\n", path, err);
+		DiskImageClose(image);
+		return err;
+	}
+
+	LogDebug(LogTagDisk, L"Reading %s from the disk: %ld bytes in %d runs\n", path, image->size,
+		image->run_count);
+	return EFI_SUCCESS;
+}
+
+VOID DiskImageClose(DiskImage *image) {
+	if (image->runs) {
+		FreePool(image->runs);
+	}
+	if (image->cache) {
+		FreePool(image->cache);
+	}
+	ZeroMem(image, sizeof(DiskImage));
+}
+
+/* Finds the run holding a file offset, which is known to be in the file. */
+static DiskRun* DiskImageFindRun(DiskImage *image, UINT64 offset) {
+	UINTN low = 0, high = image->run_count;
+	DiskRun *run = &image->runs[image->run_hint];
+
+	if (offset >= run->file_offset && offset - run->file_offset < run->length) {
+		return run;
+	}
+
+	while (high - low > 1) {
+		UINTN middle = low + (high - low) / 2;
+
+		if (image->runs[middle].file_offset <= offset) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	image->run_hint = low;
+	return &image->runs[low];
+}
+
+/*
+ * An IsoReadFunction for an open DiskImage. Reads of at least a cache block
+ * go straight into the caller's buffer, one transfer per run; smaller ones,
+ * such as directory sectors, go through the cache.
+ */
+EFI_STATUS DiskImageReader(VOID *context, UINT64 offset, UINTN size, VOID *buffer) {
+	DiskImage *image = context;
+	EFI_STATUS err;
+
+	if (offset > image->size || size > image->size - offset) {
+		return EFI_END_OF_FILE;
+	}
+
+	while (size > 0) {
+		DiskRun *run = DiskImageFindRun(image, offset);
+		UINT64 within = offset - run->file_offset;
+		UINTN chunk = size;
+
+		if (chunk > run->length - within) {
+			chunk = run->length - within;
+		}
+
+		if (chunk >= DISK_CACHE_BLOCK_SIZE) {
+			err = DiskReadDirect(image, run->disk_offset + within, chunk, buffer);
+		} else {
+			err = DiskReadCached(image, run->disk_offset + within, chunk, buffer);
+		}
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+
+		buffer = (UINT8 *)buffer + chunk;
+		offset += chunk;
+		size -= chunk;
+	}
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,69 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _disk_h
+#define _disk_h
+
+/* Small reads are served from a cache of this many blocks of this size,
+ * aligned on the partition, which is evicted least recently used first. */
+#define DISK_CACHE_BLOCK_SIZE (32 * 1024)
+#define DISK_CACHE_BLOCKS 32
+/* A miss on the block after the last one read is taken to be part of a
+ * sequential scan, and fills this many blocks with a single transfer. */
+#define DISK_READ_AHEAD_BLOCKS 8
+
+/* A stretch of the file that is contiguous on the partition. */
+typedef struct DiskRun {
+	UINT64 file_offset;
+	UINT64 disk_offset;
+	UINT64 length;
+} DiskRun;
+
+typedef struct DiskCacheSlot {
+	UINT64 block;
+	UINT64 last_used;
+} DiskCacheSlot;
+
+/*
+ * A file on a FAT partition, read with the disk I/O protocol instead of
+ * through the firmware's file system driver. Its cluster chain is walked
+ * once, when it is opened, and turned into a list of runs; after that a
+ * read of any size is one transfer for each run it touches.
+ */
+typedef struct DiskImage {
+	EFI_DISK_IO *disk_io;
+	UINT32 media_id;
+	UINT64 media_size;
+	UINT64 size;
+	DiskRun *runs;
+	UINTN run_count;
+	UINTN run_hint;
+	UINT8 *cache;
+	UINT8 *window;
+	DiskCacheSlot slots[DISK_CACHE_BLOCKS];
+	UINTN slot_hint;
+	UINT64 clock;
+	UINT64 next_block;
+} DiskImage;
+
+EFI_STATUS DiskImageOpen(DiskImage *image, EFI_HANDLE device, CHAR16 *path, EFI_FILE_HANDLE file);
+VOID DiskImageClose(DiskImage *image);
+EFI_STATUS DiskImageReader(VOID *context, UINT64 offset, UINTN size, VOID *buffer);
+
+#endif
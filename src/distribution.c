@@ -42,3 +42,48 @@ CHAR8* InitRDLocationForDistributionName(CHAR8 *name) {
 		return (CHAR8 *)"";
 	}
 }
+
+/*
+ * The parameters the distribution's live system needs to find the ISO file
+ * on its own once the kernel is running. GRUB normally supplies these; they
+ * are only used when we start the kernel ourselves.
+ */
+CHAR8* KernelParametersForDistributionName(CHAR8 *name) {
+	if (strcmpa((CHAR8 *)"Debian", name) == 0) {
+		return (CHAR8 *)"boot=live findiso=/efi/boot/boot.iso";
+	} else if (strcmpa((CHAR8 *)"Ubuntu", name) == 0 || strcmpa((CHAR8 *)"Mint", name) == 0) {
+		return (CHAR8 *)"boot=casper iso-scan/filename=/efi/boot/boot.iso";
+	} else {
+		return (CHAR8 *)"";
+	}
+}
+
+/*
+ * The same, for a live system whose ISO has been copied into memory for it.
+ * It finds it there among the block devices by looking, and being told the
+ * file name would only send it to the stick instead.
+ */
+CHAR8* KernelParametersForRamDisk(CHAR8 *name) {
+	if (strcmpa((CHAR8 *)"Debian", name) == 0) {
+		return (CHAR8 *)"boot=live";
+	} else if (strcmpa((CHAR8 *)"Ubuntu", name) == 0 || strcmpa((CHAR8 *)"Mint", name) == 0) {
+		return (CHAR8 *)"boot=casper";
+	} else {
+		return (CHAR8 *)"";
+	}
+}
+
+/*
+ * The same, for an ISO file found by discovery rather than at the usual
+ * place. The live system looks through every disk for a file by that name,
+ * which follows these, '/'-separated, on the command line.
+ */
+CHAR8* KernelParametersForISOFile(CHAR8 *name) {
+	if (strcmpa((CHAR8 *)"Debian", name) == 0) {
+		return (CHAR8 *)"boot=live findiso=";
+	} else if (strcmpa((CHAR8 *)"Ubuntu", name) == 0 || strcmpa((CHAR8 *)"Mint", name) == 0) {
+		return (CHAR8 *)"boot=casper iso-scan/filename=";
+	} else {
+		return (CHAR8 *)"";
+	}
+}
@@ -22,5 +22,8 @@
 
 CHAR8* KernelLocationForDistributionName(CHAR8 *name, OUT CHAR8 **boot_folder);
 CHAR8* InitRDLocationForDistributionName(CHAR8 *name);
+CHAR8* KernelParametersForDistributionName(CHAR8 *name);
+CHAR8* KernelParametersForRamDisk(CHAR8 *name);
+CHAR8* KernelParametersForISOFile(CHAR8 *name);
 
 #endif
@@ -0,0 +1,92 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "arena.h"
+#include "utils.h"
+#include "convert.h"
+#include "handoff.h"
+
+/*
+ * Packs the boot option and the kernel command line into one record and
+ * stores it in a single SetVariable call. The command line also goes into
+ * the variable GRUB has always read it from. Both are volatile, so there is
+ * no flash to spare by reading them back first.
+ */
+EFI_STATUS HandoffPublish(const EFI_GUID *vendor, LinuxBootOption *option, CHAR16 *command_line,
+		MemoryArena *arena) {
+	CHAR8 *values[HandoffFieldCount - 1];
+	UINTN lengths[HandoffFieldCount - 1], command_line_length, capacity, offset, i;
+	HandoffHeader *header;
+	CHAR8 *record;
+	EFI_STATUS err;
+
+	values[HandoffFieldEntry] = option->name;
+	values[HandoffFieldFamily] = option->distro_family;
+	values[HandoffFieldKernel] = option->kernel_path;
+	values[HandoffFieldInitRD] = option->initrd_path;
+	values[HandoffFieldBootFolder] = option->boot_folder;
+
+	capacity = sizeof(HandoffHeader);
+	for (i = 0; i < HandoffFieldCommandLine; i++) {
+		if (!values[i]) {
+			values[i] = (CHAR8 *)"";
+		}
+		lengths[i] = strlena(values[i]);
+		capacity += lengths[i] + 1;
+	}
+	command_line_length = StrLen(command_line);
+	capacity += UTF8_CAPACITY_FOR_UTF16(command_line_length);
+
+	// Offsets are 16 bits wide, which is plenty for paths and a command line.
+	if (capacity > 0xFFFF) {
+		return EFI_BAD_BUFFER_SIZE;
+	}
+
+	record = ArenaAllocateZero(arena, capacity);
+	if (!record) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	header = (HandoffHeader *)record;
+	header->signature = HANDOFF_SIGNATURE;
+	header->version = HANDOFF_VERSION;
+	header->field_count = HandoffFieldCount;
+
+	offset = sizeof(HandoffHeader);
+	for (i = 0; i < HandoffFieldCommandLine; i++) {
+		header->fields[i] = offset;
+		CopyMem(record + offset, values[i], lengths[i] + 1);
+		offset += lengths[i] + 1;
+	}
+
+	// The command line is the only field that arrives as UTF-16.
+	header->fields[HandoffFieldCommandLine] = offset;
+	offset += Utf16ToUtf8(command_line, command_line_length, record + offset, capacity - offset) + 1;
+	header->size = offset;
+
+	err = efi_set_variable(vendor, HANDOFF_OPTIONS_VARIABLE_NAME, record + header->fields[HandoffFieldCommandLine],
+		offset - header->fields[HandoffFieldCommandLine], FALSE);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	return efi_set_variable(vendor, HANDOFF_VARIABLE_NAME, record, offset, FALSE);
+}
@@ -0,0 +1,58 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _handoff_h
+#define _handoff_h
+
+#define HANDOFF_VARIABLE_NAME L"Enterprise_BootHandoff"
+#define HANDOFF_SIGNATURE 0x46484E45 // "ENHF"
+#define HANDOFF_VERSION 1
+// The kernel command line on its own, NUL-terminated UTF-8, as GRUB
+// configurations written before the record existed read it.
+#define HANDOFF_OPTIONS_VARIABLE_NAME L"Enterprise_LinuxBootOptions"
+
+typedef enum HandoffField {
+	HandoffFieldEntry,
+	HandoffFieldFamily,
+	HandoffFieldKernel,
+	HandoffFieldInitRD,
+	HandoffFieldBootFolder,
+	HandoffFieldCommandLine,
+	HandoffFieldCount
+} HandoffField;
+
+/*
+ * Everything GRUB needs to know about the entry being booted, in one
+ * variable. The header is followed by the fields as NUL-terminated UTF-8
+ * strings; fields[] holds the offset of each from the start of the record.
+ * Fields added in later versions go at the end, so a reader only needs to
+ * check that field_count covers the ones it knows about.
+ */
+typedef struct HandoffHeader {
+	UINT32 signature;
+	UINT16 version;
+	UINT16 field_count;
+	UINT32 size;
+	UINT16 fields[HandoffFieldCount];
+} __attribute__((packed)) HandoffHeader;
+
+EFI_STATUS HandoffPublish(const EFI_GUID *vendor, LinuxBootOption *option, CHAR16 *command_line,
+	MemoryArena *arena);
+
+#endif
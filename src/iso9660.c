@@ -0,0 +1,461 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * A read-only ISO9660 reader that understands Joliet and Rock Ridge names.
+ * It only needs to answer "where is this file inside the image", so it keeps
+ * nothing but an index of the directories it has been asked to look through.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "iso9660.h"
+
+/* Layout of the structures we use, as byte offsets (ECMA-119). */
+#define ISO_DESCRIPTOR_START		16
+#define ISO_DESCRIPTOR_LIMIT		64
+#define ISO_DESCRIPTOR_PRIMARY		1
+#define ISO_DESCRIPTOR_SUPPLEMENTARY	2
+#define ISO_DESCRIPTOR_TERMINATOR	255
+#define ISO_VD_ESCAPES				88
+#define ISO_VD_BLOCK_SIZE			128
+#define ISO_VD_ROOT_RECORD			156
+
+#define ISO_RECORD_LENGTH			0
+#define ISO_RECORD_EXTENT			2
+#define ISO_RECORD_SIZE				10
+#define ISO_RECORD_FLAGS			25
+#define ISO_RECORD_NAME_LENGTH		32
+#define ISO_RECORD_NAME				33
+#define ISO_FLAG_DIRECTORY			0x02
+
+/* Rock Ridge alternate name flags. */
+#define RR_NAME_CONTINUE			0x01
+#define RR_NAME_CURRENT				0x02
+#define RR_NAME_PARENT				0x04
+
+#define ISO_MAX_NAME				255
+#define ISO_MAX_PATH				1024
+#define ISO_MAX_DIRECTORY			(16 * 1024 * 1024)
+
+typedef struct IsoIndexEntry {
+	struct IsoIndexEntry *next;
+	UINT32 hash;
+	UINTN length;
+	BOOLEAN indexed;
+	IsoExtent extent;
+	CHAR8 path[];
+} IsoIndexEntry;
+
+static UINT32 ReadLittleEndian32(UINT8 *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32)p[3] << 24);
+}
+
+static UINT16 ReadLittleEndian16(UINT8 *p) {
+	return p[0] | (p[1] << 8);
+}
+
+static CHAR8 ToLower(CHAR8 c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* Reads from an image opened through the firmware's file protocol. */
+EFI_STATUS IsoFileReader(VOID *context, UINT64 offset, UINTN size, VOID *buffer) {
+	EFI_FILE_HANDLE file = context;
+	EFI_STATUS err;
+
+	err = uefi_call_wrapper(file->SetPosition, 2, file, offset);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	while (size > 0) {
+		UINTN chunk = size;
+
+		err = uefi_call_wrapper(file->Read, 3, file, &chunk, buffer);
+		if (EFI_ERROR(err)) {
+			return err;
+		} else if (chunk == 0) {
+			return EFI_END_OF_FILE;
+		}
+
+		buffer = (UINT8 *)buffer + chunk;
+		size -= chunk;
+	}
+	return EFI_SUCCESS;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Path index
+#endif
+/* FNV-1a; paths are short and this spreads them well enough. */
+static UINT32 IsoHashPath(CHAR8 *path, UINTN length) {
+	UINT32 hash = 2166136261U;
+	UINTN i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= path[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static IsoIndexEntry* IsoIndexFind(IsoImage *iso, CHAR8 *path, UINTN length) {
+	UINT32 hash = IsoHashPath(path, length);
+	IsoIndexEntry *entry;
+
+	for (entry = iso->buckets[hash % ISO_INDEX_BUCKETS]; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->length == length && CompareMem(entry->path, path, length) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+static IsoIndexEntry* IsoIndexInsert(IsoImage *iso, CHAR8 *path, UINTN length, UINT8 *record) {
+	IsoIndexEntry *entry;
+
+	entry = ArenaAllocate(&iso->arena, sizeof(IsoIndexEntry) + length + 1);
+	if (!entry) {
+		return NULL;
+	}
+
+	entry->hash = IsoHashPath(path, length);
+	entry->length = length;
+	entry->indexed = FALSE;
+	entry->extent.offset = (UINT64)ReadLittleEndian32(record + ISO_RECORD_EXTENT) * iso->block_size;
+	entry->extent.size = ReadLittleEndian32(record + ISO_RECORD_SIZE);
+	entry->extent.directory = (record[ISO_RECORD_FLAGS] & ISO_FLAG_DIRECTORY) != 0;
+	CopyMem(entry->path, path, length);
+	entry->path[length] = '\0';
+
+	entry->next = iso->buckets[entry->hash % ISO_INDEX_BUCKETS];
+	iso->buckets[entry->hash % ISO_INDEX_BUCKETS] = entry;
+	return entry;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Directory records
+#endif
+/* Returns the Rock Ridge alternate name of a record, if it has one. */
+static UINTN IsoRockRidgeName(IsoImage *iso, UINT8 *record, CHAR8 *name) {
+	UINT8 name_length = record[ISO_RECORD_NAME_LENGTH];
+	UINT8 *su = record + ISO_RECORD_NAME + name_length + (name_length % 2 == 0 ? 1 : 0) + iso->susp_skip;
+	UINT8 *end = record + record[ISO_RECORD_LENGTH];
+	UINTN length = 0;
+
+	while (su + 4 <= end) {
+		UINT8 entry_length = su[2];
+
+		if (entry_length < 4 || su + entry_length > end || (su[0] == 'S' && su[1] == 'T')) {
+			break;
+		}
+
+		if (su[0] == 'N' && su[1] == 'M' && entry_length >= 5) {
+			UINTN part = entry_length - 5;
+
+			if (su[4] & (RR_NAME_CURRENT|RR_NAME_PARENT)) {
+				return 0;
+			}
+
+			if (length + part > ISO_MAX_NAME) {
+				part = ISO_MAX_NAME - length;
+			}
+			CopyMem(name + length, su + 5, part);
+			length += part;
+
+			if (!(su[4] & RR_NAME_CONTINUE)) {
+				break;
+			}
+		}
+
+		su += entry_length;
+	}
+	return length;
+}
+
+/*
+ * Extracts the name of a directory record into name, in lower case and
+ * without the ISO9660 version suffix, using whichever naming extension the
+ * image provides. Returns 0 for the "." and ".." records.
+ */
+static UINTN IsoRecordName(IsoImage *iso, UINT8 *record, CHAR8 *name) {
+	UINT8 *identifier = record + ISO_RECORD_NAME;
+	UINTN identifier_length = record[ISO_RECORD_NAME_LENGTH];
+	UINTN length = 0, i;
+	BOOLEAN alternate = FALSE;
+
+	if (identifier_length == 1 && (identifier[0] == 0 || identifier[0] == 1)) {
+		return 0;
+	}
+
+	if (iso->naming == IsoNamingRockRidge) {
+		length = IsoRockRidgeName(iso, record, name);
+		alternate = length > 0;
+	}
+
+	if (length == 0 && iso->naming == IsoNamingJoliet) {
+		// Joliet names are big-endian UCS-2; we only need to match ASCII paths.
+		for (i = 0; i + 1 < identifier_length && length < ISO_MAX_NAME; i += 2) {
+			CHAR16 c = (identifier[i] << 8) | identifier[i + 1];
+			name[length++] = c < 0x80 ? (CHAR8)c : '?';
+		}
+	} else if (length == 0) {
+		for (i = 0; i < identifier_length && length < ISO_MAX_NAME; i++) {
+			name[length++] = identifier[i];
+		}
+	}
+
+	if (!alternate) {
+		for (i = 0; i < length; i++) {
+			if (name[i] == ';') {
+				length = i;
+				break;
+			}
+		}
+
+		if (length > 0 && name[length - 1] == '.') {
+			length--;
+		}
+	}
+
+	for (i = 0; i < length; i++) {
+		name[i] = ToLower(name[i]);
+	}
+	return length;
+}
+
+/* Reads a whole directory in one go and adds all of its entries to the index. */
+static EFI_STATUS IsoIndexDirectory(IsoImage *iso, IsoIndexEntry *directory) {
+	CHAR8 path[ISO_MAX_PATH];
+	UINT8 *buffer;
+	UINT64 position;
+	EFI_STATUS err;
+
+	if (directory->extent.size > ISO_MAX_DIRECTORY || directory->length + 1 + ISO_MAX_NAME >= ISO_MAX_PATH) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	buffer = AllocatePool(directory->extent.size);
+	if (!buffer) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	err = iso->read(iso->context, directory->extent.offset, directory->extent.size, buffer);
+	if (EFI_ERROR(err)) {
+		FreePool(buffer);
+		return err;
+	}
+
+	CopyMem(path, directory->path, directory->length);
+	path[directory->length] = '/';
+
+	for (position = 0; position < directory->extent.size; position += ISO_SECTOR_SIZE) {
+		UINT8 *sector = buffer + position;
+		UINTN offset = 0;
+
+		/* Records never span sectors; a zero length pads out the sector. */
+		while (offset < ISO_SECTOR_SIZE && position + offset < directory->extent.size &&
+			sector[offset + ISO_RECORD_LENGTH] != 0) {
+			UINT8 *record = sector + offset;
+			UINT8 record_length = record[ISO_RECORD_LENGTH];
+			UINTN name_length;
+
+			// The length byte is inside the buffer; the rest of the record
+			// must be too, and long enough to hold the name it claims.
+			if (record_length < ISO_RECORD_NAME + 1 || offset + record_length > ISO_SECTOR_SIZE ||
+				position + offset + record_length > directory->extent.size ||
+				ISO_RECORD_NAME + record[ISO_RECORD_NAME_LENGTH] > record_length) {
+				FreePool(buffer);
+				return EFI_VOLUME_CORRUPTED;
+			}
+
+			name_length = IsoRecordName(iso, record, path + directory->length + 1);
+			if (name_length > 0) {
+				UINTN length = directory->length + 1 + name_length;
+
+				// Later extents of a file split over several share its name; the
+				// first one is what we want.
+				if (!IsoIndexFind(iso, path, length) && !IsoIndexInsert(iso, path, length, record)) {
+					FreePool(buffer);
+					return EFI_OUT_OF_RESOURCES;
+				}
+			}
+
+			offset += record_length;
+		}
+	}
+
+	FreePool(buffer);
+	directory->indexed = TRUE;
+	return EFI_SUCCESS;
+}
+
+#ifdef __APPLE__
+	#pragma mark - Public interface
+#endif
+/* Looks for the "SP" entry that announces Rock Ridge in the root's "." record. */
+static VOID IsoDetectRockRidge(IsoImage *iso) {
+	UINT8 sector[ISO_SECTOR_SIZE];
+	UINT8 *record = sector, *su;
+
+	if (EFI_ERROR(iso->read(iso->context, iso->root->extent.offset, ISO_SECTOR_SIZE, sector))) {
+		return;
+	}
+
+	if (record[ISO_RECORD_LENGTH] < ISO_RECORD_NAME + 1 + 7 || record[ISO_RECORD_NAME_LENGTH] != 1) {
+		return;
+	}
+
+	su = record + ISO_RECORD_NAME + 1;
+	if (su[0] == 'S' && su[1] == 'P' && su[4] == 0xBE && su[5] == 0xEF) {
+		iso->naming = IsoNamingRockRidge;
+		iso->susp_skip = su[6];
+	}
+}
+
+/*
+ * Reads the volume descriptors and picks the directory tree to use: the
+ * primary one when it carries Rock Ridge names, otherwise the Joliet one if
+ * the image has it, and the plain primary tree as a last resort.
+ */
+EFI_STATUS IsoOpen(IsoImage *iso, IsoReadFunction read, VOID *context) {
+	UINT8 descriptor[ISO_SECTOR_SIZE];
+	UINT8 primary_root[34], joliet_root[34];
+	BOOLEAN have_primary = FALSE, have_joliet = FALSE;
+	UINTN sector;
+	EFI_STATUS err;
+
+	ZeroMem(iso, sizeof(IsoImage));
+	iso->read = read;
+	iso->context = context;
+	ArenaInitialize(&iso->arena, 16 * 1024);
+
+	for (sector = ISO_DESCRIPTOR_START; sector < ISO_DESCRIPTOR_LIMIT; sector++) {
+		err = read(context, (UINT64)sector * ISO_SECTOR_SIZE, ISO_SECTOR_SIZE, descriptor);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+
+		if (CompareMem(descriptor + 1, "CD001", 5) != 0 || descriptor[0] == ISO_DESCRIPTOR_TERMINATOR) {
+			break;
+		}
+
+		if (descriptor[0] == ISO_DESCRIPTOR_PRIMARY && !have_primary) {
+			iso->block_size = ReadLittleEndian16(descriptor + ISO_VD_BLOCK_SIZE);
+			CopyMem(primary_root, descriptor + ISO_VD_ROOT_RECORD, sizeof(primary_root));
+			have_primary = TRUE;
+		} else if (descriptor[0] == ISO_DESCRIPTOR_SUPPLEMENTARY && !have_joliet &&
+			descriptor[ISO_VD_ESCAPES] == '%' && descriptor[ISO_VD_ESCAPES + 1] == '/' &&
+			(descriptor[ISO_VD_ESCAPES + 2] == '@' || descriptor[ISO_VD_ESCAPES + 2] == 'C' ||
+			descriptor[ISO_VD_ESCAPES + 2] == 'E')) {
+			CopyMem(joliet_root, descriptor + ISO_VD_ROOT_RECORD, sizeof(joliet_root));
+			have_joliet = TRUE;
+		}
+	}
+
+	if (!have_primary || iso->block_size == 0) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	iso->root = IsoIndexInsert(iso, (CHAR8 *)"", 0, primary_root);
+	if (!iso->root) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	IsoDetectRockRidge(iso);
+	if (iso->naming != IsoNamingRockRidge && have_joliet) {
+		iso->root->extent.offset = (UINT64)ReadLittleEndian32(joliet_root + ISO_RECORD_EXTENT) * iso->block_size;
+		iso->root->extent.size = ReadLittleEndian32(joliet_root + ISO_RECORD_SIZE);
+		iso->naming = IsoNamingJoliet;
+	}
+	return EFI_SUCCESS;
+}
+
+VOID IsoClose(IsoImage *iso) {
+	ArenaRelease(&iso->arena);
+	ZeroMem(iso->buckets, sizeof(iso->buckets));
+	iso->root = NULL;
+}
+
+/* Resolves a '/' separated path, such as "/casper/vmlinuz", to its extent. */
+EFI_STATUS IsoLookup(IsoImage *iso, CHAR8 *path, IsoExtent *extent) {
+	CHAR8 key[ISO_MAX_PATH];
+	UINTN length = 0, walked = 0;
+	IsoIndexEntry *entry;
+	EFI_STATUS err;
+
+	// Normalise the path into the form the index uses: lower case, no empty
+	// components and no trailing slash.
+	while (*path) {
+		if (*path == '/') {
+			path++;
+			continue;
+		}
+
+		if (length + 1 >= ISO_MAX_PATH) {
+			return EFI_NOT_FOUND;
+		}
+		key[length++] = '/';
+		while (*path && *path != '/' && length < ISO_MAX_PATH) {
+			key[length++] = ToLower(*path++);
+		}
+	}
+
+	entry = IsoIndexFind(iso, key, length);
+
+	// Not seen yet: walk down from the root, indexing each directory on the
+	// way that has not been read before.
+	if (!entry) {
+		entry = iso->root;
+		while (walked < length) {
+			if (!entry->extent.directory) {
+				return EFI_NOT_FOUND;
+			}
+
+			if (!entry->indexed) {
+				err = IsoIndexDirectory(iso, entry);
+				if (EFI_ERROR(err)) {
+					return err;
+				}
+			}
+
+			do {
+				walked++;
+			} while (walked < length && key[walked] != '/');
+
+			entry = IsoIndexFind(iso, key, walked);
+			if (!entry) {
+				return EFI_NOT_FOUND;
+			}
+		}
+	}
+
+	*extent = entry->extent;
+	return EFI_SUCCESS;
+}
+
+EFI_STATUS IsoReadExtent(IsoImage *iso, IsoExtent *extent, UINT64 offset, UINTN size, VOID *buffer) {
+	if (offset > extent->size || size > extent->size - offset) {
+		return EFI_INVALID_PARAMETER;
+	}
+
+	return iso->read(iso->context, extent->offset + offset, size, buffer);
+}
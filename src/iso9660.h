@@ -0,0 +1,66 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _iso9660_h
+#define _iso9660_h
+
+#define ISO_SECTOR_SIZE 2048
+#define ISO_INDEX_BUCKETS 256
+
+/* Reads size bytes at the given byte offset of the image into buffer. */
+typedef EFI_STATUS (*IsoReadFunction)(VOID *context, UINT64 offset, UINTN size, VOID *buffer);
+
+/* A contiguous run of bytes inside the image: a file or a directory. */
+typedef struct IsoExtent {
+	UINT64 offset;
+	UINT64 size;
+	BOOLEAN directory;
+} IsoExtent;
+
+typedef enum IsoNaming {
+	IsoNamingPlain,
+	IsoNamingJoliet,
+	IsoNamingRockRidge,
+} IsoNaming;
+
+struct IsoIndexEntry;
+
+/*
+ * An open image. Directories are read at most once: the first lookup that
+ * passes through a directory adds all of its entries to a hash table keyed
+ * by their full lower-case path, and later lookups are answered from there.
+ */
+typedef struct IsoImage {
+	IsoReadFunction read;
+	VOID *context;
+	UINT16 block_size;
+	IsoNaming naming;
+	UINT8 susp_skip;
+	MemoryArena arena;
+	struct IsoIndexEntry *root;
+	struct IsoIndexEntry *buckets[ISO_INDEX_BUCKETS];
+} IsoImage;
+
+EFI_STATUS IsoFileReader(VOID *context, UINT64 offset, UINTN size, VOID *buffer);
+EFI_STATUS IsoOpen(IsoImage *iso, IsoReadFunction read, VOID *context);
+VOID IsoClose(IsoImage *iso);
+EFI_STATUS IsoLookup(IsoImage *iso, CHAR8 *path, IsoExtent *extent);
+EFI_STATUS IsoReadExtent(IsoImage *iso, IsoExtent *extent, UINT64 offset, UINTN size, VOID *buffer);
+
+#endif
@@ -0,0 +1,403 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Starts a Linux kernel straight out of the ISO file through its EFI stub,
+ * instead of chain-loading GRUB and letting it find the kernel a second time.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "arena.h"
+#include "ramdisk.h"
+#include "kernel.h"
+#include "iso9660.h"
+#include "disk.h"
+#include "utils.h"
+#include "distribution.h"
+#include "prefetch.h"
+
+#define LINUX_EFI_INITRD_MEDIA_GUID \
+	{ 0x5568e427, 0x68fc, 0x4f3d, { 0xac, 0x74, 0xca, 0x55, 0x52, 0x31, 0xcc, 0x68 } }
+#define EFI_LOAD_FILE2_PROTOCOL_GUID \
+	{ 0x4006c0c1, 0xfcb3, 0x403e, { 0x99, 0x6d, 0x4a, 0x6c, 0x87, 0x24, 0xe0, 0x6d } }
+
+struct _EFI_LOAD_FILE2_PROTOCOL;
+
+typedef EFI_STATUS (FIRMWARE_CALLBACK *EFI_LOAD_FILE2)(
+	struct _EFI_LOAD_FILE2_PROTOCOL *This,
+	EFI_DEVICE_PATH *FilePath,
+	BOOLEAN BootPolicy,
+	UINTN *BufferSize,
+	VOID *Buffer
+);
+
+typedef struct _EFI_LOAD_FILE2_PROTOCOL {
+	EFI_LOAD_FILE2 LoadFile;
+} EFI_LOAD_FILE2_PROTOCOL;
+
+/*
+ * The EFI stub (Linux 5.8 and later) asks for its initrd by locating a
+ * LoadFile2 protocol on this fixed vendor media device path.
+ */
+typedef struct {
+	VENDOR_DEVICE_PATH vendor;
+	EFI_DEVICE_PATH end;
+} __attribute__((packed)) InitrdDevicePath;
+
+/*
+ * Serves the initrd straight out of the ISO file into the buffer the stub
+ * allocates for it, so it is never held in memory twice. The start of it
+ * may already have been read while the menu was up; that part is copied.
+ */
+typedef struct {
+	EFI_LOAD_FILE2_PROTOCOL protocol;
+	EFI_FILE_HANDLE iso_file;
+	DiskImage disk;
+	IsoImage iso;
+	IsoExtent extent;
+	VOID *prefix;
+	UINTN prefix_size;
+	UINTN prefix_pages;
+} InitrdLoader;
+
+static EFI_GUID load_file2_guid = EFI_LOAD_FILE2_PROTOCOL_GUID;
+
+static InitrdDevicePath initrd_device_path = {
+	{ { MEDIA_DEVICE_PATH, MEDIA_VENDOR_DP, { sizeof(VENDOR_DEVICE_PATH), 0 } }, LINUX_EFI_INITRD_MEDIA_GUID },
+	{ END_DEVICE_PATH_TYPE, END_ENTIRE_DEVICE_PATH_SUBTYPE, { sizeof(EFI_DEVICE_PATH), 0 } },
+};
+
+static InitrdLoader initrd_loader;
+static EFI_HANDLE initrd_handle;
+
+static VOID InitrdReleasePrefix(InitrdLoader *loader) {
+	if (loader->prefix) {
+		uefi_call_wrapper(BS->FreePages, 2, (EFI_PHYSICAL_ADDRESS)(UINTN)loader->prefix, loader->prefix_pages);
+	}
+	loader->prefix = NULL;
+	loader->prefix_size = 0;
+	loader->prefix_pages = 0;
+}
+
+/* Closes the ISO file the loader reads from, and forgets what it held. */
+static VOID InitrdRelease(InitrdLoader *loader) {
+	InitrdReleasePrefix(loader);
+	if (loader->iso_file) {
+		IsoClose(&loader->iso);
+		DiskImageClose(&loader->disk);
+		uefi_call_wrapper(loader->iso_file->Close, 1, loader->iso_file);
+		loader->iso_file = NULL;
+	}
+}
+
+static EFI_STATUS FIRMWARE_CALLBACK InitrdLoadFile(EFI_LOAD_FILE2_PROTOCOL *This, EFI_DEVICE_PATH *FilePath,
+		BOOLEAN BootPolicy, UINTN *BufferSize, VOID *Buffer) {
+	InitrdLoader *loader = (InitrdLoader *)This;
+	UINTN size = loader->extent.size;
+	EFI_STATUS err;
+
+	if (BootPolicy) {
+		return EFI_UNSUPPORTED;
+	} else if (!BufferSize) {
+		return EFI_INVALID_PARAMETER;
+	} else if (!loader->iso_file) {
+		return EFI_NOT_FOUND;
+	}
+
+	if (!Buffer || *BufferSize < size) {
+		*BufferSize = size;
+		return EFI_BUFFER_TOO_SMALL;
+	}
+
+	if (loader->prefix_size) {
+		CopyMem(Buffer, loader->prefix, loader->prefix_size);
+	}
+	err = IsoReadExtent(&loader->iso, &loader->extent, loader->prefix_size, size - loader->prefix_size,
+		(UINT8 *)Buffer + loader->prefix_size);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	// The stub has its own copy now; should it ask again, it is read again.
+	InitrdReleasePrefix(loader);
+	*BufferSize = size;
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS InstallInitrdLoader(VOID) {
+	EFI_STATUS err;
+
+	initrd_loader.protocol.LoadFile = InitrdLoadFile;
+
+	// A second attempt only needs to point the existing protocol at new data.
+	if (initrd_handle) {
+		return EFI_SUCCESS;
+	}
+
+	err = uefi_call_wrapper(BS->InstallProtocolInterface, 4, &initrd_handle, &DevicePathProtocol,
+		EFI_NATIVE_INTERFACE, &initrd_device_path);
+	if (EFI_ERROR(err)) {
+		initrd_handle = NULL;
+		return err;
+	}
+
+	// A handle with only the device path would make the next attempt think
+	// it was all in place already.
+	err = uefi_call_wrapper(BS->InstallProtocolInterface, 4, &initrd_handle, &load_file2_guid,
+		EFI_NATIVE_INTERFACE, &initrd_loader.protocol);
+	if (EFI_ERROR(err)) {
+		uefi_call_wrapper(BS->UninstallProtocolInterface, 3, initrd_handle, &DevicePathProtocol,
+			&initrd_device_path);
+		initrd_handle = NULL;
+	}
+	return err;
+}
+
+/* Reads a whole file out of the image into freshly allocated pages. */
+static EFI_STATUS ReadFileFromISO(IsoImage *iso, CHAR8 *path, VOID **data, UINTN *size) {
+	EFI_PHYSICAL_ADDRESS address;
+	IsoExtent extent;
+	UINTN pages;
+	EFI_STATUS err;
+
+	err = IsoLookup(iso, path, &extent);
+	if (EFI_ERROR(err)) {
+		return err;
+	} else if (extent.directory || extent.size == 0) {
+		return EFI_NOT_FOUND;
+	}
+
+	pages = EFI_SIZE_TO_PAGES(extent.size);
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, pages, &address);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	err = IsoReadExtent(iso, &extent, 0, extent.size, (VOID *)(UINTN)address);
+	if (EFI_ERROR(err)) {
+		uefi_call_wrapper(BS->FreePages, 2, address, pages);
+		return err;
+	}
+
+	*data = (VOID *)(UINTN)address;
+	*size = extent.size;
+	return EFI_SUCCESS;
+}
+
+/*
+ * Finds the next space-separated word of a command line, returning its
+ * length; *word is left pointing at it.
+ */
+static UINTN KernelParameterNext(CHAR16 **word) {
+	UINTN length = 0;
+
+	while (**word == ' ') {
+		(*word)++;
+	}
+	while ((*word)[length] && (*word)[length] != ' ') {
+		length++;
+	}
+	return length;
+}
+
+static BOOLEAN KernelParameterIs(CHAR16 *word, UINTN length, CHAR16 *name) {
+	return StrLen(name) == length && CompareMem(word, name, length * sizeof(CHAR16)) == 0;
+}
+
+BOOLEAN KernelParameterPresent(CHAR16 *params, CHAR16 *name) {
+	UINTN length;
+
+	for (; (length = KernelParameterNext(&params)) > 0; params += length) {
+		if (KernelParameterIs(params, length, name)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/* Appends the words of params to out, leaving out any that equal skip. */
+static VOID KernelParametersAppend(CHAR16 *out, CHAR16 *params, CHAR16 *skip) {
+	UINTN length;
+
+	out += StrLen(out);
+	for (; (length = KernelParameterNext(&params)) > 0; params += length) {
+		if (skip && KernelParameterIs(params, length, skip)) {
+			continue;
+		}
+		*out++ = ' ';
+		CopyMem(out, params, length * sizeof(CHAR16));
+		out += length;
+	}
+	*out = '\0';
+}
+
+/* Appends a firmware path the way the live system names files, with '/'. */
+static VOID KernelParametersAppendPath(CHAR16 *out, CHAR16 *path) {
+	out += StrLen(out);
+	for (; *path; path++) {
+		*out++ = *path == '\\' ? '/' : *path;
+	}
+	*out = '\0';
+}
+
+/*
+ * Undoes LoadKernelFromISO() when the kernel it loaded is not started, or
+ * fails to start: closes the ISO file and takes the initrd off the fixed
+ * device path, where it would otherwise be found by whatever is started next.
+ */
+VOID KernelRelease(VOID) {
+	InitrdRelease(&initrd_loader);
+	if (initrd_handle) {
+		uefi_call_wrapper(BS->UninstallProtocolInterface, 3, initrd_handle, &load_file2_guid,
+			&initrd_loader.protocol);
+		uefi_call_wrapper(BS->UninstallProtocolInterface, 3, initrd_handle, &DevicePathProtocol,
+			&initrd_device_path);
+		initrd_handle = NULL;
+	}
+}
+
+/*
+ * Loads the kernel named by the boot option out of its ISO file, which is
+ * \efi\boot\boot.iso unless discovery found it elsewhere, publishes its
+ * initrd through LoadFile2 and sets the kernel command line. device and
+ * root_dir are the volume the ISO file is on. On success the image is ready
+ * to be passed to StartImage; the ISO file stays open until then, for the
+ * initrd to be read from. With a ram_disk, both come from the copy in
+ * memory, and the kernel is pointed at it.
+ */
+EFI_STATUS LoadKernelFromISO(EFI_HANDLE parent_image, EFI_HANDLE device, EFI_FILE_HANDLE root_dir,
+		LinuxBootOption *option, CHAR16 *params, RamDisk *ram_disk, EFI_HANDLE *image) {
+	InitrdLoader *loader = &initrd_loader;
+	EFI_LOADED_IMAGE *loaded_image;
+	EFI_DEVICE_PATH *path;
+	PrefetchedFiles prefetched;
+	VOID *kernel;
+	UINTN kernel_size, length;
+	CHAR8 *family_params;
+	CHAR16 *command_line, *iso_path, ram_params[64] = L"";
+	EFI_STATUS err;
+
+	if (!option->kernel_path || !option->initrd_path) {
+		return EFI_INVALID_PARAMETER;
+	}
+
+	iso_path = option->iso_path ? option->iso_path : L"\\efi\\boot\\boot.iso";
+	InitrdRelease(loader);
+	err = uefi_call_wrapper(root_dir->Open, 5, root_dir, &loader->iso_file, iso_path, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		loader->iso_file = NULL;
+		return err;
+	}
+
+	// Read around the firmware's FAT driver where we can.
+	if (ram_disk) {
+		err = IsoOpen(&loader->iso, RamDiskReader, ram_disk);
+	} else if (!EFI_ERROR(DiskImageOpen(&loader->disk, device, iso_path, loader->iso_file))) {
+		err = IsoOpen(&loader->iso, DiskImageReader, &loader->disk);
+	} else {
+		err = IsoOpen(&loader->iso, IsoFileReader, loader->iso_file);
+	}
+	if (!EFI_ERROR(err)) {
+		err = IsoLookup(&loader->iso, option->initrd_path, &loader->extent);
+	}
+	if (!EFI_ERROR(err) && (loader->extent.directory || loader->extent.size == 0)) {
+		err = EFI_NOT_FOUND;
+	}
+
+	// Most of the kernel, and the start of the initrd, may already have been
+	// read while the menu was up.
+	if (!EFI_ERROR(err) && !EFI_ERROR(PrefetchTake(option, &prefetched))) {
+		kernel = prefetched.kernel;
+		kernel_size = prefetched.kernel_size;
+		loader->prefix = prefetched.initrd;
+		loader->prefix_size = prefetched.initrd_read;
+		loader->prefix_pages = prefetched.initrd_pages;
+	} else if (!EFI_ERROR(err)) {
+		err = ReadFileFromISO(&loader->iso, option->kernel_path, &kernel, &kernel_size);
+	}
+
+	if (!EFI_ERROR(err)) {
+		err = InstallInitrdLoader();
+		if (EFI_ERROR(err)) {
+			uefi_call_wrapper(BS->FreePages, 2, (EFI_PHYSICAL_ADDRESS)(UINTN)kernel, EFI_SIZE_TO_PAGES(kernel_size));
+		}
+	}
+	// Every failure takes the initrd off its device path as well, so that
+	// GRUB, if it is started instead, can publish its own there.
+	if (EFI_ERROR(err)) {
+		KernelRelease();
+		return err;
+	}
+
+	// The firmware copies the image, so the kernel buffer can go right away.
+	path = FileDevicePath(device, iso_path);
+	err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, parent_image, path, kernel, kernel_size, image);
+	uefi_call_wrapper(BS->FreePages, 2, (EFI_PHYSICAL_ADDRESS)(UINTN)kernel, EFI_SIZE_TO_PAGES(kernel_size));
+	FreePool(path);
+	if (EFI_ERROR(err)) {
+		KernelRelease();
+		return err;
+	}
+
+	// Compose the command line: what the live system needs to find the ISO,
+	// followed by the options the user picked. One whose ISO is in memory
+	// already finds it there, and has no reason to copy it there again; if
+	// the firmware could not describe the copy to it, the memmap option does.
+	// One found by discovery is told the file's name.
+	if (!option->distro_family) {
+		family_params = (CHAR8 *)"";
+	} else if (ram_disk) {
+		family_params = KernelParametersForRamDisk(option->distro_family);
+	} else if (option->iso_path) {
+		family_params = KernelParametersForISOFile(option->distro_family);
+	} else {
+		family_params = KernelParametersForDistributionName(option->distro_family);
+	}
+	if (ram_disk && !ram_disk->device_path) {
+		SPrint(ram_params, sizeof(ram_params), L" memmap=0x%lx!0x%lx", ram_disk->pages * EFI_PAGE_SIZE,
+			ram_disk->base);
+	}
+	length = strlena(family_params) + StrLen(iso_path) + StrLen(ram_params) + 1 + StrLen(params) + 1;
+	command_line = AllocatePool(length * sizeof(CHAR16));
+	if (!command_line) {
+		uefi_call_wrapper(BS->UnloadImage, 1, *image);
+		KernelRelease();
+		return EFI_OUT_OF_RESOURCES;
+	}
+	SPrint(command_line, length * sizeof(CHAR16), L"%a", family_params);
+	if (option->iso_path && !ram_disk && family_params[0]) {
+		KernelParametersAppendPath(command_line, iso_path);
+	}
+	StrCat(command_line, ram_params);
+	KernelParametersAppend(command_line, params, ram_disk ? L"toram" : NULL);
+
+	err = uefi_call_wrapper(BS->HandleProtocol, 3, *image, &LoadedImageProtocol, (VOID **)&loaded_image);
+	if (EFI_ERROR(err)) {
+		FreePool(command_line);
+		uefi_call_wrapper(BS->UnloadImage, 1, *image);
+		KernelRelease();
+		return err;
+	}
+
+	loaded_image->LoadOptions = command_line;
+	loaded_image->LoadOptionsSize = StrSize(command_line);
+	return EFI_SUCCESS;
+}
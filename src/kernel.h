@@ -0,0 +1,28 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _kernel_h
+#define _kernel_h
+
+EFI_STATUS LoadKernelFromISO(EFI_HANDLE parent_image, EFI_HANDLE device, EFI_FILE_HANDLE root_dir,
+	LinuxBootOption *option, CHAR16 *params, RamDisk *ram_disk, EFI_HANDLE *image);
+VOID KernelRelease(VOID);
+BOOLEAN KernelParameterPresent(CHAR16 *params, CHAR16 *name);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Everything the loader has to say goes through here. It is always kept in
+ * memory, so that it can be handed to the booted system in a variable, and
+ * it is shown on the console unless we are running headless, in which case
+ * nobody is there to read it and we do not wait for anybody to.
+ *
+ * Each firmware console call is expensive, especially on Macs, where the
+ * text is drawn through the graphics adapter. Console output is therefore
+ * collected and written in one OutputString call per batch: when the buffer
+ * fills, when the color changes, and whenever someone is about to look at
+ * the screen (see LogFlush).
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "utils.h"
+#include "convert.h"
+#include "log.h"
+
+#define LOG_DEFAULT_ATTRIBUTE (EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK)
+
+static CHAR8 log_buffer[LOG_BUFFER_SIZE];
+static UINTN log_length;
+static BOOLEAN log_line_start = TRUE;
+static BOOLEAN log_headless = ENTERPRISE_HEADLESS;
+static const EFI_GUID *log_vendor;
+
+static CHAR16 console_buffer[LOG_CONSOLE_BUFFER_SIZE];
+static UINTN console_length;
+static UINTN console_attribute = LOG_DEFAULT_ATTRIBUTE;
+
+static CHAR8 *log_level_prefixes[] = {
+	[LOG_LEVEL_ERROR] = (CHAR8 *)"E ",
+	[LOG_LEVEL_WARNING] = (CHAR8 *)"W ",
+	[LOG_LEVEL_NOTICE] = (CHAR8 *)"N ",
+	[LOG_LEVEL_INFO] = (CHAR8 *)"I ",
+	[LOG_LEVEL_DEBUG] = (CHAR8 *)"D ",
+};
+
+static CHAR8 *log_tag_names[] = {
+	[LogTagMain] = (CHAR8 *)"main: ",
+	[LogTagMenu] = (CHAR8 *)"menu: ",
+	[LogTagConfig] = (CHAR8 *)"config: ",
+	[LogTagVerify] = (CHAR8 *)"verify: ",
+	[LogTagKernel] = (CHAR8 *)"kernel: ",
+	[LogTagDisk] = (CHAR8 *)"disk: ",
+	[LogTagDiscovery] = (CHAR8 *)"discovery: ",
+};
+
+static UINTN log_level_attributes[] = {
+	[LOG_LEVEL_ERROR] = EFI_RED|EFI_BACKGROUND_BLACK,
+	[LOG_LEVEL_WARNING] = EFI_YELLOW|EFI_BACKGROUND_BLACK,
+	[LOG_LEVEL_NOTICE] = EFI_YELLOW|EFI_BACKGROUND_BLACK,
+	[LOG_LEVEL_INFO] = LOG_DEFAULT_ATTRIBUTE,
+	[LOG_LEVEL_DEBUG] = LOG_DEFAULT_ATTRIBUTE,
+};
+
+VOID LogInitialize(const EFI_GUID *vendor) {
+	log_vendor = vendor;
+	log_length = 0;
+	log_line_start = TRUE;
+	console_length = 0;
+}
+
+VOID LogSetHeadless(BOOLEAN headless) {
+	if (headless) {
+		LogFlush();
+	}
+	log_headless = headless;
+}
+
+BOOLEAN LogHeadless(VOID) {
+	return log_headless;
+}
+
+/*
+ * Whether there is a console that someone could be watching. Firmware with
+ * no display or serial port attached reports no text modes at all.
+ */
+static BOOLEAN LogConsoleAttached(VOID) {
+	return ST->ConOut && ST->ConOut->Mode && ST->ConOut->Mode->MaxMode > 0;
+}
+
+/*
+ * Writes out whatever console output has been collected, in its color.
+ */
+VOID LogFlush(VOID) {
+	if (console_length == 0) {
+		return;
+	}
+
+	console_buffer[console_length] = '\0';
+	if (console_attribute != LOG_DEFAULT_ATTRIBUTE) {
+		uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, console_attribute);
+	}
+	uefi_call_wrapper(ST->ConOut->OutputString, 2, ST->ConOut, console_buffer);
+	if (console_attribute != LOG_DEFAULT_ATTRIBUTE) {
+		uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, LOG_DEFAULT_ATTRIBUTE);
+	}
+	console_length = 0;
+}
+
+/*
+ * Adds a message to the console buffer, turning each line feed into the
+ * carriage return and line feed that the console expects.
+ */
+static VOID LogConsoleAppend(CHAR16 *message, UINTN length, UINTN attribute) {
+	UINTN i;
+
+	if (attribute != console_attribute) {
+		LogFlush();
+		console_attribute = attribute;
+	}
+
+	for (i = 0; i < length; i++) {
+		// Room for a carriage return, the character and the terminator.
+		if (console_length + 3 > LOG_CONSOLE_BUFFER_SIZE) {
+			LogFlush();
+		}
+		if (message[i] == '\n') {
+			console_buffer[console_length++] = '\r';
+		}
+		console_buffer[console_length++] = message[i];
+	}
+}
+
+static VOID LogAppend(CHAR8 *text, UINTN length) {
+	if (length > LOG_BUFFER_SIZE - 1 - log_length) {
+		length = LOG_BUFFER_SIZE - 1 - log_length;
+	}
+	CopyMem(log_buffer + log_length, text, length);
+	log_length += length;
+}
+
+/*
+ * Records a message at the given level. In the saved log every line starts
+ * with the level and the tag; on the console only the message is shown, in
+ * the color for its level. Once the saved log is full, later messages are
+ * only displayed.
+ */
+VOID LogMessage(UINTN level, LogTag tag, CHAR16 *fmt, ...) {
+	CHAR16 message[256];
+	VA_LIST args;
+	UINTN length;
+
+	VA_START(args, fmt);
+	length = VSPrint(message, sizeof(message), fmt, args);
+	VA_END(args);
+
+	if (log_line_start) {
+		LogAppend(log_level_prefixes[level], 2);
+		LogAppend(log_tag_names[tag], strlena(log_tag_names[tag]));
+	}
+	if (log_length < LOG_BUFFER_SIZE - 1) {
+		log_length += Utf16ToUtf8(message, length, log_buffer + log_length, LOG_BUFFER_SIZE - log_length);
+	}
+	log_line_start = length > 0 && message[length - 1] == '\n';
+
+	if (!log_headless) {
+		LogConsoleAppend(message, length, log_level_attributes[level]);
+	}
+}
+
+/*
+ * Gives the user time to read the screen. Headless, there is no user, so
+ * this does nothing.
+ */
+VOID LogPause(UINTN microseconds) {
+	LogFlush();
+	if (!log_headless && LogConsoleAttached()) {
+		uefi_call_wrapper(BS->Stall, 1, microseconds);
+	}
+}
+
+/*
+ * Called when booting has failed, before we give up. The log is saved in a
+ * non-volatile variable so that it survives the reset that usually follows,
+ * and if a console is attached, the messages stay up long enough to be read;
+ * headless, they are shown now, since they have not been so far.
+ */
+VOID LogFailurePause(UINTN microseconds) {
+	LogFlush();
+	LogPublish(TRUE);
+	if (!LogConsoleAttached()) {
+		return;
+	}
+
+	if (log_headless) {
+		CHAR16 *text = ASCIItoUTF16(log_buffer, log_length, NULL);
+		if (text) {
+			Print(L"%s", text);
+			FreePool(text);
+		}
+	}
+	uefi_call_wrapper(BS->Stall, 1, microseconds);
+}
+
+/*
+ * Hands the log to the booted system, or to the next boot after a failure.
+ * The failure log holds only the last lines, which say what went wrong, and
+ * is only rewritten when it differs, to spare the flash. A boot that gets
+ * this far has succeeded, so whatever an earlier failure left is removed.
+ */
+EFI_STATUS LogPublish(BOOLEAN failed) {
+	UINTN start = 0, i;
+	EFI_STATUS err;
+
+	if (!log_vendor) {
+		return EFI_NOT_READY;
+	}
+
+	if (failed) {
+		// Start at a line boundary, which is never inside a character.
+		if (log_length > LOG_FAILURE_TAIL_SIZE) {
+			start = log_length - LOG_FAILURE_TAIL_SIZE;
+			for (i = start; i < log_length; i++) {
+				if (log_buffer[i] == '\n') {
+					start = i + 1;
+					break;
+				}
+			}
+		}
+		return efi_set_variable_if_changed(log_vendor, LOG_FAILURE_VARIABLE_NAME, log_buffer + start,
+			log_length - start, TRUE);
+	}
+
+	err = efi_delete_variable(log_vendor, LOG_FAILURE_VARIABLE_NAME);
+	if (EFI_ERROR(err) && err != EFI_NOT_FOUND) {
+		LogWarning(LogTagMain, L"Could not clear the last failure's log: %r\n", err);
+	}
+	return efi_set_variable(log_vendor, LOG_VARIABLE_NAME, log_buffer, log_length, FALSE);
+}
@@ -0,0 +1,99 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _log_h
+#define _log_h
+
+// Build with -DENTERPRISE_HEADLESS=1 (make HEADLESS=1) to start up headless
+// before the configuration file has been read.
+#ifndef ENTERPRISE_HEADLESS
+	#define ENTERPRISE_HEADLESS 0
+#endif
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARNING 1
+#define LOG_LEVEL_NOTICE 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are compiled out entirely, format strings and
+// arguments included. Set it with make LOG_LEVEL=4 for a debugging build.
+#ifndef LOG_LEVEL
+	#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// A discarded message is still type-checked, and so keeps its arguments in
+// use, but the call and its strings are dead code that is never emitted.
+#define LOG_DISCARD(tag, ...) do { if (0) LogMessage(0, tag, __VA_ARGS__); } while (0)
+
+#define LOG_VARIABLE_NAME L"Enterprise_Log"
+#define LOG_FAILURE_VARIABLE_NAME L"Enterprise_FailureLog"
+#define LOG_BUFFER_SIZE (16 * 1024)
+// Mac NVRAM is small, so only the end of the log is kept after a failure.
+#define LOG_FAILURE_TAIL_SIZE 1536
+#define LOG_CONSOLE_BUFFER_SIZE 2048
+
+// The part of the loader a message comes from, named in the saved log.
+typedef enum LogTag {
+	LogTagMain,
+	LogTagMenu,
+	LogTagConfig,
+	LogTagVerify,
+	LogTagKernel,
+	LogTagDisk,
+	LogTagDiscovery,
+	LogTagCount
+} LogTag;
+
+VOID LogInitialize(const EFI_GUID *vendor);
+VOID LogSetHeadless(BOOLEAN headless);
+BOOLEAN LogHeadless(VOID);
+VOID LogMessage(UINTN level, LogTag tag, CHAR16 *fmt, ...);
+VOID LogFlush(VOID);
+VOID LogPause(UINTN microseconds);
+VOID LogFailurePause(UINTN microseconds);
+EFI_STATUS LogPublish(BOOLEAN failed);
+
+#define LogError(tag, ...) LogMessage(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_LEVEL_WARNING
+	#define LogWarning(tag, ...) LogMessage(LOG_LEVEL_WARNING, tag, __VA_ARGS__)
+#else
+	#define LogWarning(tag, ...) LOG_DISCARD(tag, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_NOTICE
+	#define LogNotice(tag, ...) LogMessage(LOG_LEVEL_NOTICE, tag, __VA_ARGS__)
+#else
+	#define LogNotice(tag, ...) LOG_DISCARD(tag, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+	#define LogInfo(tag, ...) LogMessage(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+	#define LogInfo(tag, ...) LOG_DISCARD(tag, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+	#define LogDebug(tag, ...) LogMessage(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+	#define LogDebug(tag, ...) LOG_DISCARD(tag, __VA_ARGS__)
+#endif
+
+#endif
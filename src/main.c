@@ -21,8 +21,21 @@
 
 #include "main.h"
 #include "menu.h"
+#include "arena.h"
+#include "iso9660.h"
 #include "utils.h"
-#include "distribution.h"
+#include "config.h"
+#include "discovery.h"
+#include "timing.h"
+#include "ramdisk.h"
+#include "kernel.h"
+#include "sha256.h"
+#include "snapshot.h"
+#include "verify.h"
+#include "handoff.h"
+#include "plan.h"
+#include "prefetch.h"
+#include "log.h"
 #define banner L"Welcome to Enterprise! - Version %d.%d.%d\n"
 
 static const EFI_GUID enterprise_variable_guid = {0x4a67b082, 0x0a4c, 0x41cf, {0xb6, 0xc7, 0x44, 0x0b, 0x29, 0xbb, 0x8c, 0x4f}};
@@ -32,212 +45,457 @@ static const EFI_GUID grub_variable_guid = {0x8BE4DF61, 0x93CA, 0x11d2, {0xAA, 0
 #define VERSION_MINOR 2
 #define VERSION_PATCH 1
 
-static BootableLinuxDistro* ReadConfigurationFile(const CHAR16 *name);
+#define LAST_BOOT_VARIABLE_NAME L"Enterprise_LastBoot"
+#define LAST_BOOT_SIGNATURE 0x424C4E45 // "ENLB"
+#define LAST_BOOT_VERSION 2
+
+/*
+ * What was booted last time, kept in a non-volatile variable so that the
+ * menu can select it, or boot it again by itself once the timeout runs out.
+ * The entry is remembered by name, which survives entries being added to or
+ * removed from the configuration file.
+ */
+typedef struct LastBootRecord {
+	UINT32 signature;
+	UINT16 version;
+	UINT16 direct;
+	CHAR16 options[LAST_BOOT_OPTIONS_LENGTH];
+	CHAR8 entry[]; // NUL-terminated.
+} LastBootRecord;
+
+static EFI_STATUS ReadConfigurationFile(const CHAR16 *name, MemoryArena *arena,
+	ConfigurationSettings *settings, BootEntryTable *table);
+static EFI_STATUS ReadBootPlan(const CHAR16 *name, const CHAR16 *source_name, MemoryArena *arena,
+	ConfigurationSettings *settings, BootEntryTable *table);
 static EFI_STATUS console_text_mode(VOID);
+static VOID RememberBootSelection(LinuxBootOption *entry, CHAR16 *params, BOOLEAN direct, MemoryArena *arena);
+static EFI_STATUS LoadLastSelection(UINTN *entry, CHAR16 *options, BOOLEAN *direct);
 
 static EFI_LOADED_IMAGE *this_image = NULL;
 static EFI_FILE *root_dir;
 
 static EFI_HANDLE global_image;
+static DirectorySnapshot boot_files;
+
+// The configuration file is read once, before the menu is shown; the entries
+// stay in their own arena until we hand over to the next stage.
+static MemoryArena config_arena;
+static BootEntryTable boot_entries;
+static ConfigurationSettings settings = { .headless = ENTERPRISE_HEADLESS };
 
 /* entry function for EFI */
 EFI_STATUS efi_main(EFI_HANDLE image_handle, EFI_SYSTEM_TABLE *systab) {
 	EFI_STATUS err; // Define an error variable.
 	
+	TimingMark(BootPhaseEntry);
 	InitializeLib(image_handle, systab); // Initialize EFI.
+	LogInitialize(&enterprise_variable_guid);
+	TimingMark(BootPhaseInitializeLib);
 	console_text_mode(); // Put the console into text mode. If we don't do that, the image of the Apple
 						// boot manager will remain on the screen and the user won't see any output
 						// from the program.
+	TimingMark(BootPhaseConsoleTextMode);
 	global_image = image_handle;
 	
 	err = uefi_call_wrapper(BS->HandleProtocol, 3, image_handle, &LoadedImageProtocol, (void *)&this_image);
 	if (EFI_ERROR(err)) {
-		Print(L"Error: could not find loaded image: %d\n", err);
-		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		LogError(LogTagMain, L"Error: could not find loaded image: %d\n", err);
+		LogFailurePause(3 * 1000 * 1000);
 		return err;
 	}
 	
 	root_dir = LibOpenRoot(this_image->DeviceHandle);
 	if (!root_dir) {
-		Print(L"Unable to open root directory.\n");
-		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		LogError(LogTagMain, L"Unable to open root directory.\n");
+		LogFailurePause(3 * 1000 * 1000);
 		return EFI_LOAD_ERROR;
 	}
 	
+	// List the root and \efi\boot once; every question about the files in
+	// them is answered from this, instead of opening each file in turn.
+	SnapshotInitialize(&boot_files);
+	SnapshotAddDirectory(&boot_files, root_dir, L"\\");
+	SnapshotAddDirectory(&boot_files, root_dir, L"\\efi\\boot");
+	TimingMark(BootPhaseOpenRoot);
+	
 	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK); // Set the text color.
 	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
-	Print(banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH); // Print the welcome information.
+	LogInfo(LogTagMain, banner, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH); // Print the welcome information.
 	uefi_call_wrapper(ST->ConIn->Reset, 2, ST->ConIn, FALSE);
 	uefi_call_wrapper(ST->ConOut->EnableCursor, 2, ST->ConOut, FALSE); // Disable display of the cursor.
 	
-	BOOLEAN can_continue = TRUE;
-	LinuxBootOption *result;
+	BOOLEAN can_continue = TRUE, have_iso;
 	
 	// Check to make sure that we have our configuration file and GRUB bootloader.
-	if (!FileExists(root_dir, L"\\efi\\boot\\.MLUL-Live-USB")) {
-		DisplayErrorText(L"Error: can't find configuration file.\n");
-	} else {
-		/*result = ReadConfigurationFile(L"\\efi\\boot\\.MLUL-Live-USB");
-		if (!result) {
-			can_continue = FALSE;
-		}*/
+	if (!SnapshotFileExists(&boot_files, L"\\efi\\boot\\.MLUL-Live-USB")) {
+		LogError(LogTagMain, L"Error: can't find configuration file.\n");
 	}
 	
-	if (!FileExists(root_dir, L"\\efi\\boot\\boot.efi")) {
-		DisplayErrorText(L"Error: can't find GRUB bootloader!.\n");
+	if (!SnapshotFileExists(&boot_files, L"\\efi\\boot\\boot.efi")) {
+		LogError(LogTagMain, L"Error: can't find GRUB bootloader!.\n");
 		can_continue = FALSE;
 	}
 	
-	if (!FileExists(root_dir, L"\\efi\\boot\\boot.iso")) {
-		DisplayErrorText(L"Error: can't find ISO file to boot!.\n");
+	// Without boot.iso, there is only what discovery finds to boot.
+	have_iso = SnapshotFileExists(&boot_files, L"\\efi\\boot\\boot.iso");
+	TimingMark(BootPhaseFileChecks);
+	
+	// A parsing error is reported when the user tries to boot, as before. A
+	// compiled plan saves parsing the file at all, as long as it is current.
+	ArenaInitialize(&config_arena, 0);
+	if (can_continue && SnapshotFileExists(&boot_files, L"\\efi\\boot\\.MLUL-Live-USB")) {
+		err = ReadBootPlan(BOOT_PLAN_FILE_NAME, L"\\efi\\boot\\.MLUL-Live-USB", &config_arena,
+			&settings, &boot_entries);
+		if (EFI_ERROR(err)) {
+			ReadConfigurationFile(L"\\efi\\boot\\.MLUL-Live-USB", &config_arena, &settings, &boot_entries);
+		}
+		LogSetHeadless(settings.headless);
+	}
+	TimingMark(BootPhaseConfigParse);
+	
+	// The configured entries all boot boot.iso. ISO files found elsewhere are
+	// offered after them.
+	if (!have_iso) {
+		boot_entries.count = 0;
+	}
+	if (can_continue && settings.discover) {
+		err = DiscoverISOFiles(&enterprise_variable_guid, settings.discover, this_image->DeviceHandle,
+			&config_arena, &boot_entries);
+		if (EFI_ERROR(err) && err != EFI_NOT_FOUND) {
+			LogWarning(LogTagDiscovery, L"Could not look for ISO files: %r\n", err);
+		}
+		TimingMark(BootPhaseDiscovery);
+	}
+	if (!have_iso && boot_entries.count == 0) {
+		LogError(LogTagMain, L"Error: can't find ISO file to boot!.\n");
 		can_continue = FALSE;
 	}
 	
 	// Check if there is a persistence file present.
 	// TODO: Support distributions other than Ubuntu.
-	/*if (FileExists(root_dir, L"\\casper-rw") &&
-		strcmpa((CHAR8 *)"Ubuntu", result->distro_family) == 0 &&
+	/*if (SnapshotFileExists(&boot_files, L"\\casper-rw") &&
+		strcmpa((CHAR8 *)"Ubuntu", boot_entries.entries[0].distro_family) == 0 &&
 		can_continue) {
-		DisplayColoredText(L"Found a persistence file! You can enable persistence by " \
+		LogNotice(LogTagMain, L"Found a persistence file! You can enable persistence by " \
 							"selecting it in the Modify Boot Settings screen.\n");
 	}*/
 	
-	// Display the menu where the user can select what they want to do.
-	if (can_continue) {
-		DisplayMenu();
+	// Display the menu where the user can select what they want to do. With
+	// nobody there to choose, boot whatever was chosen last.
+	if (can_continue && settings.headless) {
+		BootLastSelection();
+		LogFailurePause(3 * 1000 * 1000);
+		return EFI_LOAD_ERROR;
+	} else if (can_continue) {
+		UINTN selected = 0;
+		LoadLastSelection(&selected, NULL, NULL);
+		// The menu keeps the prefetcher pointed at the selected entry, so its
+		// kernel and initrd are read while the user makes up their mind.
+		PrefetchInitialize(this_image->DeviceHandle, root_dir);
+		DisplayMenu(&boot_entries, selected, settings.timeout);
 	} else {
-		Print(L"Cannot continue because core files are missing. Restarting...\n");
-		uefi_call_wrapper(BS->Stall, 1, 1000 * 1000);
+		LogError(LogTagMain, L"Cannot continue because core files are missing. Restarting...\n");
+		LogFailurePause(1000 * 1000);
 		return EFI_LOAD_ERROR;
 	}
 	
 	return EFI_SUCCESS;
 }
 
-EFI_STATUS BootLinuxWithOptions(CHAR16 *params) {
+EFI_STATUS BootLinuxWithOptions(UINTN entry, CHAR16 *params, BOOLEAN direct) {
 	EFI_STATUS err;
-	EFI_HANDLE image;
+	EFI_HANDLE image = NULL;
 	EFI_DEVICE_PATH *path;
+	EFI_HANDLE iso_device = this_image->DeviceHandle;
+	EFI_FILE_HANDLE iso_root = root_dir;
+	CHAR16 *iso_path = L"\\efi\\boot\\boot.iso";
+	MemoryArena arena;
+	RamDisk ram_disk;
+	UINT8 expected[SHA256_DIGEST_SIZE];
+	BOOLEAN verify = FALSE;
+	BOOLEAN to_ram = KernelParameterPresent(params, L"toram");
 	
-	CHAR8 *sized_str = UTF16toASCII(params, StrLen(params) + 1);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_LinuxBootOptions", sized_str,
-		sizeof(sized_str[0]) * strlena(sized_str) + 1, FALSE);
+	// Everything allocated while preparing the boot lives in one arena, which
+	// is given back in a single step before control passes to the next stage.
+	ArenaInitialize(&arena, 0);
 	
+	// From here on the reads that matter are ours: the hash and the copy to
+	// memory go through the whole image, and background reads would only
+	// make the device seek back and forth between the two.
+	PrefetchStop();
 	
-	BootableLinuxDistro *root = ReadConfigurationFile(L"\\efi\\boot\\.MLUL-Live-USB");
-	if (!root) {
-		DisplayErrorText(L"Error: configuration file parsing error.\n");
+	if (boot_entries.count == 0) {
+		LogError(LogTagMain, L"Error: configuration file parsing error.\n");
+		ArenaRelease(&arena);
 		return EFI_LOAD_ERROR;
+	} else if (entry >= boot_entries.count) {
+		LogError(LogTagMain, L"Error: there is no boot entry %d.\n", entry + 1);
+		ArenaRelease(&arena);
+		return EFI_INVALID_PARAMETER;
+	}
+	
+	LinuxBootOption *option = &boot_entries.entries[entry];
+	LogDebug(LogTagMain, L"Booting entry %d of %d: %a\n", entry + 1, boot_entries.count, option->name);
+	
+	// GRUB only knows to look for boot.iso, so an ISO file found by discovery
+	// is always booted directly, from the volume it was found on.
+	if (option->iso_path) {
+		iso_device = option->iso_device;
+		iso_path = option->iso_path;
+		iso_root = LibOpenRoot(iso_device);
+		if (!iso_root) {
+			LogError(LogTagMain, L"Error: cannot open the volume %s is on.\n", iso_path);
+			ArenaRelease(&arena);
+			return EFI_NOT_FOUND;
+		}
+		direct = TRUE;
 	}
 	
-	BootableLinuxDistro *conductor = root;
-	int iteratorIndex = 0;
-	while ( conductor != NULL ) {
-    	conductor = conductor->next;
-    	
-    	Print(L"%d %s\n", (iteratorIndex + 1), conductor->bootOption->name);
-    	
-    	iteratorIndex++;
+	// Only a direct boot can use what was prefetched; GRUB reads the files
+	// itself, and should have the bus and the memory to itself.
+	if (!direct && !to_ram) {
+		PrefetchRelease();
 	}
-	uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
-	/*CHAR8 *kernel_path = boot_params->kernel_path;
-	CHAR8 *initrd_path = boot_params->initrd_path;
-	CHAR8 *boot_folder = boot_params->boot_folder;
-	efi_set_variable(&grub_variable_guid, L"Enterprise_LinuxKernelPath", kernel_path,
-		sizeof(kernel_path[0]) * strlena(kernel_path) + 1, FALSE);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_InitRDPath", initrd_path,
-		sizeof(initrd_path[0]) * strlena(initrd_path) + 1, FALSE);
-	efi_set_variable(&grub_variable_guid, L"Enterprise_BootFolder", boot_folder,
-		sizeof(boot_folder[0]) * strlena(boot_folder) + 1, FALSE);*/
+	
+	RememberBootSelection(option, params, direct, &arena);
+	
+	// Everything GRUB needs goes over in one packed variable, with the command
+	// line also on its own where older GRUB configurations look for it, and
+	// the ISO file is checked against its recorded digest, if there is one,
+	// before anything tries to boot from it. A discovered file has no use
+	// for the first and no digest for the second.
+	if (!option->iso_path) {
+		err = HandoffPublish(&grub_variable_guid, option, params, &arena);
+		if (EFI_ERROR(err)) {
+			LogError(LogTagMain, L"Error: could not pass the boot settings to GRUB: %r\n", err);
+		}
 		
-	FreePool(conductor);
-	FreePool(root); // Free the now-unneeded memory.
+		err = VerifyExpectedDigest(root_dir, &boot_files, expected);
+		verify = !EFI_ERROR(err);
+		if (EFI_ERROR(err) && err != EFI_NOT_FOUND) {
+			goto verify_failed;
+		}
+	}
+	
+	// For toram, copy the ISO file into memory now, in a few large reads, and
+	// start the kernel from the copy ourselves, since only then can we tell
+	// the live system where it is. The copy is checked as it is made, which
+	// saves reading the whole file a second time. Should the copy fail, the
+	// live system is left to make its own, as it always used to.
+	ZeroMem(&ram_disk, sizeof(ram_disk));
+	if (to_ram) {
+		err = RamDiskLoadISO(&ram_disk, iso_device, iso_root, iso_path, verify ? expected : NULL);
+		if (err == EFI_CRC_ERROR) {
+			goto verify_failed;
+		} else if (EFI_ERROR(err)) {
+			LogWarning(LogTagMain, L"Could not copy the ISO file to memory: %r\n", err);
+		} else {
+			direct = TRUE;
+			verify = FALSE;
+		}
+	}
+	
+	if (verify) {
+		err = VerifyISO(root_dir, &boot_files, expected);
+		if (EFI_ERROR(err)) {
+			goto verify_failed;
+		}
+	}
+	
+	// Try starting the kernel's EFI stub straight from the ISO file, which saves
+	// a whole bootloader stage. If that fails, GRUB can still do the job, for
+	// boot.iso at least.
+	if (direct) {
+		err = LoadKernelFromISO(global_image, iso_device, iso_root, option, params,
+			ram_disk.base ? &ram_disk : NULL, &image);
+		if (iso_root != root_dir) {
+			uefi_call_wrapper(iso_root->Close, 1, iso_root);
+		}
+		if (EFI_ERROR(err)) {
+			LogError(LogTagMain, L"Error loading the kernel from the ISO file: %r\n", err);
+			RamDiskRelease(&ram_disk);
+			image = NULL;
+			if (option->iso_path) {
+				PrefetchRelease();
+				ArenaRelease(&arena);
+				return err;
+			}
+			LogWarning(LogTagMain, L"Falling back to GRUB.\n");
+		}
+	}
+	
+	PrefetchRelease();
+	ArenaRelease(&arena); // Free the now-unneeded memory.
+	ArenaRelease(&config_arena);
+	ZeroMem(&boot_entries, sizeof(boot_entries));
 	
 	// Load the EFI boot loader image into memory.
-	path = FileDevicePath(this_image->DeviceHandle, L"\\efi\\boot\\boot.efi");
-	err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, global_image, path, NULL, 0, &image);
-	if (EFI_ERROR(err)) {
-		DisplayErrorText(L"Error loading image: ");
-		Print(L"%r\n", err);
-		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+	if (!image) {
+		path = FileDevicePath(this_image->DeviceHandle, L"\\efi\\boot\\boot.efi");
+		err = uefi_call_wrapper(BS->LoadImage, 6, FALSE, global_image, path, NULL, 0, &image);
 		FreePool(path);
-		
-		return EFI_LOAD_ERROR;
+		if (EFI_ERROR(err)) {
+			LogError(LogTagMain, L"Error loading image: %r\n", err);
+			return EFI_LOAD_ERROR;
+		}
 	}
+	TimingMark(BootPhaseLoadImage);
 	
 	// Start the EFI boot loader.
+	LogFlush();
 	uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut); // Clear the screen.
+	TimingMark(BootPhaseStartImage);
+	TimingPublish(&enterprise_variable_guid); // Let the booted system see where the time went.
+	LogPublish(FALSE);
 	err = uefi_call_wrapper(BS->StartImage, 3, image, NULL, NULL);
 	if (EFI_ERROR(err)) {
-		DisplayErrorText(L"Error starting image: ");
-		Print(L"%r\n", err);
-		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
-		FreePool(path);
-		
+		LogError(LogTagMain, L"Error starting image: %r\n", err);
+		// Give back the copy in memory and the initrd, or every retry from
+		// the menu would hold on to another ISO file's worth of memory.
+		RamDiskRelease(&ram_disk);
+		KernelRelease();
 		return EFI_LOAD_ERROR;
 	}
 	
 	return EFI_SUCCESS;
+	
+verify_failed:
+	LogError(LogTagMain, L"Error: the ISO file failed verification: %r\n", err);
+	PrefetchRelease();
+	ArenaRelease(&arena);
+	return err;
 }
 
-static BootableLinuxDistro* ReadConfigurationFile(const CHAR16 *name) {
-	/* This will always stay consistent, otherwise we'll lose the list in memory.*/
-	BootableLinuxDistro *root = AllocateZeroPool(sizeof(BootableLinuxDistro));
-	BootableLinuxDistro *conductor; // Will point to each node as we traverse the list.
+/*
+ * Stores the entry and options being booted with, so that they can be
+ * chosen again next time. The variable is only written when they change,
+ * which spares the flash on machines that boot the same way every day.
+ */
+static VOID RememberBootSelection(LinuxBootOption *entry, CHAR16 *params, BOOLEAN direct, MemoryArena *arena) {
+	UINTN name_size = strlena(entry->name) + 1;
+	UINTN size = sizeof(LastBootRecord) + name_size;
+	LastBootRecord *record = ArenaAllocateZero(arena, size);
 	
-	conductor = root; // Start by pointing at the first element.
+	if (!record) {
+		return;
+	}
+	record->signature = LAST_BOOT_SIGNATURE;
+	record->version = LAST_BOOT_VERSION;
+	record->direct = direct;
+	StrnCpy(record->options, params, LAST_BOOT_OPTIONS_LENGTH - 1);
+	CopyMem(record->entry, entry->name, name_size);
 	
+	efi_set_variable_if_changed(&enterprise_variable_guid, LAST_BOOT_VARIABLE_NAME, (CHAR8 *)record, size, TRUE);
+}
+
+/*
+ * Looks up what was booted last time. The entry is left alone if it no
+ * longer exists, and the options if the record is not one we understand;
+ * options and direct may be NULL if only the entry is wanted.
+ */
+static EFI_STATUS LoadLastSelection(UINTN *entry, CHAR16 *options, BOOLEAN *direct) {
+	LastBootRecord *record;
+	UINTN size, i;
+	CHAR8 *buffer;
+	EFI_STATUS err;
+	
+	err = efi_get_variable(&enterprise_variable_guid, LAST_BOOT_VARIABLE_NAME, &buffer, &size);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	
+	record = (LastBootRecord *)buffer;
+	if (size <= sizeof(LastBootRecord) || record->signature != LAST_BOOT_SIGNATURE ||
+			record->version != LAST_BOOT_VERSION || buffer[size - 1] != '\0' ||
+			record->options[LAST_BOOT_OPTIONS_LENGTH - 1] != '\0') {
+		FreePool(buffer);
+		return EFI_INCOMPATIBLE_VERSION;
+	}
+	
+	if (options) {
+		CopyMem(options, record->options, sizeof(record->options));
+	}
+	if (direct) {
+		*direct = record->direct;
+	}
+	for (i = 0; i < boot_entries.count; i++) {
+		if (strcmpa(boot_entries.entries[i].name, record->entry) == 0) {
+			*entry = i;
+			break;
+		}
+	}
+	
+	FreePool(buffer);
+	return EFI_SUCCESS;
+}
+
+/*
+ * Boots the same way as last time, or the first entry with the defaults if
+ * nothing was remembered.
+ */
+EFI_STATUS BootLastSelection(VOID) {
+	CHAR16 options[LAST_BOOT_OPTIONS_LENGTH] = L"";
+	BOOLEAN direct = FALSE;
+	UINTN entry = 0;
+	
+	LoadLastSelection(&entry, options, &direct);
+	return BootLinuxWithOptions(entry, options, direct);
+}
+
+static EFI_STATUS ReadConfigurationFile(const CHAR16 *name, MemoryArena *arena,
+		ConfigurationSettings *settings, BootEntryTable *table) {
 	CHAR8 *contents;
-	UINTN read_bytes = FileRead(root_dir, name, &contents);
+	EFI_STATUS err;
+	UINTN read_bytes = FileRead(root_dir, name, &contents, arena);
 	if (read_bytes == 0) {
-		DisplayErrorText(L"Error: Couldn't read configuration information.\n");
+		LogError(LogTagMain, L"Error: Couldn't read configuration information.\n");
+		return EFI_LOAD_ERROR;
 	}
 	
-	UINTN position = 0;
-	CHAR8 *key, *value, *distribution, *boot_folder;
-	while ((GetConfigurationKeyAndValue(contents, &position, &key, &value))) {
-		/* 
-		 * We require the user to specify an entry, followed by the file name and
-		 * any information required to boot the Linux distribution.
-		 */
-		// The user has put a given a distribution entry.
-		if (strcmpa((CHAR8 *)"entry", key) == 0) {
-			Print(L"Encountered an entry: %s\n", value);
-			conductor->bootOption = AllocateZeroPool(sizeof(LinuxBootOption));
-			conductor->bootOption->name = value;
-			conductor->next = 0;
-		}
-		// The user has given us a distribution family.
-		else if (strcmpa((CHAR8 *)"family", key) == 0) {
-			distribution = value;
-			conductor->bootOption->distro_family = value;
-			conductor->bootOption->kernel_path = KernelLocationForDistributionName(distribution, &boot_folder);
-			conductor->bootOption->initrd_path = InitRDLocationForDistributionName(distribution);
-			conductor->bootOption->boot_folder = boot_folder;
-			//Print(L"Boot folder: %s\n", ASCIItoUTF16(boot_folder, strlena(boot_folder)));
-			// If either of the paths are a blank string, then you've got an
-			// unsupported distribution or a typo of the distribution name.
-			if (strcmpa((CHAR8 *)"", conductor->bootOption->kernel_path) == 0 ||
-				strcmpa((CHAR8 *)"", conductor->bootOption->initrd_path) == 0) {
-				Print(L"Distribution family %s is not supported.\n", ASCIItoUTF16(value, strlena(value)));
-				
-				FreePool(conductor->bootOption);
-				return NULL;
-			}
-		// The user is manually specifying information; override any previous values.
-		} else if (strcmpa((CHAR8 *)"kernel", key) == 0) {
-			conductor->bootOption->kernel_path = value;
-		} else if (strcmpa((CHAR8 *)"initrd", key) == 0) {
-			conductor->bootOption->initrd_path = value;
-		} else if (strcmpa((CHAR8 *)"root", key) == 0) { 
-			conductor->bootOption->boot_folder = value;
-		} else {
-			Print(L"Unrecognized configuration option: %s.\n", ASCIItoUTF16(key, strlena(key)));
-		}
+	err = ParseConfiguration(contents, arena, settings, table);
+	if (EFI_ERROR(err)) {
+		// Whatever was parsed before the error is not trusted.
+		table->count = 0;
 	}
+	LogDebug(LogTagMain, L"Done reading configuration file.\n");
+	return err;
+}
+
+/*
+ * Loads the boot plan compiled from the configuration file, if there is one
+ * and it was built from the file as it is now. Anything wrong with it is
+ * only worth a note, since the caller then reads the file itself.
+ */
+static EFI_STATUS ReadBootPlan(const CHAR16 *name, const CHAR16 *source_name, MemoryArena *arena,
+		ConfigurationSettings *settings, BootEntryTable *table) {
+	SnapshotEntry *plan = SnapshotFind(&boot_files, (CHAR16 *)name);
+	SnapshotEntry *source = SnapshotFind(&boot_files, (CHAR16 *)source_name);
+	CHAR8 *contents;
+	UINTN read_bytes;
+	EFI_STATUS err;
 	
-	Print(L"Done reading configuration file.\n");
-	return root;
+	if (!plan) {
+		return EFI_NOT_FOUND;
+	} else if (!BootPlanIsCurrent(plan, source)) {
+		LogNotice(LogTagConfig, L"The boot plan is older than the configuration file; ignoring it.\n");
+		return EFI_NOT_READY;
+	}
+	
+	read_bytes = FileRead(root_dir, name, &contents, arena);
+	if (read_bytes == 0) {
+		LogWarning(LogTagConfig, L"Couldn't read the boot plan.\n");
+		return EFI_LOAD_ERROR;
+	}
+	
+	err = BootPlanLoad(contents, read_bytes, source->size, arena, settings, table);
+	if (err == EFI_NOT_READY) {
+		LogNotice(LogTagConfig, L"The boot plan was built from another configuration file; ignoring it.\n");
+	} else if (EFI_ERROR(err)) {
+		LogWarning(LogTagConfig, L"The boot plan is unusable (%r); reading the configuration file.\n", err);
+	} else {
+		LogDebug(LogTagConfig, L"Loaded %d entries from the boot plan.\n", table->count);
+	}
+	return err;
 }
 
 static EFI_STATUS console_text_mode(VOID) {
@@ -27,13 +27,26 @@ typedef struct LinuxBootOption {
 	CHAR8 *kernel_path;
 	CHAR8 *initrd_path;
 	CHAR8 *boot_folder;
+	// Where an ISO file found by discovery is. Entries from the configuration
+	// file leave these NULL, and boot \efi\boot\boot.iso next to us.
+	EFI_HANDLE iso_device;
+	CHAR16 *iso_path;
 } LinuxBootOption;
 
-typedef struct BootableLinuxDistro {
-	LinuxBootOption *bootOption;
-	struct BootableLinuxDistro *next;
-} BootableLinuxDistro;
+/*
+ * Every entry in the configuration file, in order, in one array, so that the
+ * menu can reach any of them directly however many there are.
+ */
+typedef struct BootEntryTable {
+	LinuxBootOption *entries;
+	UINTN count;
+	UINTN capacity;
+} BootEntryTable;
+
+// Long enough for every kernel option the menu offers.
+#define LAST_BOOT_OPTIONS_LENGTH 150
 
-EFI_STATUS BootLinuxWithOptions(CHAR16 *params);
+EFI_STATUS BootLinuxWithOptions(UINTN entry, CHAR16 *params, BOOLEAN direct);
+EFI_STATUS BootLastSelection(VOID);
 
 #endif
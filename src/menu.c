@@ -19,9 +19,15 @@
 #include <efi.h>
 #include <efilib.h>
 
-#include "menu.h"
 #include "main.h"
+#include "menu.h"
+#include "arena.h"
 #include "utils.h"
+#include "convert.h"
+#include "timing.h"
+#include "screen.h"
+#include "prefetch.h"
+#include "log.h"
 
 #define KEYPRESS(keys, scan, uni) ((((UINT64)keys) << 32) | ((scan) << 16) | (uni))
 #define EFI_SHIFT_STATE_VALID           0x80000000
@@ -35,7 +41,12 @@
 #define KEYCHAR(k) ((k) & 0xffff)
 #define CHAR_CTRL(c) ((c) - 'a' + 1)
 
-static EFI_STATUS key_read(UINT64 *key, BOOLEAN wait) {
+/*
+ * Reads a key, waiting for one first if wait is set. If a timer event is
+ * given as well, the wait also ends when it is signaled, and EFI_TIMEOUT is
+ * returned.
+ */
+static EFI_STATUS key_read(UINT64 *key, BOOLEAN wait, EFI_EVENT timer) {
 	#define EFI_SIMPLE_TEXT_INPUT_EX_PROTOCOL_GUID \
 		{ 0xdd9e7534, 0x7762, 0x4698, { 0x8c, 0x14, 0xf5, 0x85, 0x17, 0xa6, 0x25, 0xaa } }
 
@@ -111,10 +122,14 @@ static EFI_STATUS key_read(UINT64 *key, BOOLEAN wait) {
 
 	/* wait until key is pressed */
 	if (wait) {
-		if (TextInputEx) {
-			uefi_call_wrapper(BS->WaitForEvent, 3, 1, &TextInputEx->WaitForKeyEx, &index);
-		} else {
-			uefi_call_wrapper(BS->WaitForEvent, 3, 1, &ST->ConIn->WaitForKey, &index);
+		LogFlush();
+		EFI_EVENT events[2];
+
+		events[0] = TextInputEx ? TextInputEx->WaitForKeyEx : ST->ConIn->WaitForKey;
+		events[1] = timer;
+		err = uefi_call_wrapper(BS->WaitForEvent, 3, timer ? 2 : 1, events, &index);
+		if (!EFI_ERROR(err) && index == 1) {
+			return EFI_TIMEOUT;
 		}
 	}
 
@@ -159,117 +174,402 @@ static EFI_STATUS key_read(UINT64 *key, BOOLEAN wait) {
 	return EFI_SUCCESS;
 }
 
-EFI_STATUS DisplayMenu(void) {
+static Screen screen;
+
+/*
+ * Waits for a key while counting down the seconds on the given row of the
+ * screen. Returns EFI_TIMEOUT if no key was pressed in time.
+ */
+static EFI_STATUS key_read_countdown(UINT64 *key, UINTN timeout, UINTN row) {
+	CHAR16 line[SCREEN_MAX_COLUMNS];
+	EFI_EVENT timer;
 	EFI_STATUS err;
-	UINT64 key;
-	CHAR16 boot_options[150] = L"";
+
+	err = uefi_call_wrapper(BS->CreateEvent, 5, EVT_TIMER, 0, NULL, NULL, &timer);
+	if (EFI_ERROR(err)) {
+		return key_read(key, TRUE, NULL);
+	}
+	// The period is given in units of 100ns.
+	uefi_call_wrapper(BS->SetTimer, 3, timer, TimerPeriodic, 10 * 1000 * 1000);
+
+	do {
+		SPrint(line, sizeof(line), L"    Booting the last selection in %d second%s.", timeout,
+			timeout == 1 ? L"" : L"s");
+		ScreenSetLine(&screen, row, line, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+		ScreenFlush(&screen);
+
+		err = key_read(key, TRUE, timer);
+	} while (err == EFI_TIMEOUT && --timeout > 0);
+
+	uefi_call_wrapper(BS->CloseEvent, 1, timer);
+	ScreenSetLine(&screen, row, L"", EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	ScreenFlush(&screen);
+	return err;
+}
+
+#define MENU_FILTER_LENGTH 32
+#define MENU_HEADER_ROWS 4
+#define MENU_FOOTER_ROWS 6
+#define MENU_SELECTED_ATTRIBUTE (EFI_BLACK|EFI_BACKGROUND_LIGHTGRAY)
+
+typedef enum MenuAction {
+	MenuActionNone,
+	MenuActionBoot,
+	MenuActionConfigure,
+	MenuActionBootDirect,
+	MenuActionReboot,
+	MenuActionTimeout
+} MenuAction;
+
+/*
+ * The entry list shows a window onto the entries that match what has been
+ * typed so far. Everything the user can do touches a bounded number of
+ * rows, so the menu responds as quickly with hundreds of entries as with a
+ * handful; only a change to the filter looks at every entry.
+ */
+typedef struct MenuState {
+	BootEntryTable *table;
+	UINTN *matches; // Indices into the table, in order.
+	UINTN match_count;
+	UINTN selected; // Position in matches.
+	UINTN first; // The first match in the window.
+	UINTN height;
+	CHAR8 filter[MENU_FILTER_LENGTH + 1];
+	UINTN filter_length;
+} MenuState;
+
+static CHAR8 MenuLowerCase(CHAR8 c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/*
+ * Whether the filter occurs anywhere in the name, ignoring case.
+ */
+static BOOLEAN MenuEntryMatches(CHAR8 *name, CHAR8 *filter, UINTN filter_length) {
+	UINTN i, j;
+
+	for (i = 0; name[i]; i++) {
+		for (j = 0; j < filter_length && name[i + j]; j++) {
+			if (MenuLowerCase(name[i + j]) != filter[j]) {
+				break;
+			}
+		}
+		if (j == filter_length) {
+			return TRUE;
+		}
+	}
+	return filter_length == 0;
+}
+
+/*
+ * Recomputes the matches after the filter changed. When characters were only
+ * added, the new matches are a subset of the old ones, so only those are
+ * checked again. The same entry stays selected if it still matches.
+ */
+static VOID MenuApplyFilter(MenuState *state, BOOLEAN narrowed) {
+	UINTN previous = state->match_count ? state->matches[state->selected] : 0;
+	UINTN i, count = 0;
+
+	if (narrowed) {
+		for (i = 0; i < state->match_count; i++) {
+			UINTN entry = state->matches[i];
+			if (MenuEntryMatches(state->table->entries[entry].name, state->filter, state->filter_length)) {
+				state->matches[count++] = entry;
+			}
+		}
+	} else {
+		for (i = 0; i < state->table->count; i++) {
+			if (MenuEntryMatches(state->table->entries[i].name, state->filter, state->filter_length)) {
+				state->matches[count++] = i;
+			}
+		}
+	}
+	state->match_count = count;
+
+	state->selected = 0;
+	for (i = 0; i < count; i++) {
+		if (state->matches[i] >= previous) {
+			state->selected = state->matches[i] == previous ? i : 0;
+			break;
+		}
+	}
+}
+
+/*
+ * Moves the selection by the given number of rows, scrolling the window to
+ * keep it in view.
+ */
+static VOID MenuMove(MenuState *state, INTN distance) {
+	INTN target = (INTN)state->selected + distance;
+
+	if (state->match_count == 0) {
+		return;
+	}
+	if (target < 0) {
+		target = 0;
+	} else if (target >= (INTN)state->match_count) {
+		target = state->match_count - 1;
+	}
+	state->selected = target;
+}
+
+/*
+ * Brings the screen model up to date with the state of the menu. Only rows
+ * that come out different are redrawn by the following flush.
+ */
+static VOID MenuDraw(MenuState *state) {
+	CHAR16 line[SCREEN_MAX_COLUMNS + 1];
+	UINTN row, position, prefix;
+	CHAR8 *name;
+
+	if (state->selected < state->first) {
+		state->first = state->selected;
+	} else if (state->selected >= state->first + state->height) {
+		state->first = state->selected - state->height + 1;
+	}
+
+	SPrint(line, sizeof(line), L"    Available boot options (%d of %d):", state->match_count,
+		state->table->count);
+	ScreenSetLine(&screen, 1, line, EFI_YELLOW|EFI_BACKGROUND_BLACK);
+	if (state->filter_length) {
+		SPrint(line, sizeof(line), L"    Search: %a", state->filter);
+	} else {
+		StrCpy(line, L"    Type to search; use the arrow keys to choose.");
+	}
+	ScreenSetLine(&screen, 2, line, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+
+	for (row = 0; row < state->height; row++) {
+		position = state->first + row;
+		if (position >= state->match_count) {
+			ScreenSetLine(&screen, MENU_HEADER_ROWS + row, L"", EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+			continue;
+		}
+
+		StrCpy(line, position == state->selected ? L"  > " : L"    ");
+		prefix = StrLen(line);
+		name = state->table->entries[state->matches[position]].name;
+		Utf8ToUtf16(name, strlena(name), line + prefix, SCREEN_MAX_COLUMNS + 1 - prefix);
+		ScreenSetLine(&screen, MENU_HEADER_ROWS + row, line, position == state->selected ?
+			MENU_SELECTED_ATTRIBUTE : EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	}
+
+	ScreenFlush(&screen);
+}
+
+EFI_STATUS DisplayMenu(BootEntryTable *entries, UINTN selected, UINTN timeout) {
+	EFI_STATUS err;
+	UINT64 key = 0;
+	CHAR16 boot_options[LAST_BOOT_OPTIONS_LENGTH] = L"";
+	MenuAction action = MenuActionNone;
+	MenuState state;
+	UINTN footer, entry;
+	
+	ZeroMem(&state, sizeof(state));
+	state.table = entries;
+	state.matches = AllocatePool((entries->count ? entries->count : 1) * sizeof(UINTN));
+	if (!state.matches) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+	MenuApplyFilter(&state, FALSE);
+	state.selected = selected < state.match_count ? selected : 0;
 	
 	/*
 	 * Give the user some information as to what they can do at this point.
 	 */
-	DisplayColoredText(L"\n\n    Available boot options:\n");
-	Print(L"    Press the key corresponding to the number of the option that you want.\n");
-	Print(L"\n    1) Boot Linux from ISO file\n");
-	Print(L"    2) Modify Linux kernel boot options (advanced!)\n");
-	Print(L"\n    Press any other key to reboot the system.\n");
+	LogFlush();
+	ScreenInitialize(&screen, MENU_HEADER_ROWS + MENU_FOOTER_ROWS + (entries->count ? entries->count : 1), FALSE);
+	state.height = screen.rows > MENU_HEADER_ROWS + MENU_FOOTER_ROWS ?
+		screen.rows - MENU_HEADER_ROWS - MENU_FOOTER_ROWS : 1;
+	if (entries->count && state.height > entries->count) {
+		state.height = entries->count;
+	}
 	
-	err = key_read(&key, TRUE);
-	if (key == '1') {
-		BootLinuxWithOptions(L"");
-	} else if (key == '2') {
-		ConfigureKernel(boot_options);
+	footer = MENU_HEADER_ROWS + state.height + 1;
+	ScreenSetLine(&screen, footer, L"    Enter) Boot Linux from ISO file", EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	ScreenSetLine(&screen, footer + 1, L"    F2) Modify Linux kernel boot options (advanced!)",
+		EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	ScreenSetLine(&screen, footer + 2, L"    F3) Boot the Linux kernel directly from the ISO file, without GRUB",
+		EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	ScreenSetLine(&screen, footer + 3, L"    Esc) Reboot the system", EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	
+	while (action == MenuActionNone) {
+		UINT16 scan;
+		CHAR16 c;
+		
+		MenuDraw(&state);
+		if (state.match_count) {
+			PrefetchSelect(&entries->entries[state.matches[state.selected]]);
+		}
+		if (timeout > 0) {
+			err = key_read_countdown(&key, timeout, footer + 4);
+			timeout = 0;
+		} else {
+			err = key_read(&key, TRUE, NULL);
+		}
+		if (err == EFI_TIMEOUT) {
+			action = MenuActionTimeout;
+			break;
+		} else if (EFI_ERROR(err)) {
+			continue;
+		}
+		
+		scan = (key >> 16) & 0xffff;
+		c = KEYCHAR(key);
+		
+		// With nothing typed, the digits still pick the actions, as they always have.
+		if (state.filter_length == 0 && c >= '1' && c <= '3') {
+			scan = c == '1' ? SCAN_NULL : c == '2' ? SCAN_F2 : SCAN_F3;
+			c = c == '1' ? CHAR_CARRIAGE_RETURN : CHAR_NULL;
+		}
+		
+		if (scan == SCAN_UP) {
+			MenuMove(&state, -1);
+		} else if (scan == SCAN_DOWN) {
+			MenuMove(&state, 1);
+		} else if (scan == SCAN_PAGE_UP) {
+			MenuMove(&state, -(INTN)state.height);
+		} else if (scan == SCAN_PAGE_DOWN) {
+			MenuMove(&state, state.height);
+		} else if (scan == SCAN_HOME) {
+			MenuMove(&state, -(INTN)state.match_count);
+		} else if (scan == SCAN_END) {
+			MenuMove(&state, state.match_count);
+		} else if (scan == SCAN_ESC && state.filter_length) {
+			state.filter_length = 0;
+			state.filter[0] = '\0';
+			MenuApplyFilter(&state, FALSE);
+		} else if (scan == SCAN_ESC || scan == SCAN_F10) {
+			action = MenuActionReboot;
+		} else if (state.match_count && scan == SCAN_F2) {
+			action = MenuActionConfigure;
+		} else if (state.match_count && scan == SCAN_F3) {
+			action = MenuActionBootDirect;
+		} else if (state.match_count && c == CHAR_CARRIAGE_RETURN) {
+			action = MenuActionBoot;
+		} else if (c == CHAR_BACKSPACE && state.filter_length) {
+			state.filter[--state.filter_length] = '\0';
+			MenuApplyFilter(&state, FALSE);
+		} else if (c >= ' ' && c <= '~' && state.filter_length < MENU_FILTER_LENGTH) {
+			state.filter[state.filter_length++] = MenuLowerCase(c);
+			state.filter[state.filter_length] = '\0';
+			MenuApplyFilter(&state, TRUE);
+		}
+	}
+	
+	entry = state.match_count ? state.matches[state.selected] : 0;
+	FreePool(state.matches);
+	ScreenSetCursor(&screen, footer + 5);
+	TimingMark(BootPhaseMenuWait);
+	
+	if (action == MenuActionTimeout) {
+		BootLastSelection();
+	} else if (action == MenuActionConfigure) {
+		ConfigureKernel(entry, boot_options);
+	} else if (action == MenuActionBootDirect) {
+		BootLinuxWithOptions(entry, L"", TRUE);
+	} else if (action == MenuActionBoot) {
+		BootLinuxWithOptions(entry, L"", FALSE);
 	} else {
 		// Reboot the system.
 		err = uefi_call_wrapper(RT->ResetSystem, 4, EfiResetCold, EFI_SUCCESS, 0, NULL);
 		
 		// Should never get here unless there's an error.
-		Print(L"Error calling ResetSystem: %r", err);
-		uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+		LogError(LogTagMenu, L"Error calling ResetSystem: %r\n", err);
 	}
 	
-	uefi_call_wrapper(BS->Stall, 1, 3 * 1000 * 1000);
+	// Booting failed if we got here; leave the messages up for a moment.
+	LogFailurePause(3 * 1000 * 1000);
 	return EFI_SUCCESS;
 }
 
-static int options_array[20];
+typedef struct KernelOption {
+	CHAR16 key;
+	CHAR16 *argument;
+	CHAR16 *description;
+	BOOLEAN enabled;
+} KernelOption;
 
-#define OPTION(string, id) \
-	if (options_array[id]) { \
-		DisplayColoredText(string); \
-	} else { \
-		Print(string); \
-	}
+static KernelOption kernel_options[] = {
+	{ '1', L"nomodeset", L"Disable kernel mode setting.", FALSE },
+	{ '2', L"acpi=off", L"Disable ACPI.", FALSE },
+	{ '3', L"noefi", L"Disable EFI runtime services support.", FALSE },
+	{ '4', L"vga=ask", L"Show a menu of supported video modes.", FALSE },
+	{ '5', L"persistent", L"Make any changes to the flash storage persist.", FALSE },
+	{ '6', L"toram", L"Keep the entire distribution in RAM to minimize disk usage.", FALSE },
+	{ '7', L"debug", L"Enable kernel debugging.", FALSE },
+	{ '9', L"gpt", L"Treat disks with an invalid protective MBR as GPT (for Mac drives).", FALSE },
+};
+
+#define KERNEL_OPTION_COUNT (sizeof(kernel_options) / sizeof(kernel_options[0]))
+#define KERNEL_OPTION_FIRST_ROW 5
+
+/*
+ * Updates the screen model with the current state of one option. Only the
+ * row of an option that was just toggled differs from what is on screen.
+ */
+static VOID ShowKernelOption(UINTN index) {
+	KernelOption *option = &kernel_options[index];
+	CHAR16 line[SCREEN_MAX_COLUMNS + 1];
 
-EFI_STATUS ConfigureKernel(CHAR16 *options) {
+	SPrint(line, sizeof(line), L"    %c) %s - %s", option->key, option->argument, option->description);
+	ScreenSetLine(&screen, KERNEL_OPTION_FIRST_ROW + index, line,
+		option->enabled ? EFI_YELLOW|EFI_BACKGROUND_BLACK : EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+}
+
+EFI_STATUS ConfigureKernel(UINTN entry, CHAR16 *options) {
 	UINT64 key;
 	EFI_STATUS err;
+	UINTN i;
 	
 	StrCpy(options, L""); // Not strictly necessary, but it doesn't hurt to be double safe.
 	
+	/*
+	 * Configure the boot options to the Linux kernel. Let the user select any option
+	 * that they think might facilitate booting Linux and add it to the options
+	 * string once they press 0.
+	 */
+	LogFlush();
+	ScreenInitialize(&screen, 0, TRUE);
+	ScreenSetLine(&screen, 2, L"    Configure Kernel Options:", EFI_YELLOW|EFI_BACKGROUND_BLACK);
+	ScreenSetLine(&screen, 3, L"    Press the key corresponding to the number of the option to toggle.",
+		EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	ScreenSetLine(&screen, KERNEL_OPTION_FIRST_ROW + KERNEL_OPTION_COUNT + 1,
+		L"    0) Boot with selected options.", EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
+	
 	do {
-		uefi_call_wrapper(ST->ConOut->ClearScreen, 1, ST->ConOut);
-		/*
-		 * Configure the boot options to the Linux kernel. Let the user select any option
-		 * that they think might facilitate booting Linux and add it to the options
-		 * string once they press 0.
-		 */
-		DisplayColoredText(L"\n\n    Configure Kernel Options:\n");
-		Print(L"    Press the key corresponding to the number of the option to toggle.\n");
-		OPTION(L"\n    1) nomodeset - Disable kernel mode setting.", 0);
-		OPTION(L"\n    2) acpi=off - Disable ACPI.", 1);
-		OPTION(L"\n    3) noefi - Disable EFI runtime services support.", 2);
-		OPTION(L"\n    4) vga=ask - Show a menu of supported video modes.", 3);
-		OPTION(L"\n    5) persistent - Make any changes to the flash storage persist.", 4);
-		OPTION(L"\n    6) toram - Keep the entire distribution in RAM to minimize disk usage.", 5);
-		OPTION(L"\n    7) debug - Enable kernel debugging.", 6);
-		OPTION(L"\n    9) gpt - Forces disk with valid GPT signature but invalid Protective MBR" \
-				" to be treated as GPT (useful for installing Linux on a Mac drive).", 8);
-		Print(L"\n\n    0) Boot with selected options.\n");
+		for (i = 0; i < KERNEL_OPTION_COUNT; i++) {
+			ShowKernelOption(i);
+		}
+		ScreenFlush(&screen);
 		
-		err = key_read(&key, TRUE);
+		err = key_read(&key, TRUE, NULL);
 		if (EFI_ERROR(err)) {
-			Print(L"Error: could not read from keyboard: %d\n", err);
+			LogError(LogTagMenu, L"Error: could not read from keyboard: %d\n", err);
 			return err;
 		}
 		
-		int index = key - '0';
-		options_array[index - 1] = !options_array[index - 1];
+		for (i = 0; i < KERNEL_OPTION_COUNT; i++) {
+			if (key == kernel_options[i].key) {
+				kernel_options[i].enabled = !kernel_options[i].enabled;
+				break;
+			}
+		}
 	} while(key != '0');
+	ScreenSetCursor(&screen, KERNEL_OPTION_FIRST_ROW + KERNEL_OPTION_COUNT + 2);
+	TimingMark(BootPhaseMenuWait);
 	
 	// Now concatenate the individual options onto the option line.
-	// I'm investigating a better way to do this.
-	if (options_array[0]) {
-		StrCat(options, L"nomodeset ");
-	}
-	
-	if (options_array[1]) {
-		StrCat(options, L"acpi=off ");
-	}
-	
-	if (options_array[2]) {
-		StrCat(options, L"noefi ");
-	}
-	
-	if (options_array[3]) {
-		StrCat(options, L"vga=ask ");
-	}
-	
-	if (options_array[4]) {
-		StrCat(options, L"persistent ");
-	}
-	
-	if (options_array[5]) {
-		StrCat(options, L"toram ");
-	}
-	
-	if (options_array[8]) {
-		StrCat(options, L"gpt ");
+	for (i = 0; i < KERNEL_OPTION_COUNT; i++) {
+		if (kernel_options[i].enabled) {
+			StrCat(options, kernel_options[i].argument);
+			StrCat(options, L" ");
+		}
 	}
 	
-	BootLinuxWithOptions(options);
+	BootLinuxWithOptions(entry, options, FALSE);
 	
 	// Shouldn't get here unless something went wrong with the boot process.
-	uefi_call_wrapper(BS->Stall, 1, 3 * 1000);
+	LogFailurePause(3 * 1000 * 1000);
 	uefi_call_wrapper(RT->ResetSystem, 4, EfiResetCold, EFI_SUCCESS, 0, NULL);
 	return EFI_LOAD_ERROR;
 }
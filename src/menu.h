@@ -20,7 +20,7 @@
 #ifndef _menu_h
 #define _menu_h
 
-EFI_STATUS DisplayMenu(void);
-EFI_STATUS ConfigureKernel(CHAR16 *options);
+EFI_STATUS DisplayMenu(BootEntryTable *entries, UINTN selected, UINTN timeout);
+EFI_STATUS ConfigureKernel(UINTN entry, CHAR16 *options);
 
 #endif
@@ -0,0 +1,196 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Loads the boot plan that compile-config.py builds from the configuration
+ * file. Nothing in it needs parsing: once the checksum and the bounds have
+ * been checked, the entries point straight into the buffer the file was
+ * read into.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "arena.h"
+#include "config.h"
+#include "snapshot.h"
+#include "plan.h"
+
+/*
+ * The plan is only trusted if it was written after the configuration file
+ * was last changed; both times come from the same volume, so they compare
+ * directly. The size recorded inside the plan is checked as well, once it
+ * has been read, which catches edits made within the FAT's two-second
+ * resolution.
+ */
+BOOLEAN BootPlanIsCurrent(SnapshotEntry *plan, SnapshotEntry *source) {
+	EFI_TIME *a, *b;
+
+	if (!plan || !source || plan->directory) {
+		return FALSE;
+	}
+
+	a = &plan->modification_time;
+	b = &source->modification_time;
+	if (a->Year != b->Year) {
+		return a->Year > b->Year;
+	} else if (a->Month != b->Month) {
+		return a->Month > b->Month;
+	} else if (a->Day != b->Day) {
+		return a->Day > b->Day;
+	} else if (a->Hour != b->Hour) {
+		return a->Hour > b->Hour;
+	} else if (a->Minute != b->Minute) {
+		return a->Minute > b->Minute;
+	} else if (a->Second != b->Second) {
+		return a->Second > b->Second;
+	}
+	return a->Nanosecond >= b->Nanosecond;
+}
+
+/*
+ * Adler-32, which is what zlib.adler32() computes on the host. It is meant
+ * to catch a plan that was damaged or only partly written, which it does
+ * at a quarter of the cost of the firmware's CRC-32; with that, checking
+ * the plan would take longer than parsing the text it replaces.
+ */
+static UINT32 BootPlanChecksum(UINT8 *data, UINTN size) {
+	UINT32 a = 1, b = 0;
+
+	while (size) {
+		// 5552 bytes is the most that can be summed before b can overflow.
+		UINTN block = size < 5552 ? size : 5552;
+		size -= block;
+		while (block--) {
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+/*
+ * Turns an offset into the string table into a pointer. Every string in the
+ * table is terminated, since the table is known to end with a NUL.
+ */
+static BOOLEAN BootPlanString(CHAR8 *strings, UINT32 strings_size, UINT32 offset, CHAR8 **string) {
+	if (offset >= strings_size) {
+		return FALSE;
+	}
+	*string = offset ? strings + offset : NULL;
+	return TRUE;
+}
+
+/*
+ * Fills the table from a plan of the given size, which must have been built
+ * from a configuration file of source_size bytes. The entries are carved out
+ * of the arena and their strings point into contents, so both must outlive
+ * the table. On any error the table is left empty and the settings are left
+ * alone, and the caller can fall back to parsing the configuration file.
+ */
+EFI_STATUS BootPlanLoad(CHAR8 *contents, UINTN size, UINT64 source_size, MemoryArena *arena,
+		ConfigurationSettings *settings, BootEntryTable *table) {
+	BootPlanHeader *header = (BootPlanHeader *)contents;
+	LinuxBootOption *entries;
+	CHAR8 *strings, *discover;
+	UINT32 checksum, computed;
+	UINTN i;
+
+	ZeroMem(table, sizeof(BootEntryTable));
+	if (size < sizeof(BootPlanHeader) || header->signature != BOOT_PLAN_SIGNATURE) {
+		return EFI_VOLUME_CORRUPTED;
+	} else if (header->version != BOOT_PLAN_VERSION) {
+		return EFI_INCOMPATIBLE_VERSION;
+	} else if (header->size != size) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	checksum = header->checksum;
+	header->checksum = 0;
+	computed = BootPlanChecksum((UINT8 *)contents, size);
+	header->checksum = checksum;
+	if (computed != checksum) {
+		return EFI_CRC_ERROR;
+	}
+
+	// An intact plan can still describe an older version of the file.
+	if (header->source_size != source_size) {
+		return EFI_NOT_READY;
+	}
+
+	// The checksum catches damage, not a plan written wrongly, so the layout
+	// is checked before anything in it is used.
+	if (header->header_size < sizeof(BootPlanHeader) || header->entry_size < sizeof(BootPlanEntry) ||
+			header->strings_offset < header->header_size || header->strings_offset > size ||
+			header->strings_size == 0 || header->strings_size > size - header->strings_offset ||
+			(header->strings_offset - header->header_size) / header->entry_size < header->entry_count) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	strings = contents + header->strings_offset;
+	if (strings[0] != '\0' || strings[header->strings_size - 1] != '\0') {
+		return EFI_VOLUME_CORRUPTED;
+	} else if (header->entry_count == 0) {
+		return EFI_NOT_FOUND;
+	}
+
+	entries = ArenaAllocate(arena, header->entry_count * sizeof(LinuxBootOption));
+	if (!entries) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	for (i = 0; i < header->entry_count; i++) {
+		BootPlanEntry *record = (BootPlanEntry *)(contents + header->header_size + i * header->entry_size);
+		LinuxBootOption *option = &entries[i];
+
+		option->file_name = NULL;
+		option->iso_device = NULL;
+		option->iso_path = NULL;
+		if (!BootPlanString(strings, header->strings_size, record->name, &option->name) ||
+				!BootPlanString(strings, header->strings_size, record->family, &option->distro_family) ||
+				!BootPlanString(strings, header->strings_size, record->kernel, &option->kernel_path) ||
+				!BootPlanString(strings, header->strings_size, record->initrd, &option->initrd_path) ||
+				!BootPlanString(strings, header->strings_size, record->boot_folder, &option->boot_folder) ||
+				!option->name) {
+			return EFI_VOLUME_CORRUPTED;
+		}
+	}
+
+	if (!BootPlanString(strings, header->strings_size, header->discover, &discover)) {
+		return EFI_VOLUME_CORRUPTED;
+	}
+
+	if (settings) {
+		if (discover) {
+			settings->discover = discover;
+		}
+		if (header->flags & BOOT_PLAN_TIMEOUT) {
+			settings->timeout = header->timeout;
+		}
+		if (header->flags & BOOT_PLAN_HEADLESS_SET) {
+			settings->headless = (header->flags & BOOT_PLAN_HEADLESS) != 0;
+		}
+	}
+
+	table->entries = entries;
+	table->count = table->capacity = header->entry_count;
+	return EFI_SUCCESS;
+}
@@ -0,0 +1,71 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _plan_h
+#define _plan_h
+
+#define BOOT_PLAN_FILE_NAME L"\\efi\\boot\\.MLUL-Live-USB.plan"
+#define BOOT_PLAN_SIGNATURE 0x50424E45 // "ENBP"
+#define BOOT_PLAN_VERSION 2
+
+#define BOOT_PLAN_TIMEOUT 0x01 // The timeout field holds a value.
+#define BOOT_PLAN_HEADLESS_SET 0x02 // The file said whether to run headless...
+#define BOOT_PLAN_HEADLESS 0x04 // ...and this is what it said.
+
+/*
+ * The configuration file as compile-config.py leaves it: parsed, checked,
+ * and with every distribution family already turned into paths. The header
+ * is followed by entry_count records of entry_size bytes, and then by a
+ * table of NUL-terminated UTF-8 strings that the records point into. All
+ * fields are little-endian. The checksum is the Adler-32 of the whole file,
+ * as zlib computes it, with the checksum field itself set to zero.
+ */
+typedef struct BootPlanHeader {
+	UINT32 signature;
+	UINT16 version;
+	UINT16 header_size;
+	UINT32 size;
+	UINT32 checksum;
+	UINT64 source_size; // Size of the configuration file the plan was built from.
+	UINT32 entry_count;
+	UINT32 entry_size;
+	UINT32 strings_offset;
+	UINT32 strings_size;
+	UINT32 timeout;
+	UINT32 flags;
+	UINT32 discover; // Offset of the discover directory in the string table.
+} __attribute__((packed)) BootPlanHeader;
+
+/*
+ * Offsets into the string table. The table starts with an empty string, so
+ * offset zero stands for a key the entry did not give.
+ */
+typedef struct BootPlanEntry {
+	UINT32 name;
+	UINT32 family;
+	UINT32 kernel;
+	UINT32 initrd;
+	UINT32 boot_folder;
+} __attribute__((packed)) BootPlanEntry;
+
+BOOLEAN BootPlanIsCurrent(SnapshotEntry *plan, SnapshotEntry *source);
+EFI_STATUS BootPlanLoad(CHAR8 *contents, UINTN size, UINT64 source_size, MemoryArena *arena,
+	ConfigurationSettings *settings, BootEntryTable *table);
+
+#endif
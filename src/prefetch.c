@@ -0,0 +1,269 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Reads the selected entry's kernel and initrd out of the ISO file while the
+ * menu waits for a key. A periodic timer reads one bounded chunk per tick,
+ * so the firmware goes on delivering key presses in between, and whatever
+ * has been read by the time the user decides is not read again.
+ *
+ * The timer's notification function runs at TPL_CALLBACK, which the file
+ * protocol allows. The code here that changes what the timer works on runs
+ * at the same level, so the two never see each other half done.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "main.h"
+#include "arena.h"
+#include "iso9660.h"
+#include "disk.h"
+#include "utils.h"
+#include "prefetch.h"
+#include "log.h"
+
+typedef enum PrefetchFileKind {
+	PrefetchKernel,
+	PrefetchInitRD,
+	PrefetchFileCount
+} PrefetchFileKind;
+
+/* One file being read into pages of its own; length is how much of it. */
+typedef struct PrefetchFile {
+	CHAR8 *path;
+	IsoExtent extent;
+	EFI_PHYSICAL_ADDRESS buffer;
+	UINT64 length;
+	UINT64 done;
+} PrefetchFile;
+
+typedef struct Prefetcher {
+	EFI_FILE_HANDLE iso_file;
+	DiskImage disk;
+	IsoImage iso;
+	EFI_EVENT timer;
+	BOOLEAN running;
+	EFI_STATUS status;
+	PrefetchFile files[PrefetchFileCount];
+} Prefetcher;
+
+static Prefetcher prefetcher;
+
+/*
+ * Stops the background reads but keeps what they have read, for
+ * PrefetchTake() to hand over or PrefetchRelease() to give back.
+ */
+VOID PrefetchStop(VOID) {
+	if (prefetcher.running) {
+		uefi_call_wrapper(BS->SetTimer, 3, prefetcher.timer, TimerCancel, 0);
+		prefetcher.running = FALSE;
+	}
+}
+
+static VOID PrefetchDiscard(PrefetchFile *file) {
+	if (file->buffer) {
+		uefi_call_wrapper(BS->FreePages, 2, file->buffer, EFI_SIZE_TO_PAGES(file->length));
+	}
+	ZeroMem(file, sizeof(PrefetchFile));
+}
+
+/* Reads the next chunk of the first unfinished file among the first count. */
+static EFI_STATUS PrefetchStep(UINTN count) {
+	UINTN i;
+
+	for (i = 0; i < count; i++) {
+		PrefetchFile *file = &prefetcher.files[i];
+		UINT64 remaining = file->length - file->done;
+		UINTN chunk = remaining < PREFETCH_CHUNK_SIZE ? remaining : PREFETCH_CHUNK_SIZE;
+		EFI_STATUS err;
+
+		if (remaining == 0) {
+			continue;
+		}
+
+		err = IsoReadExtent(&prefetcher.iso, &file->extent, file->done, chunk,
+			(UINT8 *)(UINTN)file->buffer + file->done);
+		if (!EFI_ERROR(err)) {
+			file->done += chunk;
+		}
+		return err;
+	}
+	return EFI_END_OF_FILE;
+}
+
+static VOID FIRMWARE_CALLBACK PrefetchTick(EFI_EVENT event, VOID *context) {
+	EFI_STATUS err = PrefetchStep(PrefetchFileCount);
+
+	if (EFI_ERROR(err)) {
+		// Finished, or failed; either way there is nothing more to do in
+		// the background. A failure is reported to whoever takes the files.
+		prefetcher.status = err == EFI_END_OF_FILE ? EFI_SUCCESS : err;
+		PrefetchStop();
+	}
+}
+
+/*
+ * Opens the ISO file for the prefetcher's own use; it keeps a separate
+ * handle, so its reads never move anybody else's file position. device is
+ * the partition it is on, which it is read from directly when it can be.
+ */
+EFI_STATUS PrefetchInitialize(EFI_HANDLE device, EFI_FILE_HANDLE root_dir) {
+	EFI_STATUS err;
+
+	ZeroMem(&prefetcher, sizeof(prefetcher));
+	err = uefi_call_wrapper(root_dir->Open, 5, root_dir, &prefetcher.iso_file, L"\\efi\\boot\\boot.iso",
+		EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	if (!EFI_ERROR(DiskImageOpen(&prefetcher.disk, device, L"\\efi\\boot\\boot.iso", prefetcher.iso_file))) {
+		err = IsoOpen(&prefetcher.iso, DiskImageReader, &prefetcher.disk);
+	} else {
+		err = IsoOpen(&prefetcher.iso, IsoFileReader, prefetcher.iso_file);
+	}
+	if (!EFI_ERROR(err)) {
+		err = uefi_call_wrapper(BS->CreateEvent, 5, EVT_TIMER|EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+			(EFI_EVENT_NOTIFY)PrefetchTick, NULL, &prefetcher.timer);
+	}
+	if (EFI_ERROR(err)) {
+		IsoClose(&prefetcher.iso);
+		DiskImageClose(&prefetcher.disk);
+		uefi_call_wrapper(prefetcher.iso_file->Close, 1, prefetcher.iso_file);
+		prefetcher.iso_file = NULL;
+	}
+	return err;
+}
+
+/*
+ * Points the prefetcher at a boot entry. Entries that boot the same kernel
+ * and initrd keep what has been read; for any other, it starts over.
+ */
+VOID PrefetchSelect(LinuxBootOption *option) {
+	CHAR8 *paths[PrefetchFileCount];
+	EFI_TPL tpl;
+	UINTN i;
+
+	// Only boot.iso is open; entries found by discovery are read at boot.
+	if (!prefetcher.iso_file || option->iso_path || !option->kernel_path || !option->initrd_path) {
+		return;
+	}
+
+	paths[PrefetchKernel] = option->kernel_path;
+	paths[PrefetchInitRD] = option->initrd_path;
+	if (prefetcher.files[PrefetchKernel].path && prefetcher.files[PrefetchInitRD].path &&
+			strcmpa(prefetcher.files[PrefetchKernel].path, paths[PrefetchKernel]) == 0 &&
+			strcmpa(prefetcher.files[PrefetchInitRD].path, paths[PrefetchInitRD]) == 0) {
+		return;
+	}
+
+	tpl = uefi_call_wrapper(BS->RaiseTPL, 1, TPL_CALLBACK);
+	PrefetchStop();
+	prefetcher.status = EFI_SUCCESS;
+	for (i = 0; i < PrefetchFileCount; i++) {
+		PrefetchFile *file = &prefetcher.files[i];
+		EFI_STATUS err;
+
+		PrefetchDiscard(file);
+		file->path = paths[i];
+		err = IsoLookup(&prefetcher.iso, paths[i], &file->extent);
+		if (!EFI_ERROR(err) && (file->extent.directory || file->extent.size == 0)) {
+			err = EFI_NOT_FOUND;
+		}
+		if (!EFI_ERROR(err)) {
+			file->length = file->extent.size;
+			if (i == PrefetchInitRD && file->length > PREFETCH_INITRD_LIMIT) {
+				file->length = PREFETCH_INITRD_LIMIT;
+			}
+			err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData,
+				EFI_SIZE_TO_PAGES(file->length), &file->buffer);
+		}
+		if (EFI_ERROR(err)) {
+			// Remember which files the failure is about, and leave them to be
+			// read, and the error reported, when the entry is booted.
+			file->length = 0;
+			prefetcher.status = err;
+		}
+	}
+
+	if (!EFI_ERROR(prefetcher.status)) {
+		prefetcher.running = !EFI_ERROR(uefi_call_wrapper(BS->SetTimer, 3, prefetcher.timer, TimerPeriodic,
+			PREFETCH_PERIOD));
+	}
+	uefi_call_wrapper(BS->RestoreTPL, 1, tpl);
+}
+
+/*
+ * Hands over the kernel of the given entry, reading whatever the timer did
+ * not get to, along with the part of its initrd that has been read. The
+ * rest of the initrd is left for the caller to read straight to where it is
+ * wanted. Returns EFI_NOT_FOUND if nothing was prefetched for this entry, in
+ * which case the caller reads the files itself.
+ */
+EFI_STATUS PrefetchTake(LinuxBootOption *option, PrefetchedFiles *taken) {
+	PrefetchFile *files = prefetcher.files;
+	EFI_STATUS err;
+
+	PrefetchStop();
+	if (!prefetcher.iso_file || !files[PrefetchKernel].buffer || !files[PrefetchInitRD].buffer ||
+			option->iso_path || !option->kernel_path || !option->initrd_path ||
+			strcmpa(files[PrefetchKernel].path, option->kernel_path) != 0 ||
+			strcmpa(files[PrefetchInitRD].path, option->initrd_path) != 0) {
+		return EFI_NOT_FOUND;
+	}
+
+	LogDebug(LogTagKernel, L"%ld of %ld bytes of the kernel and %ld of %ld bytes of the initrd were read "
+		L"while the menu was up.\n", files[PrefetchKernel].done, files[PrefetchKernel].extent.size,
+		files[PrefetchInitRD].done, files[PrefetchInitRD].extent.size);
+
+	err = prefetcher.status;
+	while (!EFI_ERROR(err)) {
+		err = PrefetchStep(PrefetchKernel + 1);
+	}
+	if (err != EFI_END_OF_FILE) {
+		return err;
+	}
+
+	taken->kernel = (VOID *)(UINTN)files[PrefetchKernel].buffer;
+	taken->kernel_size = files[PrefetchKernel].extent.size;
+	taken->initrd = (VOID *)(UINTN)files[PrefetchInitRD].buffer;
+	taken->initrd_read = files[PrefetchInitRD].done;
+	taken->initrd_pages = EFI_SIZE_TO_PAGES(files[PrefetchInitRD].length);
+	ZeroMem(files, sizeof(prefetcher.files));
+	return EFI_SUCCESS;
+}
+
+/* Stops the prefetcher and gives back everything it still holds. */
+VOID PrefetchRelease(VOID) {
+	UINTN i;
+
+	if (!prefetcher.iso_file) {
+		return;
+	}
+
+	PrefetchStop();
+	uefi_call_wrapper(BS->CloseEvent, 1, prefetcher.timer);
+	for (i = 0; i < PrefetchFileCount; i++) {
+		PrefetchDiscard(&prefetcher.files[i]);
+	}
+	IsoClose(&prefetcher.iso);
+	DiskImageClose(&prefetcher.disk);
+	uefi_call_wrapper(prefetcher.iso_file->Close, 1, prefetcher.iso_file);
+	ZeroMem(&prefetcher, sizeof(prefetcher));
+}
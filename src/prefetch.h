@@ -0,0 +1,52 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _prefetch_h
+#define _prefetch_h
+
+/* Read at most this much at each timer tick, which bounds how long a key
+ * press can go unnoticed while a read is in progress. */
+#define PREFETCH_CHUNK_SIZE (256 * 1024)
+/* The tick period, in units of 100ns. */
+#define PREFETCH_PERIOD (10 * 1000)
+
+/* The initrd is streamed into the kernel's own buffer once the kernel asks
+ * for it, so only its start is worth reading ahead of time; this caps the
+ * memory the prefetcher holds on to on top of what the kernel allocates. */
+#define PREFETCH_INITRD_LIMIT (64 * 1024 * 1024)
+
+/*
+ * What PrefetchTake() hands over: the whole kernel, and however much of the
+ * start of the initrd had been read by then. The caller frees the pages.
+ */
+typedef struct PrefetchedFiles {
+	VOID *kernel;
+	UINTN kernel_size;
+	VOID *initrd;
+	UINTN initrd_read;
+	UINTN initrd_pages;
+} PrefetchedFiles;
+
+EFI_STATUS PrefetchInitialize(EFI_HANDLE device, EFI_FILE_HANDLE root_dir);
+VOID PrefetchSelect(LinuxBootOption *option);
+VOID PrefetchStop(VOID);
+EFI_STATUS PrefetchTake(LinuxBootOption *option, PrefetchedFiles *files);
+VOID PrefetchRelease(VOID);
+
+#endif
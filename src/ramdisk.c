@@ -0,0 +1,206 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * The "toram" boot option. Instead of leaving the live system to copy the
+ * ISO file to memory through its own, slow, live-media code, we read it
+ * once at full speed before the kernel starts and hand it over in memory,
+ * so the kernel and initrd come from the copy and the stick can be pulled
+ * out once the system is up.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "iso9660.h"
+#include "disk.h"
+#include "ramdisk.h"
+#include "snapshot.h"
+#include "verify.h"
+#include "utils.h"
+#include "log.h"
+
+#define EFI_RAM_DISK_PROTOCOL_GUID \
+	{ 0xab38a0df, 0x6873, 0x44a9, { 0x87, 0xe6, 0xd4, 0xeb, 0x56, 0x14, 0x84, 0x49 } }
+#define EFI_VIRTUAL_CD_GUID \
+	{ 0x3d5abd30, 0x4175, 0x87ce, { 0x6d, 0x64, 0xd2, 0xad, 0xe5, 0x23, 0xc4, 0xbb } }
+
+typedef EFI_STATUS (FIRMWARE_CALLBACK *EFI_RAM_DISK_REGISTER_RAMDISK)(
+	UINT64 RamDiskBase,
+	UINT64 RamDiskSize,
+	EFI_GUID *RamDiskType,
+	EFI_DEVICE_PATH *ParentDevicePath,
+	EFI_DEVICE_PATH **DevicePath
+);
+
+typedef EFI_STATUS (FIRMWARE_CALLBACK *EFI_RAM_DISK_UNREGISTER_RAMDISK)(
+	EFI_DEVICE_PATH *DevicePath
+);
+
+/* Only in UEFI 2.6 and later, and so in none of the Macs' own firmware. */
+typedef struct {
+	EFI_RAM_DISK_REGISTER_RAMDISK Register;
+	EFI_RAM_DISK_UNREGISTER_RAMDISK Unregister;
+} EFI_RAM_DISK_PROTOCOL;
+
+static EFI_GUID ram_disk_guid = EFI_RAM_DISK_PROTOCOL_GUID;
+static EFI_GUID virtual_cd_guid = EFI_VIRTUAL_CD_GUID;
+
+/*
+ * Allocates reserved memory, which neither the firmware nor the kernel will
+ * hand out to anybody else, aligned by allocating a little extra and giving
+ * back what lies outside the aligned range.
+ */
+static EFI_STATUS RamDiskAllocate(RamDisk *disk) {
+	UINTN alignment_pages = EFI_SIZE_TO_PAGES(RAM_DISK_ALIGNMENT), slack;
+	EFI_PHYSICAL_ADDRESS address, aligned;
+	EFI_STATUS err;
+
+	disk->pages = EFI_SIZE_TO_PAGES(disk->size);
+	disk->pages = (disk->pages + alignment_pages - 1) / alignment_pages * alignment_pages;
+	err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiReservedMemoryType,
+		disk->pages + alignment_pages, &address);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	aligned = (address + RAM_DISK_ALIGNMENT - 1) & ~((EFI_PHYSICAL_ADDRESS)RAM_DISK_ALIGNMENT - 1);
+	slack = EFI_SIZE_TO_PAGES(aligned - address);
+	if (slack) {
+		uefi_call_wrapper(BS->FreePages, 2, address, slack);
+	}
+	if (alignment_pages - slack) {
+		uefi_call_wrapper(BS->FreePages, 2, aligned + disk->pages * EFI_PAGE_SIZE, alignment_pages - slack);
+	}
+	disk->base = aligned;
+	return EFI_SUCCESS;
+}
+
+/*
+ * Reads the whole image in large sequential requests, hashing it on the way
+ * when there is a digest to check it against.
+ */
+static EFI_STATUS RamDiskFill(RamDisk *disk, IsoReadFunction read, VOID *context, UINT8 *expected) {
+	UINT8 *buffer = (UINT8 *)(UINTN)disk->base;
+	UINT64 offset;
+	EFI_STATUS err;
+
+	if (expected) {
+		err = VerifyStream(read, context, disk->size, buffer, expected);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+	} else {
+		for (offset = 0; offset < disk->size; offset += RAM_DISK_CHUNK_SIZE) {
+			UINTN chunk = disk->size - offset < RAM_DISK_CHUNK_SIZE ? disk->size - offset : RAM_DISK_CHUNK_SIZE;
+
+			err = read(context, offset, chunk, buffer + offset);
+			if (EFI_ERROR(err)) {
+				return err;
+			}
+		}
+	}
+
+	// The tail of the last page would otherwise hold whatever was there.
+	ZeroMem(buffer + disk->size, disk->pages * EFI_PAGE_SIZE - disk->size);
+	return EFI_SUCCESS;
+}
+
+/*
+ * Copies the ISO file at path from the partition on device into memory, and
+ * registers the copy with the firmware if it has the RAM disk protocol.
+ * With an expected digest, the copy is verified as it is made, and
+ * EFI_CRC_ERROR is returned if it does not match.
+ */
+EFI_STATUS RamDiskLoadISO(RamDisk *disk, EFI_HANDLE device, EFI_FILE_HANDLE root_dir, CHAR16 *path,
+		UINT8 *expected) {
+	EFI_RAM_DISK_PROTOCOL *protocol;
+	EFI_FILE_HANDLE iso_file;
+	EFI_FILE_INFO *info;
+	DiskImage image;
+	EFI_STATUS err;
+
+	ZeroMem(disk, sizeof(RamDisk));
+	err = uefi_call_wrapper(root_dir->Open, 5, root_dir, &iso_file, path, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	info = LibFileInfo(iso_file);
+	if (!info) {
+		uefi_call_wrapper(iso_file->Close, 1, iso_file);
+		return EFI_DEVICE_ERROR;
+	}
+	disk->size = info->FileSize;
+	FreePool(info);
+
+	err = disk->size ? RamDiskAllocate(disk) : EFI_NOT_FOUND;
+	if (!EFI_ERROR(err)) {
+		if (!EFI_ERROR(DiskImageOpen(&image, device, path, iso_file))) {
+			err = RamDiskFill(disk, DiskImageReader, &image, expected);
+			DiskImageClose(&image);
+		} else {
+			err = RamDiskFill(disk, IsoFileReader, iso_file, expected);
+		}
+	}
+	uefi_call_wrapper(iso_file->Close, 1, iso_file);
+	if (EFI_ERROR(err)) {
+		RamDiskRelease(disk);
+		return err;
+	}
+
+	err = LibLocateProtocol(&ram_disk_guid, (VOID **)&protocol);
+	if (!EFI_ERROR(err)) {
+		err = uefi_call_wrapper(protocol->Register, 5, disk->base, disk->pages * EFI_PAGE_SIZE, &virtual_cd_guid,
+			NULL, &disk->device_path);
+	}
+	if (EFI_ERROR(err)) {
+		disk->device_path = NULL;
+		LogInfo(LogTagDisk, L"No firmware RAM disk (%r); the kernel is told where the copy is.\n", err);
+	}
+
+	LogDebug(LogTagDisk, L"Copied %ld bytes of the ISO file to memory at 0x%lx.\n", disk->size, disk->base);
+	return EFI_SUCCESS;
+}
+
+VOID RamDiskRelease(RamDisk *disk) {
+	EFI_RAM_DISK_PROTOCOL *protocol;
+
+	if (disk->device_path && !EFI_ERROR(LibLocateProtocol(&ram_disk_guid, (VOID **)&protocol))) {
+		uefi_call_wrapper(protocol->Unregister, 1, disk->device_path);
+	}
+	if (disk->device_path) {
+		FreePool(disk->device_path);
+	}
+	if (disk->base) {
+		uefi_call_wrapper(BS->FreePages, 2, disk->base, disk->pages);
+	}
+	ZeroMem(disk, sizeof(RamDisk));
+}
+
+/* An IsoReadFunction for the copy. */
+EFI_STATUS RamDiskReader(VOID *context, UINT64 offset, UINTN size, VOID *buffer) {
+	RamDisk *disk = context;
+
+	if (offset > disk->size || size > disk->size - offset) {
+		return EFI_END_OF_FILE;
+	}
+	CopyMem(buffer, (UINT8 *)(UINTN)disk->base + offset, size);
+	return EFI_SUCCESS;
+}
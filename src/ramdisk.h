@@ -0,0 +1,47 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _ramdisk_h
+#define _ramdisk_h
+
+/* The ISO file is copied into memory this much at a time. */
+#define RAM_DISK_CHUNK_SIZE (16 * 1024 * 1024)
+/* The kernel maps persistent memory in 2 MiB sections, so the copy starts
+ * and ends on such a boundary. */
+#define RAM_DISK_ALIGNMENT (2 * 1024 * 1024)
+
+/*
+ * A copy of the ISO file in reserved memory. When the firmware has the RAM
+ * disk protocol, it is registered as a virtual CD, which the firmware shows
+ * as a block device and the kernel as a pmem device through ACPI NFIT; when
+ * not, device_path is NULL and the kernel has to be told where it is.
+ */
+typedef struct RamDisk {
+	EFI_PHYSICAL_ADDRESS base;
+	UINT64 size;
+	UINTN pages;
+	EFI_DEVICE_PATH *device_path;
+} RamDisk;
+
+EFI_STATUS RamDiskLoadISO(RamDisk *disk, EFI_HANDLE device, EFI_FILE_HANDLE root_dir, CHAR16 *path,
+	UINT8 *expected);
+VOID RamDiskRelease(RamDisk *disk);
+EFI_STATUS RamDiskReader(VOID *context, UINT64 offset, UINTN size, VOID *buffer);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * On Macs the text console is drawn through the graphics adapter, one glyph
+ * at a time, so clearing and reprinting a whole menu for every keypress is
+ * slow enough to see. Instead we remember what each row shows and touch only
+ * the rows whose contents changed.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "screen.h"
+
+#define SCREEN_DEFAULT_ATTRIBUTE (EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK)
+
+/*
+ * Takes over the console from the cursor down, or the whole console when
+ * clear is set. If fewer than rows_needed rows are left below the cursor,
+ * the console is scrolled up to make room.
+ */
+VOID ScreenInitialize(Screen *screen, UINTN rows_needed, BOOLEAN clear) {
+	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
+	UINTN columns = 80, rows = 25, i;
+	EFI_STATUS err;
+
+	ZeroMem(screen, sizeof(Screen));
+	err = uefi_call_wrapper(out->QueryMode, 4, out, out->Mode->Mode, &columns, &rows);
+	if (EFI_ERROR(err) || columns == 0 || rows == 0) {
+		columns = 80;
+		rows = 25;
+	}
+
+	// Nothing is ever written to the last column, where some firmware wraps
+	// (and at the bottom of the screen, scrolls) as soon as it is filled.
+	screen->columns = (columns > SCREEN_MAX_COLUMNS ? SCREEN_MAX_COLUMNS : columns) - 1;
+
+	if (clear) {
+		uefi_call_wrapper(out->ClearScreen, 1, out);
+		screen->top = 0;
+	} else {
+		screen->top = out->Mode->CursorRow;
+		if (rows_needed > rows) {
+			rows_needed = rows;
+		}
+		if (screen->top + rows_needed > rows) {
+			CHAR16 newlines[2 * SCREEN_MAX_ROWS + 1];
+			UINTN scroll = screen->top + rows_needed - rows;
+
+			for (i = 0; i < scroll && i < SCREEN_MAX_ROWS; i++) {
+				newlines[2 * i] = '\r';
+				newlines[2 * i + 1] = '\n';
+			}
+			newlines[2 * i] = '\0';
+
+			uefi_call_wrapper(out->SetCursorPosition, 3, out, 0, rows - 1);
+			uefi_call_wrapper(out->OutputString, 2, out, newlines);
+			screen->top = rows - rows_needed;
+		}
+	}
+
+	screen->rows = rows - screen->top;
+	if (screen->rows > SCREEN_MAX_ROWS) {
+		screen->rows = SCREEN_MAX_ROWS;
+	}
+	for (i = 0; i < screen->rows; i++) {
+		screen->lines[i].attribute = SCREEN_DEFAULT_ATTRIBUTE;
+	}
+}
+
+/*
+ * Changes what a row should show. The row is only marked for redrawing if
+ * the text or the color differs from what it holds already. Text past the
+ * width of the screen is cut off.
+ */
+VOID ScreenSetLine(Screen *screen, UINTN row, CHAR16 *text, UINTN attribute) {
+	ScreenLine *line;
+	UINTN length;
+
+	if (row >= screen->rows) {
+		return;
+	}
+	line = &screen->lines[row];
+
+	for (length = 0; text[length] && length < screen->columns; length++) {
+		if (length >= line->length || text[length] != line->text[length]) {
+			break;
+		}
+	}
+
+	// Unchanged if the common prefix is the entire old and the entire new line.
+	if (length == line->length && (length == screen->columns || !text[length]) &&
+			attribute == line->attribute) {
+		return;
+	}
+
+	for (; text[length] && length < screen->columns; length++) {
+		line->text[length] = text[length];
+	}
+	line->text[length] = '\0';
+	line->length = length;
+	line->attribute = attribute;
+	line->dirty = TRUE;
+}
+
+/*
+ * Blanks every row from the given one to the bottom of the screen.
+ */
+VOID ScreenClearLines(Screen *screen, UINTN from) {
+	for (; from < screen->rows; from++) {
+		ScreenSetLine(screen, from, L"", SCREEN_DEFAULT_ATTRIBUTE);
+	}
+}
+
+/*
+ * Redraws the rows that changed since the last flush, each with a single
+ * OutputString call. Whatever is left of a longer previous line is
+ * overwritten with spaces in the same call.
+ */
+VOID ScreenFlush(Screen *screen) {
+	SIMPLE_TEXT_OUTPUT_INTERFACE *out = ST->ConOut;
+	CHAR16 buffer[SCREEN_MAX_COLUMNS + 1];
+	UINTN row, i;
+	BOOLEAN changed_attribute = FALSE;
+
+	for (row = 0; row < screen->rows; row++) {
+		ScreenLine *line = &screen->lines[row];
+		if (!line->dirty) {
+			continue;
+		}
+		line->dirty = FALSE;
+
+		CopyMem(buffer, line->text, line->length * sizeof(CHAR16));
+		for (i = line->length; i < line->drawn; i++) {
+			buffer[i] = ' ';
+		}
+		buffer[i] = '\0';
+		line->drawn = line->length;
+
+		if (i == 0) {
+			continue;
+		}
+
+		if ((UINTN)out->Mode->Attribute != line->attribute) {
+			uefi_call_wrapper(out->SetAttribute, 2, out, line->attribute);
+			changed_attribute = TRUE;
+		}
+		uefi_call_wrapper(out->SetCursorPosition, 3, out, 0, screen->top + row);
+		uefi_call_wrapper(out->OutputString, 2, out, buffer);
+	}
+
+	if (changed_attribute && (UINTN)out->Mode->Attribute != SCREEN_DEFAULT_ATTRIBUTE) {
+		uefi_call_wrapper(out->SetAttribute, 2, out, SCREEN_DEFAULT_ATTRIBUTE);
+	}
+}
+
+/*
+ * Puts the cursor at the start of a row, so that ordinary output carries on
+ * from there once the screen is no longer being managed.
+ */
+VOID ScreenSetCursor(Screen *screen, UINTN row) {
+	if (row >= screen->rows) {
+		row = screen->rows - 1;
+	}
+	uefi_call_wrapper(ST->ConOut->SetCursorPosition, 3, ST->ConOut, 0, screen->top + row);
+}
@@ -0,0 +1,52 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _screen_h
+#define _screen_h
+
+#define SCREEN_MAX_ROWS 64
+#define SCREEN_MAX_COLUMNS 160
+
+typedef struct ScreenLine {
+	CHAR16 text[SCREEN_MAX_COLUMNS + 1];
+	UINTN length;
+	UINTN drawn; // How many columns of this row currently hold our text.
+	UINTN attribute;
+	BOOLEAN dirty;
+} ScreenLine;
+
+/*
+ * A model of the rows of the text console that we own, from top down to the
+ * bottom of the screen. Lines are set as a whole and compared with what is
+ * already there; ScreenFlush() then only redraws the ones that changed.
+ */
+typedef struct Screen {
+	UINTN top;
+	UINTN rows;
+	UINTN columns;
+	ScreenLine lines[SCREEN_MAX_ROWS];
+} Screen;
+
+VOID ScreenInitialize(Screen *screen, UINTN rows_needed, BOOLEAN clear);
+VOID ScreenSetLine(Screen *screen, UINTN row, CHAR16 *text, UINTN attribute);
+VOID ScreenClearLines(Screen *screen, UINTN from);
+VOID ScreenFlush(Screen *screen);
+VOID ScreenSetCursor(Screen *screen, UINTN row);
+
+#endif
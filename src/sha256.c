@@ -0,0 +1,270 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * SHA-256 (FIPS 180-4). The block function uses the x86 SHA extensions when
+ * CPUID reports them, and a portable implementation otherwise.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "sha256.h"
+
+#if defined(__x86_64__)
+	#include <immintrin.h>
+	#define SHA256_HAVE_SHA_EXTENSIONS
+#endif
+
+typedef VOID (*Sha256BlockFunction)(UINT32 *state, const UINT8 *data, UINTN blocks);
+
+static const UINT32 sha256_round_constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const UINT32 sha256_initial_state[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROTR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)	(((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SIGMA0(x)	(ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SIGMA1(x)	(ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define GAMMA0(x)	(ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define GAMMA1(x)	(ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+static VOID Sha256BlocksPortable(UINT32 *state, const UINT8 *data, UINTN blocks) {
+	UINT32 w[64], a, b, c, d, e, f, g, h, t1, t2;
+	UINTN i;
+
+	while (blocks--) {
+		for (i = 0; i < 16; i++) {
+			w[i] = ((UINT32)data[i * 4] << 24) | ((UINT32)data[i * 4 + 1] << 16) |
+				((UINT32)data[i * 4 + 2] << 8) | data[i * 4 + 3];
+		}
+		for (i = 16; i < 64; i++) {
+			w[i] = GAMMA1(w[i - 2]) + w[i - 7] + GAMMA0(w[i - 15]) + w[i - 16];
+		}
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+		for (i = 0; i < 64; i++) {
+			t1 = h + SIGMA1(e) + CH(e, f, g) + sha256_round_constants[i] + w[i];
+			t2 = SIGMA0(a) + MAJ(a, b, c);
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		data += SHA256_BLOCK_SIZE;
+	}
+}
+
+#ifdef SHA256_HAVE_SHA_EXTENSIONS
+/*
+ * Four rounds per sha256rnds2 pair, with the message schedule for the next
+ * group computed alongside. This follows the layout in Intel's reference
+ * code; the state is kept as ABEF/CDGH, which is what the instructions want.
+ */
+__attribute__((target("sha,sse4.1")))
+static VOID Sha256BlocksShaExtensions(UINT32 *state, const UINT8 *data, UINTN blocks) {
+	const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, saved0, saved1, message, temp, w[4];
+	UINTN group;
+
+	temp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	temp = _mm_shuffle_epi32(temp, 0xB1);
+	state1 = _mm_shuffle_epi32(state1, 0x1B);
+	state0 = _mm_alignr_epi8(temp, state1, 8);
+	state1 = _mm_blend_epi16(state1, temp, 0xF0);
+
+	while (blocks--) {
+		saved0 = state0;
+		saved1 = state1;
+
+		for (group = 0; group < 4; group++) {
+			w[group] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + group * 16)), byte_swap);
+		}
+
+		#pragma GCC unroll 16
+		for (group = 0; group < 16; group++) {
+			__m128i *current = &w[group % 4];
+
+			message = _mm_add_epi32(*current,
+				_mm_loadu_si128((const __m128i *)&sha256_round_constants[group * 4]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+
+			if (group >= 3 && group <= 14) {
+				__m128i *following = &w[(group + 1) % 4];
+
+				temp = _mm_alignr_epi8(*current, w[(group + 3) % 4], 4);
+				*following = _mm_add_epi32(*following, temp);
+				*following = _mm_sha256msg2_epu32(*following, *current);
+			}
+
+			message = _mm_shuffle_epi32(message, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+
+			if (group >= 1 && group <= 12) {
+				w[(group + 3) % 4] = _mm_sha256msg1_epu32(w[(group + 3) % 4], *current);
+			}
+		}
+
+		state0 = _mm_add_epi32(state0, saved0);
+		state1 = _mm_add_epi32(state1, saved1);
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	temp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(temp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, temp, 8);
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static VOID Cpuid(UINT32 leaf, UINT32 subleaf, UINT32 *registers) {
+	__asm__ __volatile__("cpuid"
+		: "=a" (registers[0]), "=b" (registers[1]), "=c" (registers[2]), "=d" (registers[3])
+		: "a" (leaf), "c" (subleaf));
+}
+#endif
+
+static Sha256BlockFunction sha256_blocks;
+
+/* Picks the block function once; every processor in the machine agrees. */
+static Sha256BlockFunction Sha256SelectBlockFunction(VOID) {
+	if (sha256_blocks) {
+		return sha256_blocks;
+	}
+
+	sha256_blocks = Sha256BlocksPortable;
+#ifdef SHA256_HAVE_SHA_EXTENSIONS
+	{
+		UINT32 registers[4];
+
+		Cpuid(0, 0, registers);
+		if (registers[0] >= 7) {
+			BOOLEAN sse41, sha;
+
+			Cpuid(1, 0, registers);
+			sse41 = (registers[2] & (1 << 19)) != 0;
+			Cpuid(7, 0, registers);
+			sha = (registers[1] & (1 << 29)) != 0;
+
+			if (sse41 && sha) {
+				sha256_blocks = Sha256BlocksShaExtensions;
+			}
+		}
+	}
+#endif
+	return sha256_blocks;
+}
+
+BOOLEAN Sha256Accelerated(VOID) {
+	return Sha256SelectBlockFunction() != Sha256BlocksPortable;
+}
+
+VOID Sha256Init(Sha256Context *context) {
+	Sha256SelectBlockFunction();
+	CopyMem(context->state, (VOID *)sha256_initial_state, sizeof(context->state));
+	context->length = 0;
+	context->used = 0;
+}
+
+VOID Sha256Update(Sha256Context *context, const VOID *data, UINTN size) {
+	const UINT8 *bytes = data;
+	UINTN blocks;
+
+	context->length += size;
+
+	if (context->used > 0) {
+		UINTN take = SHA256_BLOCK_SIZE - context->used;
+
+		if (take > size) {
+			take = size;
+		}
+		CopyMem(context->buffer + context->used, (VOID *)bytes, take);
+		context->used += take;
+		bytes += take;
+		size -= take;
+
+		if (context->used < SHA256_BLOCK_SIZE) {
+			return;
+		}
+		sha256_blocks(context->state, context->buffer, 1);
+		context->used = 0;
+	}
+
+	// Whole blocks are hashed straight from the caller's buffer.
+	blocks = size / SHA256_BLOCK_SIZE;
+	if (blocks > 0) {
+		sha256_blocks(context->state, bytes, blocks);
+		bytes += blocks * SHA256_BLOCK_SIZE;
+		size -= blocks * SHA256_BLOCK_SIZE;
+	}
+
+	if (size > 0) {
+		CopyMem(context->buffer, (VOID *)bytes, size);
+		context->used = size;
+	}
+}
+
+VOID Sha256Final(Sha256Context *context, UINT8 *digest) {
+	UINT64 bits = context->length * 8;
+	UINTN i;
+
+	context->buffer[context->used++] = 0x80;
+	if (context->used > SHA256_BLOCK_SIZE - 8) {
+		SetMem(context->buffer + context->used, SHA256_BLOCK_SIZE - context->used, 0);
+		sha256_blocks(context->state, context->buffer, 1);
+		context->used = 0;
+	}
+	SetMem(context->buffer + context->used, SHA256_BLOCK_SIZE - 8 - context->used, 0);
+
+	for (i = 0; i < 8; i++) {
+		context->buffer[SHA256_BLOCK_SIZE - 1 - i] = (UINT8)(bits >> (i * 8));
+	}
+	sha256_blocks(context->state, context->buffer, 1);
+
+	for (i = 0; i < 8; i++) {
+		digest[i * 4] = (UINT8)(context->state[i] >> 24);
+		digest[i * 4 + 1] = (UINT8)(context->state[i] >> 16);
+		digest[i * 4 + 2] = (UINT8)(context->state[i] >> 8);
+		digest[i * 4 + 3] = (UINT8)context->state[i];
+	}
+}
+
+VOID Sha256Digest(const VOID *data, UINTN size, UINT8 *digest) {
+	Sha256Context context;
+
+	Sha256Init(&context);
+	Sha256Update(&context, data, size);
+	Sha256Final(&context, digest);
+}
@@ -0,0 +1,44 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _sha256_h
+#define _sha256_h
+
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct Sha256Context {
+	UINT32 state[8];
+	UINT64 length;
+	UINT8 buffer[SHA256_BLOCK_SIZE];
+	UINTN used;
+} Sha256Context;
+
+/*
+ * None of these call into the firmware, so they are safe to run on
+ * application processors started through the MP Services protocol.
+ */
+VOID Sha256Init(Sha256Context *context);
+VOID Sha256Update(Sha256Context *context, const VOID *data, UINTN size);
+VOID Sha256Final(Sha256Context *context, UINT8 *digest);
+VOID Sha256Digest(const VOID *data, UINTN size, UINT8 *digest);
+
+BOOLEAN Sha256Accelerated(VOID);
+
+#endif
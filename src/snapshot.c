@@ -0,0 +1,166 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Answers "is this file there, and how big is it" without going back to the
+ * disk. Every Open through Apple's FAT driver walks the path again, which is
+ * slow on USB sticks, so each directory we care about is listed just once.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAX_PATH 512
+
+static CHAR16 SnapshotLower(CHAR16 c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static UINT32 SnapshotHash(CHAR16 *path) {
+	UINT32 hash = 2166136261U;
+
+	for (; *path; path++) {
+		hash ^= SnapshotLower(*path);
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static BOOLEAN SnapshotPathsMatch(CHAR16 *a, CHAR16 *b) {
+	for (; *a && *b; a++, b++) {
+		if (SnapshotLower(*a) != SnapshotLower(*b)) {
+			return FALSE;
+		}
+	}
+	return *a == *b;
+}
+
+VOID SnapshotInitialize(DirectorySnapshot *snapshot) {
+	ArenaInitialize(&snapshot->arena, 4096);
+	ZeroMem(snapshot->buckets, sizeof(snapshot->buckets));
+}
+
+static EFI_STATUS SnapshotInsert(DirectorySnapshot *snapshot, CHAR16 *directory, EFI_FILE_INFO *info) {
+	UINTN directory_length = StrLen(directory), name_length = StrLen(info->FileName);
+	SnapshotEntry *entry;
+	CHAR16 *p;
+
+	// The root is "\", so only other directories need a separator added.
+	if (directory[directory_length - 1] == '\\') {
+		directory_length--;
+	}
+
+	entry = ArenaAllocate(&snapshot->arena,
+		sizeof(SnapshotEntry) + (directory_length + 1 + name_length + 1) * sizeof(CHAR16));
+	if (!entry) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	p = entry->path;
+	CopyMem(p, directory, directory_length * sizeof(CHAR16));
+	p += directory_length;
+	*p++ = '\\';
+	CopyMem(p, info->FileName, (name_length + 1) * sizeof(CHAR16));
+
+	entry->hash = SnapshotHash(entry->path);
+	entry->size = info->FileSize;
+	entry->modification_time = info->ModificationTime;
+	entry->directory = (info->Attribute & EFI_FILE_DIRECTORY) != 0;
+	entry->next = snapshot->buckets[entry->hash % SNAPSHOT_BUCKETS];
+	snapshot->buckets[entry->hash % SNAPSHOT_BUCKETS] = entry;
+	return EFI_SUCCESS;
+}
+
+/* Lists the directory at path (such as L"\\efi\\boot") into the snapshot. */
+EFI_STATUS SnapshotAddDirectory(DirectorySnapshot *snapshot, EFI_FILE_HANDLE root_dir, CHAR16 *path) {
+	EFI_FILE_HANDLE dir;
+	EFI_FILE_INFO *info;
+	UINTN capacity = SIZE_OF_EFI_FILE_INFO + SNAPSHOT_MAX_PATH * sizeof(CHAR16);
+	EFI_STATUS err;
+
+	err = uefi_call_wrapper(root_dir->Open, 5, root_dir, &dir, path, EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+
+	info = AllocatePool(capacity);
+	if (!info) {
+		uefi_call_wrapper(dir->Close, 1, dir);
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	for (;;) {
+		UINTN size = capacity;
+
+		err = uefi_call_wrapper(dir->Read, 3, dir, &size, info);
+		if (err == EFI_BUFFER_TOO_SMALL) {
+			// An unusually long name; grow the buffer and read the entry again.
+			FreePool(info);
+			capacity = size;
+			info = AllocatePool(capacity);
+			if (!info) {
+				err = EFI_OUT_OF_RESOURCES;
+				break;
+			}
+			continue;
+		} else if (EFI_ERROR(err) || size == 0) {
+			break;
+		}
+
+		if (StrCmp(info->FileName, L".") == 0 || StrCmp(info->FileName, L"..") == 0) {
+			continue;
+		}
+
+		err = SnapshotInsert(snapshot, path, info);
+		if (EFI_ERROR(err)) {
+			break;
+		}
+	}
+
+	if (info) {
+		FreePool(info);
+	}
+	uefi_call_wrapper(dir->Close, 1, dir);
+	return err;
+}
+
+SnapshotEntry* SnapshotFind(DirectorySnapshot *snapshot, CHAR16 *path) {
+	UINT32 hash = SnapshotHash(path);
+	SnapshotEntry *entry;
+
+	for (entry = snapshot->buckets[hash % SNAPSHOT_BUCKETS]; entry; entry = entry->next) {
+		if (entry->hash == hash && SnapshotPathsMatch(entry->path, path)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+BOOLEAN SnapshotFileExists(DirectorySnapshot *snapshot, CHAR16 *path) {
+	SnapshotEntry *entry = SnapshotFind(snapshot, path);
+
+	return entry && !entry->directory;
+}
+
+VOID SnapshotRelease(DirectorySnapshot *snapshot) {
+	ArenaRelease(&snapshot->arena);
+	ZeroMem(snapshot->buckets, sizeof(snapshot->buckets));
+}
@@ -0,0 +1,49 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _snapshot_h
+#define _snapshot_h
+
+#define SNAPSHOT_BUCKETS 64
+
+typedef struct SnapshotEntry {
+	struct SnapshotEntry *next;
+	UINT32 hash;
+	UINT64 size;
+	EFI_TIME modification_time;
+	BOOLEAN directory;
+	CHAR16 path[];
+} SnapshotEntry;
+
+/*
+ * The contents of a few directories, read once. Paths are full paths from
+ * the root of the volume and, like FAT, compare without regard to case.
+ */
+typedef struct DirectorySnapshot {
+	MemoryArena arena;
+	SnapshotEntry *buckets[SNAPSHOT_BUCKETS];
+} DirectorySnapshot;
+
+VOID SnapshotInitialize(DirectorySnapshot *snapshot);
+EFI_STATUS SnapshotAddDirectory(DirectorySnapshot *snapshot, EFI_FILE_HANDLE root_dir, CHAR16 *path);
+SnapshotEntry* SnapshotFind(DirectorySnapshot *snapshot, CHAR16 *path);
+BOOLEAN SnapshotFileExists(DirectorySnapshot *snapshot, CHAR16 *path);
+VOID SnapshotRelease(DirectorySnapshot *snapshot);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Reads files in large, page-aligned chunks so that kernels, initrds and ISO
+ * images never need a pool allocation the size of the whole file, and so that
+ * whatever consumes the data (a hash, a copy) can work on it as it arrives.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "stream.h"
+
+/*
+ * Reads the rest of an open file, chunk by chunk, as described by options.
+ * The total number of bytes read is stored in size. When reading into a
+ * destination, a file that does not fit fails with EFI_BUFFER_TOO_SMALL.
+ */
+EFI_STATUS StreamFile(EFI_FILE_HANDLE handle, StreamOptions *options, UINT64 *size) {
+	EFI_PHYSICAL_ADDRESS bounce = 0;
+	UINTN chunk_size, pages = 0;
+	UINT64 offset = 0;
+	EFI_STATUS err = EFI_SUCCESS;
+
+	chunk_size = options->chunk_size ? options->chunk_size : STREAM_DEFAULT_CHUNK_SIZE;
+	chunk_size = EFI_SIZE_TO_PAGES(chunk_size) * EFI_PAGE_SIZE;
+
+	if (!options->destination) {
+		pages = EFI_SIZE_TO_PAGES(chunk_size);
+		err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, pages, &bounce);
+		if (EFI_ERROR(err)) {
+			return err;
+		}
+	}
+
+	for (;;) {
+		UINT8 *buffer = (UINT8 *)(UINTN)bounce;
+		UINTN length = chunk_size;
+
+		if (options->destination) {
+			if (offset == options->destination_size) {
+				// The destination is full; anything left means it was too small.
+				UINT8 probe;
+
+				length = sizeof(probe);
+				err = uefi_call_wrapper(handle->Read, 3, handle, &length, &probe);
+				if (!EFI_ERROR(err) && length != 0) {
+					err = EFI_BUFFER_TOO_SMALL;
+				}
+				break;
+			}
+
+			buffer = (UINT8 *)options->destination + offset;
+			if (length > options->destination_size - offset) {
+				length = options->destination_size - offset;
+			}
+		}
+
+		err = uefi_call_wrapper(handle->Read, 3, handle, &length, buffer);
+		if (EFI_ERROR(err) || length == 0) {
+			break;
+		}
+
+		if (options->chunk) {
+			err = options->chunk(options->context, offset, buffer, length);
+			if (EFI_ERROR(err)) {
+				break;
+			}
+		}
+		offset += length;
+	}
+
+	if (bounce) {
+		uefi_call_wrapper(BS->FreePages, 2, bounce, pages);
+	}
+
+	if (size) {
+		*size = offset;
+	}
+	return err;
+}
@@ -0,0 +1,44 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _stream_h
+#define _stream_h
+
+#define STREAM_DEFAULT_CHUNK_SIZE (1024 * 1024)
+
+/* Called once per chunk, in file order, with the bytes just read. */
+typedef EFI_STATUS (*StreamChunkFunction)(VOID *context, UINT64 offset, VOID *data, UINTN size);
+
+/*
+ * How a file is streamed. A chunk size of zero selects the default, and any
+ * other size is rounded up to whole pages. If a destination is given the
+ * chunks are read straight into it; otherwise they pass through a single
+ * page-aligned buffer that is reused for every chunk.
+ */
+typedef struct StreamOptions {
+	UINTN chunk_size;
+	StreamChunkFunction chunk;
+	VOID *context;
+	VOID *destination;
+	UINTN destination_size;
+} StreamOptions;
+
+EFI_STATUS StreamFile(EFI_FILE_HANDLE handle, StreamOptions *options, UINT64 *size);
+
+#endif
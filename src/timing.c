@@ -0,0 +1,137 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "timing.h"
+#include "utils.h"
+
+static CHAR16 *phase_names[BootPhaseCount] = {
+	[BootPhaseEntry] = L"Entry",
+	[BootPhaseInitializeLib] = L"InitializeLib",
+	[BootPhaseConsoleTextMode] = L"ConsoleTextMode",
+	[BootPhaseOpenRoot] = L"OpenRoot",
+	[BootPhaseFileChecks] = L"FileChecks",
+	[BootPhaseMenuWait] = L"MenuWait",
+	[BootPhaseConfigParse] = L"ConfigParse",
+	[BootPhaseDiscovery] = L"Discovery",
+	[BootPhaseLoadImage] = L"LoadImage",
+	[BootPhaseStartImage] = L"StartImage",
+};
+
+static UINT64 phase_ticks[BootPhaseCount];
+static UINT64 ticks_per_microsecond;
+
+/*
+ * The time stamp counter starts at zero when the CPU is reset, so its value
+ * includes the time spent in the firmware before we were started. This is
+ * the same clock systemd-boot uses for its LoaderTime* variables.
+ */
+static UINT64 ReadTimeStampCounter(VOID) {
+#if defined(__x86_64__) || defined(__i386__)
+	UINT32 low, high;
+
+	__asm__ __volatile__("rdtsc" : "=a" (low), "=d" (high));
+	return ((UINT64)high << 32) | low;
+#else
+	return 0;
+#endif
+}
+
+/* Works out the counter frequency by timing a 1ms firmware stall. This is
+ * only done once, when the results are published, so it costs the boot one
+ * millisecond in total. */
+static UINT64 TicksPerMicrosecond(VOID) {
+	UINT64 start;
+
+	if (!ticks_per_microsecond) {
+		start = ReadTimeStampCounter();
+		uefi_call_wrapper(BS->Stall, 1, 1000);
+		ticks_per_microsecond = (ReadTimeStampCounter() - start) / 1000;
+	}
+	return ticks_per_microsecond;
+}
+
+VOID TimingMark(BootPhase phase) {
+	phase_ticks[phase] = ReadTimeStampCounter();
+}
+
+UINT64 TimingMicroseconds(BootPhase phase) {
+	UINT64 rate = TicksPerMicrosecond();
+
+	if (!rate) {
+		return 0;
+	}
+	return phase_ticks[phase] / rate;
+}
+
+/* The time since reset right now, for measuring steps that are not phases. */
+UINT64 TimingNowMicroseconds(VOID) {
+	UINT64 rate = TicksPerMicrosecond();
+
+	if (!rate) {
+		return 0;
+	}
+	return ReadTimeStampCounter() / rate;
+}
+
+static EFI_STATUS PublishMicroseconds(const EFI_GUID *vendor, CHAR16 *name, BootPhase phase) {
+	CHAR16 value[32];
+
+	if (!phase_ticks[phase]) {
+		return EFI_NOT_READY;
+	}
+
+	SPrint(value, sizeof(value), L"%ld", TimingMicroseconds(phase));
+	return efi_set_variable(vendor, name, (CHAR8 *)value, StrSize(value), FALSE);
+}
+
+/*
+ * Exports the timestamps so that the booted system can read them. The
+ * LoaderTime* variables use systemd-boot's names and format (a decimal
+ * string of microseconds since CPU reset), so systemd-analyze picks them up;
+ * EnterpriseBootPhases lists every phase that was reached, one per line.
+ */
+EFI_STATUS TimingPublish(const EFI_GUID *vendor) {
+	CHAR16 phases[BootPhaseCount * 40];
+	UINTN length = 0, i;
+
+	if (!TicksPerMicrosecond()) {
+		return EFI_UNSUPPORTED;
+	}
+
+	PublishMicroseconds(vendor, L"LoaderTimeInitUSec", BootPhaseEntry);
+	// The menu comes up once discovery, if it was asked for, has finished.
+	PublishMicroseconds(vendor, L"LoaderTimeMenuUSec",
+		phase_ticks[BootPhaseDiscovery] ? BootPhaseDiscovery : BootPhaseConfigParse);
+	PublishMicroseconds(vendor, L"LoaderTimeExecUSec", BootPhaseStartImage);
+
+	for (i = 0; i < BootPhaseCount; i++) {
+		if (!phase_ticks[i]) {
+			continue;
+		}
+
+		length += SPrint(phases + length, sizeof(phases) - length * sizeof(CHAR16), L"%s %ld\n",
+			phase_names[i], TimingMicroseconds(i));
+	}
+
+	return efi_set_variable(vendor, L"EnterpriseBootPhases", (CHAR8 *)phases,
+		(length + 1) * sizeof(CHAR16), FALSE);
+}
@@ -0,0 +1,44 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _timing_h
+#define _timing_h
+
+/* The points during boot at which a timestamp is taken, in the order they
+ * are normally reached. Each one marks the end of the named step. */
+typedef enum BootPhase {
+	BootPhaseEntry,
+	BootPhaseInitializeLib,
+	BootPhaseConsoleTextMode,
+	BootPhaseOpenRoot,
+	BootPhaseFileChecks,
+	BootPhaseConfigParse,
+	BootPhaseDiscovery,
+	BootPhaseMenuWait,
+	BootPhaseLoadImage,
+	BootPhaseStartImage,
+	BootPhaseCount
+} BootPhase;
+
+VOID TimingMark(BootPhase phase);
+UINT64 TimingMicroseconds(BootPhase phase);
+UINT64 TimingNowMicroseconds(VOID);
+EFI_STATUS TimingPublish(const EFI_GUID *vendor);
+
+#endif
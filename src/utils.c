@@ -19,9 +19,10 @@
 #include <efi.h>
 #include <efilib.h>
 
+#include "arena.h"
 #include "utils.h"
-
-static CHAR8* strchra(CHAR8 *s, CHAR8 c);
+#include "stream.h"
+#include "log.h"
 
 #ifdef __APPLE__
 	#pragma mark - Get/Set/Delete EFI variables
@@ -37,20 +38,28 @@ EFI_STATUS efi_set_variable(const EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UI
 	return uefi_call_wrapper(RT->SetVariable, 5, name, (EFI_GUID *)vendor, flags, size, buf);
 }
 
+/*
+ * No attributes at all deletes the variable whatever it was written with;
+ * firmware refuses a delete that names other attributes than the stored ones.
+ */
 EFI_STATUS efi_delete_variable(const EFI_GUID *vendor, CHAR16 *name) {
-	UINT32 flags;
-	UINTN size = 0;
-	
-	flags = EFI_VARIABLE_BOOTSERVICE_ACCESS|EFI_VARIABLE_RUNTIME_ACCESS;
-	return uefi_call_wrapper(RT->SetVariable, 5, name, (EFI_GUID *)vendor, flags, size, NULL);
+	return uefi_call_wrapper(RT->SetVariable, 5, name, (EFI_GUID *)vendor, 0, 0, NULL);
 }
 
+/*
+ * Reads a variable into a pool buffer of exactly the right size, which the
+ * caller frees. A first call with no buffer asks the firmware for the size.
+ */
 EFI_STATUS efi_get_variable(const EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size) {
 	CHAR8 *buf;
-	UINTN length;
+	UINTN length = 0;
 	EFI_STATUS err;
 
-	length = sizeof(CHAR16 *) * EFI_MAXIMUM_VARIABLE_SIZE;
+	err = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, NULL, &length, NULL);
+	if (err != EFI_BUFFER_TOO_SMALL) {
+		return EFI_ERROR(err) ? err : EFI_NOT_FOUND;
+	}
+
 	buf = AllocatePool(length);
 	if (!buf) {
 		return EFI_OUT_OF_RESOURCES;
@@ -69,111 +78,50 @@ EFI_STATUS efi_get_variable(const EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer
 	return err;
 }
 
-#ifdef __APPLE__
-	#pragma mark - Text output functions
-#endif
-VOID DisplayColoredText(CHAR16 *string) {
-	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_YELLOW|EFI_BACKGROUND_BLACK);
-	Print(string);
-	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
-}
-
-VOID DisplayErrorText(CHAR16 *string) {
-	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_RED|EFI_BACKGROUND_BLACK);
-	Print(string);
-	uefi_call_wrapper(ST->ConOut->SetAttribute, 2, ST->ConOut, EFI_LIGHTGRAY|EFI_BACKGROUND_BLACK);
-}
+/*
+ * Like efi_set_variable, but leaves the variable alone if it already holds
+ * exactly this value. Reading is far cheaper than writing on most firmware,
+ * and for non-volatile variables it saves wearing out the flash.
+ */
+EFI_STATUS efi_set_variable_if_changed(const EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size,
+		BOOLEAN persistent) {
+	UINT32 attributes, flags;
+	UINTN length = size;
+	CHAR8 *current;
+	EFI_STATUS err;
 
-#ifdef __APPLE__
-	#pragma mark - Character conversion functions missing from GNU-EFI
-#endif
-CHAR8* UTF16toASCII(CHAR16 *InString, UINTN InLength) {
-	CHAR8 *OutString, *InAs8;
-	UINTN i = 0;
-	
-	OutString = AllocateZeroPool(InLength * sizeof(CHAR8));
-	InAs8 = (CHAR8*)InString;
-	while ((InAs8[i * 2] != '\0') && (i < InLength)) {
-		OutString[i] = InAs8[i * 2];
-		i++;
+	flags = EFI_VARIABLE_BOOTSERVICE_ACCESS|EFI_VARIABLE_RUNTIME_ACCESS;
+	if (persistent) {
+		flags |= EFI_VARIABLE_NON_VOLATILE;
 	}
-	return OutString;
-}
-
-CHAR16* ASCIItoUTF16(CHAR8 *InString, UINTN InLength) {
-	UINTN strlen = 0, i = 0;
-	CHAR16 *str;
-
-	str = AllocatePool((InLength + 1) * sizeof(CHAR16));
-	while (i < InLength) {
-		INTN utf8len;
 
-		utf8len = NarrowToLongCharConvert(InString + i, str + strlen);
-		if (utf8len <= 0) {
-			i++;
-			continue;
+	// A buffer of the new size is enough: anything longer is a change anyway.
+	current = AllocatePool(size + 1);
+	if (current) {
+		err = uefi_call_wrapper(RT->GetVariable, 5, name, (EFI_GUID *)vendor, &attributes, &length, current);
+		if (!EFI_ERROR(err) && length == size && attributes == flags && CompareMem(current, buf, size) == 0) {
+			FreePool(current);
+			return EFI_SUCCESS;
 		}
-
-		strlen++;
-		i += utf8len;
-	}
-	str[strlen] = '\0';
-	return str;
-}
-
-INTN NarrowToLongCharConvert(CHAR8 *InString, CHAR16 *c) {
-	CHAR16 unichar;
-	UINTN len;
-	UINTN i;
-
-	if (InString[0] < 0x80) {
-		len = 1;
-	} else if ((InString[0] & 0xe0) == 0xc0) {
-		len = 2;
-	} else if ((InString[0] & 0xf0) == 0xe0) {
-		len = 3;
-	} else if ((InString[0] & 0xf8) == 0xf0) {
-		len = 4;
-	} else if ((InString[0] & 0xfc) == 0xf8) {
-		len = 5;
-	} else if ((InString[0] & 0xfe) == 0xfc) {
-		len = 6;
-	} else {
-		return -1;
+		FreePool(current);
 	}
 
-	switch (len) {
-		case 1:
-			unichar = InString[0];
-			break;
-		case 2:
-			unichar = InString[0] & 0x1f;
-			break;
-		case 3:
-			unichar = InString[0] & 0x0f;
-			break;
-		case 4:
-			unichar = InString[0] & 0x07;
-			break;
-		case 5:
-			unichar = InString[0] & 0x03;
-			break;
-		case 6:
-			unichar = InString[0] & 0x01;
-			break;
-	}
+	return efi_set_variable(vendor, name, buf, size, persistent);
+}
 
-	for (i = 1; i < len; i++) {
-		if ((InString[i] & 0xc0) != 0x80) {
-			return -1;
-		}
-		
-		unichar <<= 6;
-		unichar |= InString[i] & 0x3f;
-	}
+#ifdef __APPLE__
+	#pragma mark - Text output functions
+#endif
+/*
+ * Highlighted and error text go through the log like everything else, which
+ * batches the color changes with the rest of the console output.
+ */
+VOID DisplayColoredText(CHAR16 *string) {
+	LogNotice(LogTagMain, L"%s", string);
+}
 
-	*c = unichar;
-	return len;
+VOID DisplayErrorText(CHAR16 *string) {
+	LogError(LogTagMain, L"%s", string);
 }
 
 BOOLEAN FileExists(EFI_FILE_HANDLE dir, CHAR16 *name) {
@@ -194,13 +142,13 @@ out:
 #ifdef __APPLE__
 	#pragma mark - Functions for reading and parsing config files.
 #endif
-UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 *name, CHAR8 **content) {
+UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 *name, CHAR8 **content, MemoryArena *arena) {
 	EFI_FILE_HANDLE handle;
 	EFI_FILE_INFO *info;
+	StreamOptions options;
 	CHAR8 *buf;
-	UINTN buflen;
 	EFI_STATUS err;
-	UINTN len = 0;
+	UINT64 len = 0;
 	
 	err = uefi_call_wrapper(dir->Open, 5, dir, &handle, name, EFI_FILE_MODE_READ, NULL);
 	if (EFI_ERROR(err)) {
@@ -208,96 +156,109 @@ UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 *name, CHAR8 **content) {
 	}
 	
 	info = LibFileInfo(handle);
-	buflen = info->FileSize+1;
-	buf = AllocatePool(buflen);
+	if (!info) {
+		goto close;
+	}
+	
+	// Read straight into the buffer we hand back, leaving room for the
+	// terminator after the last byte.
+	ZeroMem(&options, sizeof(options));
+	options.destination_size = info->FileSize;
+	FreePool(info);
 	
-	err = uefi_call_wrapper(handle->Read, 3, handle, &buflen, buf);
+	buf = ArenaAllocate(arena, options.destination_size + 1);
+	if (!buf) {
+		goto close;
+	}
+	options.destination = buf;
+	
+	err = StreamFile(handle, &options, &len);
 	if (EFI_ERROR(err) == EFI_SUCCESS) {
-		buf[buflen] = '\0';
+		buf[len] = '\0';
 		*content = buf;
-		len = buflen;
 	} else {
-		FreePool(buf);
+		len = 0;
+		if (!arena) {
+			FreePool(buf);
+		}
 	}
 	
-	FreePool(info);
+close:
 	uefi_call_wrapper(handle->Close, 1, handle);
 out:
 	return len;
 }
 
-// This code has been adapted from gummiboot. Thanks, guys!
-static CHAR8 *strchra(CHAR8 *s, CHAR8 c) {
-	do {
-		if (*s == c) {
-			return s;
-		}
-	} while (*s++);
-	return NULL;
-}
+/*
+ * Character classes used by the configuration tokenizer. Looking a byte up in
+ * this table replaces the strchr-style scans of separator sets, so every byte
+ * of the file is classified with a single load.
+ */
+#define CHAR_CLASS_SPACE	0x01
+#define CHAR_CLASS_NEWLINE	0x02
+#define CHAR_CLASS_END		0x04
+
+static const UINT8 config_char_class[256] = {
+	['\0'] = CHAR_CLASS_END,
+	[' '] = CHAR_CLASS_SPACE,
+	['\t'] = CHAR_CLASS_SPACE,
+	['\n'] = CHAR_CLASS_NEWLINE,
+	['\r'] = CHAR_CLASS_NEWLINE,
+};
 
+// This code has been adapted from gummiboot. Thanks, guys!
 CHAR8* GetConfigurationKeyAndValue(CHAR8 *content, UINTN *pos, CHAR8 **key_ret, CHAR8 **value_ret) {
-	CHAR8 *line;
-	UINTN linelen;
-	CHAR8 *value;
+	CHAR8 *p = content + *pos;
+	CHAR8 *key, *key_end, *value, *value_end, *next;
 
-skip:
-	line = content + *pos;
-	if (*line == '\0') {
-		return NULL;
-	}
+	for (;;) {
+		/* Skip leading whitespace and empty lines. */
+		while (config_char_class[*p] & (CHAR_CLASS_SPACE|CHAR_CLASS_NEWLINE)) {
+			p++;
+		}
 
-	linelen = 0;
-	while (line[linelen] && !strchra((CHAR8 *)"\n\r", line[linelen])) {
-		linelen++;
-	}
+		if (config_char_class[*p] & CHAR_CLASS_END) {
+			*pos = p - content;
+			return NULL;
+		}
 
-	/* Move the position to the next line. */
-	*pos += linelen;
-	if (content[*pos]) {
-		(*pos)++;
-	}
+		/* The key runs up to the first whitespace character. */
+		key = p;
+		while (!config_char_class[*p]) {
+			p++;
+		}
+		key_end = p;
 
-	/* The line has no length, so it is empty. */
-	if (linelen == 0) {
-		goto skip;
-	}
+		/* The value starts after the separating whitespace and runs to the end
+		 * of the line, minus any trailing whitespace. */
+		while (config_char_class[*p] & CHAR_CLASS_SPACE) {
+			p++;
+		}
 
-	/* Add a string terminator character. */
-	line[linelen] = '\0';
+		value = value_end = p;
+		while (!(config_char_class[*p] & (CHAR_CLASS_NEWLINE|CHAR_CLASS_END))) {
+			if (!(config_char_class[*p] & CHAR_CLASS_SPACE)) {
+				value_end = p + 1;
+			}
+			p++;
+		}
 
-	/* Remove leading and trailing whitespace. */
-	while (strchra((CHAR8 *)" \t", *line)) {
-		line++;
-		linelen--;
-	}
+		/* Move the position to the next line. */
+		next = *p ? p + 1 : p;
 
-	while (linelen > 0 && strchra((CHAR8 *)" \t", line[linelen-1])) {
-		linelen--;
-	}
-	line[linelen] = '\0';
+		/* Skip comments and keys without a value. */
+		if (*key == '#' || value_end == value) {
+			p = next;
+			continue;
+		}
 
-	if (*line == '#') {
-		goto skip;
-	}
+		/* Add string terminator characters. */
+		*key_end = '\0';
+		*value_end = '\0';
 
-	/* Split the key and the value. */
-	value = line;
-	while (*value && !strchra((CHAR8 *)" \t", *value)) {
-		value++;
+		*pos = next - content;
+		*key_ret = key;
+		*value_ret = value;
+		return key;
 	}
-	
-	if (*value == '\0') {
-		goto skip;
-	}
-	
-	*value = '\0';
-	value++;
-	while (*value && strchra((CHAR8 *)" \t", *value)) {
-		value++;
-	}
-
-	*key_ret = line;
-	*value_ret = value;
-	return line;
 }
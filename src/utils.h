@@ -20,16 +20,25 @@
 #ifndef _utils_h
 #define _utils_h
 
+/*
+ * Functions that the firmware calls back into (protocol members we install,
+ * event notifications) must use its calling convention. GNU-EFI's EFIAPI
+ * does not force it on x86_64, so we do.
+ */
+#if defined(__x86_64__)
+	#define FIRMWARE_CALLBACK __attribute__((ms_abi))
+#else
+	#define FIRMWARE_CALLBACK
+#endif
+
 EFI_STATUS efi_set_variable(const EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size, BOOLEAN persistent);
 EFI_STATUS efi_delete_variable(const EFI_GUID *vendor, CHAR16 *name);
 EFI_STATUS efi_get_variable(const EFI_GUID *vendor, CHAR16 *name, CHAR8 **buffer, UINTN *size);
-
-INTN NarrowToLongCharConvert(CHAR8 *InChar, OUT CHAR16 *OutChar);
-CHAR16* ASCIItoUTF16(CHAR8 *InString, UINTN InLength);
-CHAR8* UTF16toASCII(CHAR16 *InString, UINTN InLength);
+EFI_STATUS efi_set_variable_if_changed(const EFI_GUID *vendor, CHAR16 *name, CHAR8 *buf, UINTN size,
+	BOOLEAN persistent);
 
 BOOLEAN FileExists(EFI_FILE_HANDLE dir, CHAR16 *name);
-UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 *name, CHAR8 **content);
+UINTN FileRead(EFI_FILE_HANDLE dir, const CHAR16 *name, CHAR8 **content, MemoryArena *arena);
 CHAR8* GetConfigurationKeyAndValue(CHAR8 *content, UINTN *pos, CHAR8 **key_ret, CHAR8 **value_ret);
 VOID DisplayColoredText(CHAR16 *string);
 VOID DisplayErrorText(CHAR16 *string);
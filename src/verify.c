@@ -0,0 +1,302 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+/*
+ * Checks boot.iso against the digest recorded next to it, so that a damaged
+ * stick is caught before a live session half boots and falls over. The ISO
+ * is read in batches of segments; while the application processors hash one
+ * batch, the boot processor reads the next one, then helps to finish off.
+ * For toram the same pipeline reads straight into the copy in memory, so
+ * the ISO is only read once.
+ */
+
+#include <efi.h>
+#include <efilib.h>
+
+#include "arena.h"
+#include "iso9660.h"
+#include "utils.h"
+#include "sha256.h"
+#include "timing.h"
+#include "snapshot.h"
+#include "verify.h"
+#include "log.h"
+
+#define EFI_MP_SERVICES_PROTOCOL_GUID \
+	{ 0x3fdda605, 0xa76e, 0x4f46, { 0xad, 0x29, 0x12, 0xf4, 0x53, 0x1b, 0x3d, 0x08 } }
+
+/* Two batches are in memory at once, so this bounds us to 128 MB. */
+#define VERIFY_MAX_BATCH_SEGMENTS 16
+/* A copy needs no buffers of its own, so it can afford larger reads. */
+#define VERIFY_MIN_COPY_BATCH_SEGMENTS 4
+
+typedef VOID (FIRMWARE_CALLBACK *EFI_AP_PROCEDURE)(VOID *ProcedureArgument);
+
+struct _EFI_MP_SERVICES_PROTOCOL;
+
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_GET_NUMBER_OF_PROCESSORS)(
+	struct _EFI_MP_SERVICES_PROTOCOL *This,
+	UINTN *NumberOfProcessors,
+	UINTN *NumberOfEnabledProcessors
+);
+
+typedef EFI_STATUS (EFIAPI *EFI_MP_SERVICES_STARTUP_ALL_APS)(
+	struct _EFI_MP_SERVICES_PROTOCOL *This,
+	EFI_AP_PROCEDURE Procedure,
+	BOOLEAN SingleThread,
+	EFI_EVENT WaitEvent,
+	UINTN TimeoutInMicroSeconds,
+	VOID *ProcedureArgument,
+	UINTN **FailedCpuList
+);
+
+/* From the PI specification; only the members we call are typed. */
+typedef struct _EFI_MP_SERVICES_PROTOCOL {
+	EFI_MP_SERVICES_GET_NUMBER_OF_PROCESSORS GetNumberOfProcessors;
+	VOID *GetProcessorInfo;
+	EFI_MP_SERVICES_STARTUP_ALL_APS StartupAllAPs;
+	VOID *StartupThisAP;
+	VOID *SwitchBSP;
+	VOID *EnableDisableAP;
+	VOID *WhoAmI;
+} EFI_MP_SERVICES_PROTOCOL;
+
+/* One batch of segments. Processors take segments from it until none are left. */
+typedef struct VerifyBatch {
+	UINT8 *data;
+	UINTN size;
+	UINTN segments;
+	UINT8 *digests;
+	volatile UINTN next;
+} VerifyBatch;
+
+static EFI_GUID mp_services_guid = EFI_MP_SERVICES_PROTOCOL_GUID;
+
+static VOID VerifyHashSegments(VerifyBatch *batch) {
+	UINTN segment;
+
+	while ((segment = __sync_fetch_and_add(&batch->next, 1)) < batch->segments) {
+		UINTN offset = segment * VERIFY_SEGMENT_SIZE;
+		UINTN length = batch->size - offset;
+
+		if (length > VERIFY_SEGMENT_SIZE) {
+			length = VERIFY_SEGMENT_SIZE;
+		}
+		Sha256Digest(batch->data + offset, length, batch->digests + segment * SHA256_DIGEST_SIZE);
+	}
+}
+
+/* Runs on the application processors, so it must not touch boot services. */
+static VOID FIRMWARE_CALLBACK VerifyWorker(VOID *argument) {
+	VerifyHashSegments(argument);
+}
+
+static BOOLEAN VerifyParseDigest(CHAR8 *text, UINT8 *digest) {
+	UINTN i;
+
+	for (i = 0; i < SHA256_DIGEST_SIZE * 2; i++) {
+		CHAR8 c = text[i];
+		UINT8 nibble;
+
+		if (c >= '0' && c <= '9') {
+			nibble = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			nibble = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			nibble = c - 'A' + 10;
+		} else {
+			return FALSE;
+		}
+
+		digest[i / 2] = (i % 2) ? (digest[i / 2] | nibble) : (UINT8)(nibble << 4);
+	}
+	return TRUE;
+}
+
+/*
+ * Reads size bytes through read and hashes them, into destination if there
+ * is one, which is how toram copies boot.iso, and through buffers of our
+ * own if not, then compares the result with expected. Returns EFI_CRC_ERROR
+ * if they do not match.
+ */
+EFI_STATUS VerifyStream(IsoReadFunction read, VOID *context, UINT64 size, UINT8 *destination,
+		UINT8 *expected) {
+	EFI_MP_SERVICES_PROTOCOL *mp = NULL;
+	EFI_EVENT done = NULL;
+	EFI_PHYSICAL_ADDRESS buffers[2] = { 0, 0 };
+	VerifyBatch batches[2];
+	UINT8 actual[SHA256_DIGEST_SIZE], *digests;
+	UINTN processors = 1, enabled = 1, batch_segments, batch_pages = 0, segments, current = 0, index;
+	UINT64 offset = 0, start, elapsed;
+	BOOLEAN in_flight = FALSE;
+	EFI_STATUS err = EFI_SUCCESS;
+
+	segments = (size + VERIFY_SEGMENT_SIZE - 1) / VERIFY_SEGMENT_SIZE;
+	digests = AllocatePool(segments * SHA256_DIGEST_SIZE + 1);
+	if (!digests) {
+		return EFI_OUT_OF_RESOURCES;
+	}
+
+	// Without MP Services, or with a single processor, everything is hashed
+	// on this one, a segment at a time.
+	if (!EFI_ERROR(LibLocateProtocol(&mp_services_guid, (VOID **)&mp)) &&
+		!EFI_ERROR(uefi_call_wrapper(mp->GetNumberOfProcessors, 3, mp, &processors, &enabled)) && enabled > 1 &&
+		!EFI_ERROR(uefi_call_wrapper(BS->CreateEvent, 5, 0, 0, NULL, NULL, &done))) {
+		batch_segments = enabled < VERIFY_MAX_BATCH_SEGMENTS ? enabled : VERIFY_MAX_BATCH_SEGMENTS;
+	} else {
+		mp = NULL;
+		enabled = 1;
+		batch_segments = 1;
+	}
+
+	if (destination) {
+		if (batch_segments < VERIFY_MIN_COPY_BATCH_SEGMENTS) {
+			batch_segments = VERIFY_MIN_COPY_BATCH_SEGMENTS;
+		}
+	} else {
+		batch_pages = EFI_SIZE_TO_PAGES(batch_segments * VERIFY_SEGMENT_SIZE);
+		for (index = 0; index < (mp ? 2 : 1); index++) {
+			err = uefi_call_wrapper(BS->AllocatePages, 4, AllocateAnyPages, EfiLoaderData, batch_pages,
+				&buffers[index]);
+			if (EFI_ERROR(err)) {
+				goto out;
+			}
+		}
+	}
+
+	LogInfo(LogTagVerify, L"%s boot.iso on %d processor%s%s...\n", destination ? L"Copying and verifying" : L"Verifying",
+		enabled, enabled == 1 ? L"" : L"s", Sha256Accelerated() ? L" with SHA extensions" : L"");
+	start = TimingNowMicroseconds();
+
+	while (offset < size) {
+		VerifyBatch *batch = &batches[current];
+
+		batch->data = destination ? destination + offset : (UINT8 *)(UINTN)buffers[current];
+		batch->size = (size - offset) < batch_segments * VERIFY_SEGMENT_SIZE ?
+			(UINTN)(size - offset) : batch_segments * VERIFY_SEGMENT_SIZE;
+		batch->segments = (batch->size + VERIFY_SEGMENT_SIZE - 1) / VERIFY_SEGMENT_SIZE;
+		batch->digests = digests + (offset / VERIFY_SEGMENT_SIZE) * SHA256_DIGEST_SIZE;
+		batch->next = 0;
+
+		// This read overlaps with the other processors hashing the last batch.
+		err = read(context, offset, batch->size, batch->data);
+		if (EFI_ERROR(err)) {
+			goto out;
+		}
+
+		if (in_flight) {
+			VerifyHashSegments(&batches[current ^ 1]);
+			uefi_call_wrapper(BS->WaitForEvent, 3, 1, &done, &index);
+			in_flight = FALSE;
+		}
+
+		if (mp) {
+			err = uefi_call_wrapper(mp->StartupAllAPs, 7, mp, VerifyWorker, FALSE, done, 0, batch, NULL);
+			in_flight = !EFI_ERROR(err);
+		}
+		if (!in_flight) {
+			VerifyHashSegments(batch);
+		} else {
+			current ^= 1;
+		}
+
+		offset += batch->size;
+		if (!LogHeadless()) {
+			LogFlush();
+			Print(L"\r%d%%", (UINTN)(offset * 100 / size));
+		}
+	}
+
+	if (in_flight) {
+		VerifyHashSegments(&batches[current ^ 1]);
+		uefi_call_wrapper(BS->WaitForEvent, 3, 1, &done, &index);
+		in_flight = FALSE;
+	}
+
+	Sha256Digest(digests, segments * SHA256_DIGEST_SIZE, actual);
+	elapsed = TimingNowMicroseconds() - start;
+	LogInfo(LogTagVerify, L"\r%ld MB in %ld ms (%ld MB/s)\n", size / 1000000, elapsed / 1000,
+		elapsed > 0 ? size / elapsed : 0);
+
+	err = CompareMem(actual, expected, SHA256_DIGEST_SIZE) == 0 ? EFI_SUCCESS : EFI_CRC_ERROR;
+
+out:
+	// The processors may still be reading a buffer if we bailed out early.
+	if (in_flight) {
+		uefi_call_wrapper(BS->WaitForEvent, 3, 1, &done, &index);
+	}
+	for (index = 0; index < 2; index++) {
+		if (buffers[index]) {
+			uefi_call_wrapper(BS->FreePages, 2, buffers[index], batch_pages);
+		}
+	}
+	if (done) {
+		uefi_call_wrapper(BS->CloseEvent, 1, done);
+	}
+	FreePool(digests);
+	return err;
+}
+
+/*
+ * Reads \efi\boot\boot.iso.sha256 into expected. Returns EFI_NOT_FOUND if
+ * no digest was recorded, and EFI_INVALID_PARAMETER if it cannot be parsed.
+ */
+EFI_STATUS VerifyExpectedDigest(EFI_FILE_HANDLE root_dir, DirectorySnapshot *files, UINT8 *expected) {
+	CHAR8 *text = NULL;
+	EFI_STATUS err;
+
+	if (!SnapshotFind(files, L"\\efi\\boot\\boot.iso") ||
+		!SnapshotFileExists(files, L"\\efi\\boot\\boot.iso.sha256")) {
+		return EFI_NOT_FOUND;
+	}
+
+	// A file too short to hold a digest still comes back in a buffer.
+	if (FileRead(root_dir, L"\\efi\\boot\\boot.iso.sha256", &text, NULL) < SHA256_DIGEST_SIZE * 2) {
+		err = EFI_NOT_FOUND;
+	} else {
+		err = VerifyParseDigest(text, expected) ? EFI_SUCCESS : EFI_INVALID_PARAMETER;
+	}
+	if (text) {
+		FreePool(text);
+	}
+	return err;
+}
+
+/*
+ * Hashes the ISO file and compares it with the digest VerifyExpectedDigest()
+ * read. Returns EFI_CRC_ERROR if the file does not match it.
+ */
+EFI_STATUS VerifyISO(EFI_FILE_HANDLE root_dir, DirectorySnapshot *files, UINT8 *expected) {
+	EFI_FILE_HANDLE iso_file;
+	SnapshotEntry *entry;
+	EFI_STATUS err;
+
+	entry = SnapshotFind(files, L"\\efi\\boot\\boot.iso");
+	if (!entry) {
+		return EFI_NOT_FOUND;
+	}
+
+	err = uefi_call_wrapper(root_dir->Open, 5, root_dir, &iso_file, L"\\efi\\boot\\boot.iso", EFI_FILE_MODE_READ, 0);
+	if (EFI_ERROR(err)) {
+		return err;
+	}
+	err = VerifyStream(IsoFileReader, iso_file, entry->size, NULL, expected);
+	uefi_call_wrapper(iso_file->Close, 1, iso_file);
+	return err;
+}
+
@@ -0,0 +1,36 @@
+/*
+ * Tool intended to help facilitate the process of booting Linux on Intel
+ * Macintosh computers made by Apple from a USB stick or similar.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Copyright (C) 2014 SevenBits
+ *
+ */
+
+#pragma once
+#ifndef _verify_h
+#define _verify_h
+
+/*
+ * boot.iso.sha256 holds a tree hash of the ISO file, as 64 hex digits: the
+ * file is cut into segments of this size, each segment is hashed with
+ * SHA-256, and the SHA-256 of all the segment digests, in order, is the
+ * value recorded. The segments can then be hashed on separate processors.
+ */
+#define VERIFY_SEGMENT_SIZE (4 * 1024 * 1024)
+
+EFI_STATUS VerifyExpectedDigest(EFI_FILE_HANDLE root_dir, DirectorySnapshot *files, UINT8 *expected);
+EFI_STATUS VerifyISO(EFI_FILE_HANDLE root_dir, DirectorySnapshot *files, UINT8 *expected);
+EFI_STATUS VerifyStream(IsoReadFunction read, VOID *context, UINT64 size, UINT8 *destination,
+	UINT8 *expected);
+
+#endif
@@ -16,90 +16,369 @@
 # Copyright (C) 2014 SevenBits
 #
 #
-from sys import exit
-""" Note: this program assumes that it is being executed from the
- root directory of a USB drive containing an installation of
- Enterprise.
+from __future__ import print_function
+import argparse
+import hashlib
+import json
+import mmap
+import multiprocessing
+import os
+import struct
+import sys
+import time
+""" Note: with no arguments this program assumes that it is being executed
+ from the root directory of a USB drive containing an installation of
+ Enterprise. Otherwise it checks the root of every drive it is given, a
+ few at a time, which is how freshly written sticks are checked in bulk.
+
+ 	It verifies the configuration file, whether all required files are
+ present, and whether every entry's kernel and initrd can be found inside
+ boot.iso. With --hash it also hashes boot.iso and compares the result with
+ boot.iso.sha256, the way Enterprise does before booting; --write-hash
+ records the hash in boot.iso.sha256 instead, for Enterprise to check."""
+
+## compile-config.py reads the configuration file exactly the way the
+## loader does; its name is not a valid module name, hence __import__.
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+compileConfig = __import__("compile-config")
+
+clock = getattr(time, "perf_counter", time.time)
+
+## The tree hash from verify.h: SHA-256 over the SHA-256 of each segment.
+VERIFY_SEGMENT_SIZE = 4 * 1024 * 1024
+
+ISO_SECTOR_SIZE = 2048
 
- 	It verifies syntax and whether all required files are present."""
 def main():
 	"""The program's main method."""
-	installValid = True
-	reason = ""
+	parser = argparse.ArgumentParser(description="Check Enterprise installations.")
+	parser.add_argument("mounts", nargs="*", metavar="mount point",
+		help="root of an Enterprise drive (default: the current directory)")
+	parser.add_argument("--hash", action="store_true",
+		help="hash boot.iso and compare it with boot.iso.sha256")
+	parser.add_argument("--write-hash", action="store_true",
+		help="hash boot.iso and write the result to boot.iso.sha256")
+	parser.add_argument("--json", action="store_true",
+		help="print the results as JSON")
+	parser.add_argument("-j", "--jobs", type=int, default=0,
+		help="drives to check at once (default: one per processor, at least 4)")
+	arguments = parser.parse_args()
 
-	configIsValid = verifyConfigurationFile("efi/boot/.MLUL-Live-USB")
-	## Check if the Enterprise files are present.
-	if ( not fileExists("efi/boot/boot.efi") and
-		 not fileExists("efi/boot/bootX64.efi")
-		):
-		reason = "The EFI boot files are not present."
-		installValid = False
-	elif (not fileExists("efi/boot/.MLUL-Live-USB")):
-		reason = "No Enterprise configuration file present."
-		installValid = False
-
-	## Verify that the configuration file is present.
-	elif (not configIsValid):
-		reason = "The configuration file is bad."
-		installValid = False
-
-	## Display whether or not everything's good.
-	if (installValid):
-		print("The installation is valid. All's good. :)")
-		exit(0)
+	mounts = arguments.mounts or ["."]
+	## Most of the time goes on waiting for the drives, so there is no harm
+	## in running more checks than there are processors.
+	jobs = arguments.jobs or max(4, multiprocessing.cpu_count())
+	jobs = max(1, min(jobs, len(mounts)))
+	work = [(mount, arguments.hash, arguments.write_hash) for mount in mounts]
+
+	## Each drive is a separate device, so checking several at once keeps
+	## all of them busy; the results still come back in the order given.
+	start = clock()
+	if jobs == 1:
+		results = [verifyInstallationTask(task) for task in work]
 	else:
-		print("The installation is invalid: {0}".format(reason))
-		exit(1)
-
-def verifyConfigurationFile(file):
-	"""Verify whether Enterprise's configuration file
-		is valid."""
-	validKeys = ["family", "kernel", "initrd", "root"]
-	verifyIsValid = True
-	if not (fileExists(file)):
-		return "bad: the file does not exist"
-
-	## Open the file.
-	file = open(file, 'r')
-
-	## Read each line.
-	lineNumber = 1
-	n = 1 # We must read at least one byte.
-	while True:
-		chunk = file.read(n)
-		if (chunk == ''):
-			break
+		pool = multiprocessing.Pool(jobs)
+		try:
+			results = pool.map(verifyInstallationTask, work, 1)
+		finally:
+			pool.close()
+			pool.join()
+	elapsed = clock() - start
+
+	allValid = all(result["valid"] for result in results)
+	if arguments.json:
+		json.dump({"valid": allValid, "jobs": jobs, "seconds": round(elapsed, 6),
+			"installations": results}, sys.stdout, indent=2, sort_keys=True)
+		print()
+	elif not arguments.mounts:
+		## Display whether or not everything's good.
+		result = results[0]
+		for message in result["warnings"]:
+			print(message)
+		if result["valid"]:
+			print("The installation is valid. All's good. :)")
 		else:
-			line = chunk + file.readline()
-			didSucceed, message = processConfigLine(line, validKeys)
-			if not (didSucceed):
-				print("Syntax error on line {0}: {1}" \
-					.format(lineNumber, message))
-				verifyIsValid = False
-		lineNumber += 1
-	return verifyIsValid
-			
-def processConfigLine(line, validKeys):
-	"""Determine whether a configuration file's line starts
-		with valid keys."""
-	command = line.split(' ')[0]
-	message = ""
-	if (command.startswith('#')):
-		return (True, message)
-	keyIsValid = command in validKeys
-	if not (keyIsValid):
-		message = "key \"{0}\" is not valid".format(command)
-
-	value = (keyIsValid, message)
-	return value
+			print("The installation is invalid: {0}".format(result["errors"][0]))
+	else:
+		for result in results:
+			for message in result["warnings"]:
+				print("{0}: {1}".format(result["mount"], message))
+			if result["valid"]:
+				print("{0}: valid ({1:.2f}s)".format(result["mount"], result["timings"]["total"]))
+			else:
+				print("{0}: invalid: {1}".format(result["mount"], "; ".join(result["errors"])))
+		print("{0} of {1} installations are valid.".format(
+			sum(1 for result in results if result["valid"]), len(results)))
 
-def fileExists(file):
-	"""Check if a file exists."""
+	sys.exit(0 if allValid else 1)
+
+def verifyInstallationTask(task):
+	"""Pool workers get a single argument."""
+	return verifyInstallation(*task)
+
+def verifyInstallation(mount, hashImage, writeHash=False):
+	"""Check one drive. Returns a dictionary that can go straight into the
+		JSON output; errors make the installation invalid, warnings do not."""
+	result = {"mount": mount, "valid": False, "errors": [], "warnings": [], "timings": {}}
+	errors = result["errors"]
+	start = clock()
+
+	def path(name):
+		return os.path.join(mount, *name.split("/"))
+
+	## Check if the Enterprise files are present.
+	if not fileExists(path("efi/boot/boot.efi")) and not fileExists(path("efi/boot/bootX64.efi")):
+		errors.append("The EFI boot files are not present.")
+	if not fileExists(path("efi/boot/boot.iso")):
+		errors.append("No ISO file present.")
+
+	## Verify the configuration file.
+	phase = clock()
+	entries = verifyConfigurationFile(path("efi/boot/.MLUL-Live-USB"), result)
+	result["timings"]["config"] = round(clock() - phase, 6)
+
+	## Look inside the ISO file for what the entries need.
+	if entries and fileExists(path("efi/boot/boot.iso")):
+		phase = clock()
+		verifyImageContents(path("efi/boot/boot.iso"), entries, result)
+		result["timings"]["iso"] = round(clock() - phase, 6)
+
+	if writeHash and fileExists(path("efi/boot/boot.iso")):
+		phase = clock()
+		writeImageDigest(path("efi/boot/boot.iso"), path("efi/boot/boot.iso.sha256"), result)
+		result["timings"]["hash"] = round(clock() - phase, 6)
+	elif hashImage and fileExists(path("efi/boot/boot.iso")):
+		phase = clock()
+		verifyImageDigest(path("efi/boot/boot.iso"), path("efi/boot/boot.iso.sha256"), result)
+		result["timings"]["hash"] = round(clock() - phase, 6)
+
+	result["valid"] = not errors
+	result["timings"]["total"] = round(clock() - start, 6)
+	return result
+
+def verifyConfigurationFile(file, result):
+	"""Verify whether Enterprise's configuration file is valid, and whether
+		the compiled plan next to it, if any, is up to date. Returns the
+		entries it describes. Anything the loader would only warn about is
+		still an error here, since it is almost always a typing mistake."""
 	try:
-		open(file)
-		return True
+		with open(file, "rb") as handle:
+			contents = handle.read()
 	except IOError:
-		return False
+		result["errors"].append("No Enterprise configuration file present.")
+		return []
+
+	entries, settings, warnings, errors = compileConfig.compileConfiguration(contents)
+	result["errors"].extend("Syntax error: " + message for message in warnings + errors)
+	result["entries"] = [entry["name"].decode("utf-8", "replace") for entry in entries]
+	for entry in entries:
+		for key in ("kernel", "initrd"):
+			if key not in entry:
+				result["errors"].append("Entry {0} has no {1}.".format(
+					entry["name"].decode("utf-8", "replace"), key))
+
+	plan = file + ".plan"
+	if fileExists(plan):
+		## The loader's test: the plan must be no older than the file, and
+		## built from a file of the same size.
+		try:
+			with open(plan, "rb") as handle:
+				header = handle.read(compileConfig.PLAN_HEADER.size)
+			sourceSize = compileConfig.PLAN_HEADER.unpack(header)[5]
+		except (IOError, struct.error):
+			sourceSize = None
+		if sourceSize != len(contents) or os.path.getmtime(plan) < os.path.getmtime(file):
+			result["warnings"].append("The boot plan is out of date; run compile-config.py again.")
+	return entries
+
+def verifyImageContents(file, entries, result):
+	"""Check that every entry's kernel and initrd exist in the ISO file."""
+	try:
+		with open(file, "rb") as handle:
+			image = mmap.mmap(handle.fileno(), 0, access=mmap.ACCESS_READ)
+	except (IOError, OSError, ValueError) as error:
+		result["errors"].append("Cannot map the ISO file: {0}".format(error))
+		return
+
+	try:
+		iso = IsoImage(image)
+		result["iso"] = {"size": len(image), "naming": iso.naming}
+		missing = set()
+		for entry in entries:
+			for key in ("kernel", "initrd"):
+				if key in entry and iso.lookup(entry[key]) is None:
+					missing.add(entry[key].decode("utf-8", "replace"))
+		for name in sorted(missing):
+			result["errors"].append("The ISO file has no {0}.".format(name))
+	except IsoError as error:
+		result["errors"].append("The ISO file is unreadable: {0}".format(error))
+	finally:
+		image.close()
+
+def imageDigest(file):
+	"""The tree hash of the ISO file, as hex digits, in large sequential reads."""
+	digests = hashlib.sha256()
+	with open(file, "rb", 0) as handle:
+		if hasattr(os, "posix_fadvise"):
+			os.posix_fadvise(handle.fileno(), 0, 0, os.POSIX_FADV_SEQUENTIAL)
+		while True:
+			segment = handle.read(VERIFY_SEGMENT_SIZE)
+			if not segment:
+				break
+			digests.update(hashlib.sha256(segment).digest())
+	return digests.hexdigest()
+
+def verifyImageDigest(file, digestFile, result):
+	"""Compute the tree hash of the ISO file and compare it with the
+		recorded one if there is one."""
+	try:
+		with open(digestFile, "rb") as handle:
+			expected = handle.read(64).decode("ascii", "replace").lower()
+	except IOError:
+		expected = None
+
+	actual = imageDigest(file)
+	result["hash"] = {"expected": expected, "actual": actual,
+		"match": None if expected is None else expected == actual}
+	if expected is not None and expected != actual:
+		result["errors"].append("The ISO file does not match boot.iso.sha256.")
+
+def writeImageDigest(file, digestFile, result):
+	"""Record the tree hash of the ISO file the way verify.c reads it: 64
+		lower-case hex digits, followed here by a newline it ignores."""
+	actual = imageDigest(file)
+	try:
+		with open(digestFile, "wb") as handle:
+			handle.write((actual + "\n").encode("ascii"))
+	except IOError as error:
+		result["errors"].append("Cannot write boot.iso.sha256: {0}".format(error))
+		return
+	result["hash"] = {"expected": actual, "actual": actual, "match": True}
+
+class IsoError(Exception):
+	pass
+
+class IsoImage(object):
+	"""Finds files in an ISO9660 image held in memory, naming them the way
+		iso9660.c does: Rock Ridge names if the image has them, otherwise
+		Joliet, otherwise plain names without the version suffix, all in
+		lower case. Directories are read when a lookup first passes
+		through them."""
+
+	def __init__(self, image):
+		self.image = image
+		self.naming = "plain"
+		self.susp = 0
+		self.index = {}
+		primary = joliet = None
+		for sector in range(16, 64):
+			descriptor = image[sector * ISO_SECTOR_SIZE:(sector + 1) * ISO_SECTOR_SIZE]
+			if len(descriptor) < ISO_SECTOR_SIZE or descriptor[1:6] != b"CD001" or descriptor[0:1] == b"\xff":
+				break
+			if descriptor[0:1] == b"\x01" and primary is None:
+				self.blockSize = struct.unpack("<H", descriptor[128:130])[0]
+				primary = descriptor[156:190]
+			elif (descriptor[0:1] == b"\x02" and joliet is None and descriptor[88:90] == b"%/"
+				and descriptor[90:91] in (b"@", b"C", b"E")):
+				joliet = descriptor[156:190]
+		if primary is None or not self.blockSize:
+			raise IsoError("no primary volume descriptor")
+
+		self.root = self.extent(primary)
+		record = image[self.root[0]:self.root[0] + ISO_SECTOR_SIZE]
+		if (len(record) > 40 and ord(record[0:1]) >= 41 and ord(record[32:33]) == 1 and
+			record[34:36] == b"SP" and record[38:40] == b"\xbe\xef"):
+			self.naming = "rockridge"
+			self.susp = ord(record[40:41])
+		elif joliet is not None:
+			self.root = self.extent(joliet)
+			self.naming = "joliet"
+
+	def extent(self, record):
+		"""(offset, size, is a directory) of a directory record."""
+		location, size = struct.unpack("<I4xI", record[2:14])
+		return (location * self.blockSize, size, bool(ord(record[25:26]) & 2))
+
+	def recordName(self, record):
+		identifier = record[33:33 + ord(record[32:33])]
+		if identifier in (b"\0", b"\1"):
+			return None
+		if self.naming == "rockridge":
+			name = self.rockRidgeName(record, len(identifier))
+			if name:
+				return name.lower()
+		if self.naming == "joliet":
+			name = identifier.decode("utf-16-be", "replace")
+		else:
+			name = identifier.decode("latin-1")
+		name = name.split(";", 1)[0]
+		if name.endswith("."):
+			name = name[:-1]
+		return name.lower()
+
+	def rockRidgeName(self, record, identifierLength):
+		position = 33 + identifierLength + (1 - identifierLength % 2) + self.susp
+		name = b""
+		found = False
+		while position + 4 <= len(record):
+			signature, length = record[position:position + 2], ord(record[position + 2:position + 3])
+			if length < 4 or position + length > len(record) or signature == b"ST":
+				break
+			if signature == b"NM" and length >= 5:
+				flags = ord(record[position + 4:position + 5])
+				if flags & 0x06:
+					return None
+				name += record[position + 5:position + length]
+				found = True
+				if not flags & 0x01:
+					break
+			position += length
+		return name.decode("utf-8", "replace") if found else None
+
+	def directory(self, extent):
+		"""The entries of a directory, by name; read once."""
+		if extent[0] in self.index:
+			return self.index[extent[0]]
+		entries = {}
+		offset, size = extent[0], extent[1]
+		if offset + size > len(self.image):
+			raise IsoError("a directory lies past the end of the image")
+		data = self.image[offset:offset + size]
+		for sector in range(0, size, ISO_SECTOR_SIZE):
+			position = sector
+			end = min(sector + ISO_SECTOR_SIZE, size)
+			while position < end and data[position:position + 1] != b"\0":
+				length = ord(data[position:position + 1])
+				## Too short to hold a name, or running past its sector or
+				## the directory: the same tests as iso9660.c.
+				if length < 34 or position + length > sector + ISO_SECTOR_SIZE or position + length > size:
+					raise IsoError("a directory record is corrupted")
+				record = data[position:position + length]
+				if 33 + ord(record[32:33]) > length:
+					raise IsoError("a directory record is corrupted")
+				name = self.recordName(record)
+				if name and name not in entries:
+					entries[name] = self.extent(record)
+				position += length
+		self.index[extent[0]] = entries
+		return entries
+
+	def lookup(self, path):
+		"""The extent of a '/' separated path, or None."""
+		extent = self.root
+		for part in path.decode("utf-8", "replace").lower().split("/"):
+			if not part:
+				continue
+			if not extent[2]:
+				return None
+			extent = self.directory(extent).get(part)
+			if extent is None:
+				return None
+		return extent
+
+def fileExists(file):
+	"""Check if a file exists."""
+	return os.path.isfile(file)
 
 if  __name__ == '__main__':
-    main()
\ No newline at end of file
+	main()